@@ -253,7 +253,17 @@ HEADERS += src/engine/AST.h \
            src/engine/Package.h \
            src/engine/Assignment.h \
            src/engine/expression.h \
+           src/engine/exprcompiler.h \
+           src/engine/symbol.h \
            src/engine/function.h \
+           src/engine/FunctionCache.h \
+           src/engine/TableIndex.h \
+           src/engine/purity.h \
+           src/engine/ASTOptimizer.h \
+           src/engine/parallelfor.h \
+           src/engine/stacksegment.h \
+           src/engine/Profiler.h \
+           src/engine/Trace.h \
            src/engine/module.h \
            src/engine/UserModule.h \
 
@@ -262,7 +272,17 @@ SOURCES += src/engine/AST.cc \
            src/engine/Assignment.cc \
            src/porters/export_pdf.cc \
            src/engine/expr.cc \
+           src/engine/exprcompiler.cc \
+           src/engine/symbol.cc \
            src/engine/function.cc \
+           src/engine/FunctionCache.cc \
+           src/engine/TableIndex.cc \
+           src/engine/purity.cc \
+           src/engine/ASTOptimizer.cc \
+           src/engine/parallelfor.cc \
+           src/engine/stacksegment.cc \
+           src/engine/Profiler.cc \
+           src/engine/Trace.cc \
            src/engine/module.cc \
            src/engine/UserModule.cc \
            src/engine/annotation.cc
@@ -326,6 +346,8 @@ HEADERS += src/gui/version_check.h \
            src/engine/cgaladvnode.h \
            src/engine/importnode.h \
            src/porters/import.h \
+           src/porters/parseutils.h \
+           src/porters/scadmesh.h \
            src/engine/transformnode.h \
            src/engine/colornode.h \
            src/engine/rendernode.h \
@@ -343,6 +365,7 @@ HEADERS += src/gui/version_check.h \
            src/engine/math/polyset.h \
            src/common/printutils.h \
            src/common/fileutils.h \
+           src/common/ThreadPool.h \
            src/engine/value.h \
            src/engine/progress.h \
            src/gui/editor.h \
@@ -350,8 +373,10 @@ HEADERS += src/gui/version_check.h \
            src/engine/math/state.h \
            src/engine/nodecache.h \
            src/engine/nodedumper.h \
+           src/engine/nodehasher.h \
            src/engine/ModuleCache.h \
            src/engine/GeometryCache.h \
+           src/engine/DiskCache.h \
            src/engine/GeometryEvaluator.h \
            src/engine/Tree.h \
            src/gui/DrawingCallback.h \
@@ -472,14 +497,17 @@ SOURCES += \
            src/engine/parsersettings.cc \
            src/common/boost-utils.cc \
            src/common/PlatformUtils.cc \
+           src/common/ThreadPool.cc \
            src/gui/LibraryInfo.cc \
            src/engine/RenderStatistic.cc \
            \
            src/engine/nodedumper.cc \
+           src/engine/nodehasher.cc \
            src/engine/NodeVisitor.cc \
            src/engine/GeometryEvaluator.cc \
            src/engine/ModuleCache.cc \
            src/engine/GeometryCache.cc \
+           src/engine/DiskCache.cc \
            src/engine/Tree.cc \
 	       src/gui/DrawingCallback.cc \
 	       src/gui/FreetypeRenderer.cc \
@@ -508,6 +536,7 @@ SOURCES += \
            src/porters/export_amf.cc \
            src/porters/export_3mf.cc \
            src/porters/export_off.cc \
+           src/porters/export_scadmesh.cc \
            src/porters/export_dxf.cc \
            src/porters/export_svg.cc \
            src/porters/export_nef.cc \
@@ -515,6 +544,8 @@ SOURCES += \
            src/porters/import.cc \
            src/porters/import_stl.cc \
            src/porters/import_off.cc \
+           src/porters/import_scadmesh.cc \
+           src/porters/parseutils.cc \
            src/porters/import_svg.cc \
            src/porters/import_amf.cc \
            src/porters/import_3mf.cc \
@@ -660,6 +691,7 @@ HEADERS += src/engine/cgal.h \
 
 SOURCES += src/engine/cgalutils.cc \
            src/engine/cgalutils-applyops.cc \
+           src/engine/cgalutils-corefine.cc \
            src/engine/cgalutils-project.cc \
            src/engine/cgalutils-tess.cc \
            src/engine/cgalutils-polyhedron.cc \
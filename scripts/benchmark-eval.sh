@@ -0,0 +1,29 @@
+#!/bin/sh
+# Evaluates the expression benchmark corpus, without creating any geometry,
+# and reports the wall clock time of each run. Options starting with -- are
+# passed on to openscad, e.g. to compare --enable=bytecode against the default.
+#
+# Usage: benchmark-eval.sh [--openscad-option ...] [scad-file ...]
+
+cmd="openscad"
+[ -x "./openscad" ] && cmd="./openscad"
+[ -x "./OpenSCAD.app/Contents/MacOS/OpenSCAD" ] && cmd="./OpenSCAD.app/Contents/MacOS/OpenSCAD"
+
+options=""
+files=""
+for arg in "$@"; do
+  case "$arg" in
+    --*) options="$options $arg" ;;
+    *) files="$files $arg" ;;
+  esac
+done
+[ -z "$files" ] && files=`dirname $0`/../testdata/scad/benchmark/eval/*.scad
+
+mkdir -p output
+for f in $files; do
+  name=`basename $f .scad`
+  start=`date +%s.%N`
+  "$cmd" $options -o output/$name.echo $f > /dev/null 2>&1
+  end=`date +%s.%N`
+  echo "$name `echo "$end - $start" | bc` s"
+done
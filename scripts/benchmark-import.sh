@@ -0,0 +1,77 @@
+#!/bin/sh
+# Imports large generated ASCII and binary STL files and an OFF file, with 1
+# up to N render threads, and reports the wall clock time of each run. The
+# files are closed torus meshes with the given number of triangles (default
+# 2000000), written to output/ once.
+#
+# Usage: benchmark-import.sh [triangles] [max-threads]
+
+cmd="openscad"
+[ -x "./openscad" ] && cmd="./openscad"
+[ -x "./OpenSCAD.app/Contents/MacOS/OpenSCAD" ] && cmd="./OpenSCAD.app/Contents/MacOS/OpenSCAD"
+
+triangles=${1:-2000000}
+maxthreads=${2:-`getconf _NPROCESSORS_ONLN`}
+
+mkdir -p output
+for format in ascii binary off; do
+  file=output/torus-$triangles-$format.stl
+  [ $format = off ] && file=output/torus-$triangles.off
+  [ -f $file ] || python3 - $triangles $format $file <<'EOF'
+import math, struct, sys
+triangles, fmt, filename = int(sys.argv[1]), sys.argv[2], sys.argv[3]
+rows = max(3, int(math.sqrt(triangles / 2)))
+cols = max(3, triangles // (2 * rows))
+def vertex(i, j):
+    u, v = 2 * math.pi * (i % rows) / rows, 2 * math.pi * (j % cols) / cols
+    r = 100 + 30 * math.cos(v)
+    return (r * math.cos(u), r * math.sin(u), 30 * math.sin(v))
+def faces():
+    for i in range(rows):
+        for j in range(cols):
+            a, b, c, d = vertex(i, j), vertex(i + 1, j), vertex(i + 1, j + 1), vertex(i, j + 1)
+            yield a, b, c
+            yield a, c, d
+with open(filename, 'wb') as f:
+    if fmt == 'off':
+        f.write(b'OFF\n%d %d 0\n' % (rows * cols, 2 * rows * cols))
+        for i in range(rows):
+            for j in range(cols):
+                f.write(b'%r %r %r\n' % vertex(i, j))
+        for i in range(rows):
+            for j in range(cols):
+                a, b, c, d = i * cols + j, (i + 1) % rows * cols + j, (i + 1) % rows * cols + (j + 1) % cols, i * cols + (j + 1) % cols
+                f.write(b'3 %d %d %d\n3 %d %d %d\n' % (a, b, c, a, c, d))
+    elif fmt == 'ascii':
+        f.write(b'solid torus\n')
+        for face in faces():
+            lines = ['  facet normal 0 0 0\n    outer loop\n']
+            lines += ['      vertex %e %e %e\n' % v for v in face]
+            lines.append('    endloop\n  endfacet\n')
+            f.write(''.join(lines).encode())
+        f.write(b'endsolid torus\n')
+    else:
+        f.write(b'\0' * 80 + struct.pack('<I', 2 * rows * cols))
+        for face in faces():
+            f.write(struct.pack('<12fH', 0, 0, 0, *(x for v in face for x in v), 0))
+EOF
+  echo "import(\"`basename $file`\");" > output/import-$format.scad
+done
+
+# 1, 2, 4, ... and max-threads itself
+counts=""
+n=1
+while [ $n -lt $maxthreads ]; do
+  counts="$counts $n"
+  n=`expr $n \* 2`
+done
+counts="$counts $maxthreads"
+
+for format in ascii binary off; do
+  for threads in $counts; do
+    start=`date +%s.%N`
+    "$cmd" --render-threads=$threads -o output/import-$format.off output/import-$format.scad > /dev/null 2>&1
+    end=`date +%s.%N`
+    echo "import-$format triangles=$triangles threads=$threads `echo "$end - $start" | bc` s"
+  done
+done
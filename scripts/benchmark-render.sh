@@ -0,0 +1,34 @@
+#!/bin/sh
+# Renders the benchmark corpus with 1 up to N render threads and reports
+# the wall clock time of each run.
+#
+# Usage: benchmark-render.sh [max-threads] [scad-file ...]
+
+cmd="openscad"
+[ -x "./openscad" ] && cmd="./openscad"
+[ -x "./OpenSCAD.app/Contents/MacOS/OpenSCAD" ] && cmd="./OpenSCAD.app/Contents/MacOS/OpenSCAD"
+
+maxthreads=${1:-`getconf _NPROCESSORS_ONLN`}
+[ $# -gt 0 ] && shift
+files="$@"
+[ -z "$files" ] && files=`dirname $0`/../testdata/scad/benchmark/*.scad
+
+# 1, 2, 4, ... and max-threads itself
+counts=""
+n=1
+while [ $n -lt $maxthreads ]; do
+  counts="$counts $n"
+  n=`expr $n \* 2`
+done
+counts="$counts $maxthreads"
+
+mkdir -p output
+for f in $files; do
+  name=`basename $f .scad`
+  for threads in $counts; do
+    start=`date +%s.%N`
+    "$cmd" --render-threads=$threads -o output/$name.stl $f > /dev/null 2>&1
+    end=`date +%s.%N`
+    echo "$name threads=$threads `echo "$end - $start" | bc` s"
+  done
+done
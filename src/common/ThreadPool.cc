@@ -0,0 +1,175 @@
+#include "ThreadPool.h"
+#include "printutils.h"
+#include "PlatformUtils.h"
+
+ThreadPool *ThreadPool::inst = nullptr;
+
+namespace {
+	// The pool and queue index of the current thread, if it is a pool worker
+	thread_local const ThreadPool *current_pool = nullptr;
+	thread_local size_t current_index = 0;
+}
+
+struct ThreadPool::Batch {
+	Batch(size_t size) : remaining(size), exceptions(size), messages(size) {}
+	std::atomic<size_t> remaining;
+	std::vector<std::exception_ptr> exceptions;
+	std::vector<std::vector<Message>> messages;
+};
+
+ThreadPool::~ThreadPool()
+{
+	stop();
+}
+
+void ThreadPool::setNumThreads(unsigned int n)
+{
+	if (n == 0) n = boost::thread::hardware_concurrency();
+	if (n == 0) n = 1;
+	if (n == this->numthreads) return;
+
+	stop();
+	this->numthreads = n;
+	start();
+}
+
+void ThreadPool::start()
+{
+	if (!isParallel()) return;
+
+	// The thread calling run() does its share of the work, so we need one
+	// worker less than the requested number of threads.
+	for (unsigned int i = 0; i < this->numthreads; ++i) {
+		this->queues.emplace_back(new Queue);
+	}
+	for (unsigned int i = 0; i + 1 < this->numthreads; ++i) {
+		boost::thread::attributes attrs;
+		// Evaluating deep subtrees needs as much stack as the main thread gets,
+		// as StackCheck allows each thread to use that much
+		attrs.set_stack_size(PlatformUtils::stackLimit() + STACK_BUFFER_SIZE);
+		this->threads.emplace_back(attrs, [this, i]() { workerLoop(i); });
+	}
+}
+
+void ThreadPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->wakeup.notify_all();
+	for (auto &thread : this->threads) thread.join();
+	this->threads.clear();
+	this->queues.clear();
+	this->stopping = false;
+}
+
+void ThreadPool::workerLoop(size_t index)
+{
+	current_pool = this;
+	current_index = index;
+	while (true) {
+		Job job;
+		if (pop(job)) {
+			execute(job);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->wakeup.wait(lock, [this]() { return this->stopping || this->queued > 0; });
+		if (this->stopping) return;
+	}
+}
+
+void ThreadPool::push(const Job &job)
+{
+	// Threads outside the pool share the last queue
+	const size_t index = current_pool == this ? current_index : this->queues.size() - 1;
+	{
+		auto &queue = *this->queues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(job);
+	}
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->queued++;
+	}
+	this->wakeup.notify_one();
+}
+
+/*!
+	Takes the most recently pushed job from our own queue, or steals the
+	oldest job from another queue if ours is empty.
+*/
+bool ThreadPool::pop(Job &job)
+{
+	const size_t numqueues = this->queues.size();
+	const size_t own = current_pool == this ? current_index : numqueues - 1;
+	for (size_t i = 0; i < numqueues; ++i) {
+		auto &queue = *this->queues[(own + i) % numqueues];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.jobs.empty()) continue;
+		if (i == 0) {
+			job = queue.jobs.back();
+			queue.jobs.pop_back();
+		}
+		else {
+			job = queue.jobs.front();
+			queue.jobs.pop_front();
+		}
+		this->queued--;
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::execute(const Job &job)
+{
+	{
+		MessageCapture capture(job.batch->messages[job.index]);
+		try {
+			(*job.task)();
+		} catch (...) {
+			job.batch->exceptions[job.index] = std::current_exception();
+		}
+	}
+	// The batch may go away as soon as the last job is done, so don't touch it after this
+	if (--job.batch->remaining == 0) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->wakeup.notify_all();
+	}
+}
+
+/*!
+	Runs all tasks and returns when they are done. Tasks may call run()
+	themselves.
+
+	Once all tasks have finished, their messages are printed in task order.
+	If a task threw, output stops after its messages and its exception is
+	rethrown, just like when running the tasks one after another.
+*/
+void ThreadPool::run(const std::vector<Task> &tasks)
+{
+	if (!isParallel() || tasks.size() < 2) {
+		for (const auto &task : tasks) task();
+		return;
+	}
+
+	Batch batch(tasks.size());
+	// Pushed in reverse, so the calling thread starts with the first task
+	for (size_t i = tasks.size(); i-- > 0;) push(Job{&tasks[i], &batch, i});
+
+	while (batch.remaining > 0) {
+		Job job;
+		if (pop(job)) {
+			execute(job);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->wakeup.wait(lock, [&]() { return batch.remaining == 0 || this->queued > 0; });
+	}
+
+	for (size_t i = 0; i < tasks.size(); ++i) {
+		for (const auto &msg : batch.messages[i]) PRINT(msg);
+		if (batch.exceptions[i]) std::rethrow_exception(batch.exceptions[i]);
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <boost/thread/thread.hpp>
+
+/*!
+	Work-stealing thread pool for fork-join parallelism.
+
+	Each worker owns a task queue. Tasks forked from a worker go to the back of
+	its own queue and are taken from there (LIFO), while idle workers steal
+	from the front of other queues, so large subtrees near the root get
+	distributed first. A thread waiting in run() keeps executing queued tasks
+	until its own batch is done, which makes nested run() calls deadlock free.
+
+	Messages printed by tasks are captured and replayed in task order once the
+	batch is done, so the output doesn't depend on scheduling either.
+
+	The pool defaults to a single thread, in which case run() simply executes
+	the tasks in order on the calling thread.
+*/
+class ThreadPool
+{
+public:
+	typedef std::function<void()> Task;
+
+	ThreadPool() : numthreads(1), stopping(false), queued(0) {}
+	~ThreadPool();
+
+	static ThreadPool *instance() { if (!inst) inst = new ThreadPool; return inst; }
+
+	unsigned int numThreads() const { return this->numthreads; }
+	// 0 means one thread per hardware core. Must not be called while tasks are running.
+	void setNumThreads(unsigned int n);
+	bool isParallel() const { return this->numthreads > 1; }
+
+	void run(const std::vector<Task> &tasks);
+
+private:
+	struct Batch;
+	struct Job {
+		const Task *task;
+		Batch *batch;
+		size_t index;
+	};
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	static ThreadPool *inst;
+
+	void start();
+	void stop();
+	void workerLoop(size_t index);
+	void push(const Job &job);
+	bool pop(Job &job);
+	void execute(const Job &job);
+
+	unsigned int numthreads;
+	std::vector<boost::thread> threads;
+	// One queue per worker, plus a shared one for threads outside the pool
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	bool stopping;
+	std::atomic<size_t> queued;
+};
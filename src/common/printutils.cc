@@ -1,6 +1,7 @@
 #include "printutils.h"
 #include <sstream>
 #include <cstdio>
+#include <mutex>
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/circular_buffer.hpp>
@@ -30,6 +31,20 @@ int count=0;
 namespace {
 	bool no_throw;
 	bool deferred;
+	// Serializes output and the message history from multiple threads
+	std::recursive_mutex print_mutex;
+	thread_local std::vector<Message> *captured_messages = nullptr;
+	thread_local size_t message_count = 0;
+}
+
+MessageCapture::MessageCapture(std::vector<Message> &messages) : previous(captured_messages)
+{
+	captured_messages = &messages;
+}
+
+MessageCapture::~MessageCapture()
+{
+	captured_messages = this->previous;
 }
 
 void set_output_handler(OutputHandlerFunc *newhandler, OutputHandlerFunc2 *newhandler2, void *userdata)
@@ -73,6 +88,23 @@ void print_messages_pop()
 void PRINT(const Message& msgObj)
 {
 	if (msgObj.msg.empty() && msgObj.group != message_group::Echo) return;
+	message_count++;
+
+	if (captured_messages) {
+		captured_messages->push_back(msgObj);
+		// Stop the task early, replaying the message will throw again
+		if (OpenSCAD::hardwarnings && !no_throw && msgObj.group == message_group::Warning && !std::current_exception()) {
+			throw HardWarningException(msgObj.msg);
+		}
+		return;
+	}
+
+	std::lock_guard<std::recursive_mutex> lock(print_mutex);
+
+	//check for deprecations
+	if (msgObj.group == message_group::Deprecated) {
+		if (!printedDeprecations.insert(msgObj.msg + msgObj.loc.toRelativeString(msgObj.docPath)).second) return;
+	}
 
 	if (print_messages_stack.size() > 0) {
 		if (!print_messages_stack.back().empty()) {
@@ -89,10 +121,16 @@ void PRINT(const Message& msgObj)
 	}
 }
 
+size_t thread_message_count()
+{
+	return message_count;
+}
+
 void PRINT_NOCACHE(const Message& msgObj)
 {
 	if (msgObj.msg.empty() && msgObj.group != message_group::Echo) return;
 
+	std::lock_guard<std::recursive_mutex> lock(print_mutex);
 	const auto msg = msgObj.str();
 
 	if (msgObj.group == message_group::Warning || msgObj.group == message_group::Error || msgObj.group == message_group::Trace) {
@@ -164,6 +202,7 @@ std::string two_digit_exp_format(double x)
 
 void resetSuppressedMessages()
 {
+	std::lock_guard<std::recursive_mutex> lock(print_mutex);
 	printedDeprecations.clear();
 	lastmessages.clear();
 }
@@ -6,6 +6,7 @@
 #include <boost/format.hpp>
 #include <boost/algorithm/string.hpp>
 #include <utility>
+#include <vector>
 #include <libintl.h>
 #undef snprintf
 #include <locale.h>
@@ -84,6 +85,24 @@ void resetSuppressedMessages();
 void PRINT(const Message &msgObj);
 
 void PRINT_NOCACHE(const Message &msgObj);
+
+// Number of messages printed on the current thread so far
+size_t thread_message_count();
+
+/*!
+	While in scope, messages printed on the current thread are collected
+	instead of being output. Parallel tasks use this so their output can be
+	replayed with PRINT() in a deterministic order.
+*/
+class MessageCapture
+{
+public:
+	MessageCapture(std::vector<Message> &messages);
+	~MessageCapture();
+
+private:
+	std::vector<Message> *previous;
+};
 #define PRINTB_NOCACHE(_fmt, _arg) do { } while (0)
 // #define PRINTB_NOCACHE(_fmt, _arg) do { PRINT_NOCACHE(str(boost::format(_fmt) % _arg)); } while (0)
 
@@ -176,18 +195,12 @@ public:
 	}
 };
 
-extern std::set<std::string> printedDeprecations;
-
 template <typename F, typename... Args>
 void LOG(const message_group &msg_grp,const Location &loc,const std::string &docPath,F&& f, Args&&... args)
 {	
 	const auto msg = MessageClass<Args...>(std::forward<F>(f), std::forward<Args>(args)...);
 	const auto formatted = msg.format();
 
-	//check for deprecations
-	if (msg_grp == message_group::Deprecated && printedDeprecations.find(formatted+loc.toRelativeString(docPath)) != printedDeprecations.end()) return;
-	if(msg_grp == message_group::Deprecated) printedDeprecations.insert(formatted+loc.toRelativeString(docPath));
-
 	Message msgObj = {formatted,loc,docPath,msg_grp};
 
 	PRINT(msgObj);
@@ -0,0 +1,544 @@
+#define _USE_MATH_DEFINES
+#include <cmath>
+
+#include "ASTOptimizer.h"
+#include "FileModule.h"
+#include "UserModule.h"
+#include "ModuleInstantiation.h"
+#include "builtincontext.h"
+#include "expression.h"
+#include "function.h"
+#include "exceptions.h"
+#include "../common/printutils.h"
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+	// Builtin functions with results depending only on their arguments
+	bool is_foldable_builtin(const std::string &name)
+	{
+		static const std::unordered_set<std::string> names{
+			"abs", "sign", "min", "max", "sin", "cos", "asin", "acos", "tan", "atan", "atan2",
+			"round", "ceil", "floor", "pow", "sqrt", "exp", "log", "ln", "len", "str", "chr", "ord",
+			"concat", "lookup", "norm", "cross", "is_list", "is_num", "is_bool", "is_string"
+		};
+		return names.count(name) != 0;
+	}
+
+	void collect_function_names(const LocalScope &scope, std::unordered_set<std::string> &names)
+	{
+		for (const auto &f : scope.astFunctions) names.insert(f.first);
+		for (const auto &m : scope.astModules) collect_function_names(m.second->scope, names);
+		for (const auto &inst : scope.children_inst) {
+			collect_function_names(inst->scope, names);
+			if (const auto ifelse = dynamic_cast<const IfElseModuleInstantiation *>(inst.get())) {
+				collect_function_names(ifelse->else_scope, names);
+			}
+		}
+	}
+
+	bool is_literal(const shared_ptr<Expression> &expr)
+	{
+		return expr && typeid(*expr) == typeid(Literal);
+	}
+}
+
+/*!
+	Rewrites a file's syntax tree in place, keeping track of the variables
+	in scope. This is a friend of the Expression subclasses.
+*/
+class ASTOptimizer
+{
+public:
+	ASTOptimizer(const FileModule &module)
+		: context(Context::create<BuiltinContext>()), constants(nullptr), calls(false), usesLibraries(module.usesLibraries())
+	{
+		collect_function_names(module.scope, this->functions);
+		for (const auto &assignment : module.scope.assignments) this->toplevel.insert(assignment->getName());
+	}
+
+	void optimize(FileModule &module)
+	{
+		const auto &scope = module.scope;
+		ConstantMap constants;
+		if (!this->toplevel.count("PI")) constants.emplace(Symbol("PI").index(), ValuePtr(M_PI));
+
+		// Functions may be called while the top-level assignments are evaluated, so
+		// they only get the constants assigned before the first such call
+		ConstantMap function_constants;
+		bool called = false;
+		for (const auto &assignment : scope.assignments) {
+			this->constants = &constants;
+			this->calls = false;
+			foldAssignment(*assignment);
+			if (this->calls && !called) {
+				function_constants = constants;
+				called = true;
+			}
+			const auto &expr = assignment->getExpr();
+			if (is_literal(expr) && assignment->getName()[0] != '$') {
+				constants.emplace(assignment->getSymbol().index(), static_cast<const Literal &>(*expr).value);
+			}
+		}
+		if (!called) function_constants = constants;
+
+		this->constants = &function_constants;
+		for (const auto &f : scope.astFunctions) optimizeFunction(*f.second);
+		// Modules are only instantiated after all top-level assignments
+		this->constants = &constants;
+		for (const auto &m : scope.astModules) optimizeModule(*m.second);
+		for (const auto &inst : scope.children_inst) optimizeInstantiation(*inst);
+	}
+
+private:
+	typedef std::unordered_map<uint32_t, ValuePtr> ConstantMap;
+
+	// Simplifies expr, replacing it if needed
+	void fold(shared_ptr<Expression> &expr)
+	{
+		if (!expr) return;
+
+		const auto &type = typeid(*expr);
+		if (type == typeid(Lookup)) {
+			const auto value = constant(static_cast<const Lookup &>(*expr).symbol);
+			if (value) expr = make_shared<Literal>(*value, expr->location());
+		}
+		else if (type == typeid(UnaryOp)) {
+			auto &op = static_cast<UnaryOp &>(*expr);
+			fold(op.expr);
+			if (is_literal(op.expr)) evaluate(expr);
+		}
+		else if (type == typeid(BinaryOp)) {
+			foldBinary(expr);
+		}
+		else if (type == typeid(TernaryOp)) {
+			auto &op = static_cast<TernaryOp &>(*expr);
+			fold(op.cond);
+			fold(op.ifexpr);
+			fold(op.elseexpr);
+			if (is_literal(op.cond)) {
+				const bool cond = static_cast<const Literal &>(*op.cond).value;
+				expr = cond ? op.ifexpr : op.elseexpr;
+			}
+		}
+		else if (type == typeid(ArrayLookup)) {
+			auto &lookup = static_cast<ArrayLookup &>(*expr);
+			fold(lookup.array);
+			fold(lookup.index);
+			if (is_literal(lookup.array) && is_literal(lookup.index)) evaluate(expr);
+		}
+		else if (type == typeid(MemberLookup)) {
+			auto &lookup = static_cast<MemberLookup &>(*expr);
+			fold(lookup.expr);
+			if (is_literal(lookup.expr)) evaluate(expr);
+		}
+		else if (type == typeid(Range)) {
+			auto &range = static_cast<Range &>(*expr);
+			fold(range.begin);
+			fold(range.step);
+			fold(range.end);
+			if (is_literal(range.begin) && (!range.step || is_literal(range.step)) && is_literal(range.end)) {
+				evaluate(expr);
+			}
+		}
+		else if (type == typeid(Vector)) {
+			bool literal = true;
+			for (auto &child : static_cast<Vector &>(*expr).children) {
+				fold(child);
+				literal = literal && is_literal(child);
+			}
+			if (literal) evaluate(expr);
+		}
+		else if (type == typeid(FunctionCall)) {
+			auto &call = static_cast<FunctionCall &>(*expr);
+			if (!call.isLookup) fold(call.expr);
+			const bool literal = foldAssignments(call.arguments);
+			if (!isFoldableCall(call)) this->calls = true;
+			else if (literal) evaluate(expr);
+		}
+		// Function literals are left as written, as function values print their body
+		else if (type == typeid(Let)) {
+			auto &let = static_cast<Let &>(*expr);
+			foldScope(let.arguments, let.expr);
+		}
+		else if (type == typeid(Echo)) {
+			auto &echo = static_cast<Echo &>(*expr);
+			foldAssignments(echo.arguments);
+			fold(echo.expr);
+		}
+		else if (type == typeid(Assert)) {
+			// The message of a failed assert() shows its condition as written
+			fold(static_cast<Assert &>(*expr).expr);
+		}
+		else if (type == typeid(LcIf)) {
+			auto &lc = static_cast<LcIf &>(*expr);
+			fold(lc.cond);
+			fold(lc.ifexpr);
+			fold(lc.elseexpr);
+		}
+		else if (type == typeid(LcEach)) {
+			fold(static_cast<LcEach &>(*expr).expr);
+		}
+		else if (type == typeid(LcLet)) {
+			auto &lc = static_cast<LcLet &>(*expr);
+			foldScope(lc.arguments, lc.expr);
+		}
+		else if (type == typeid(LcFor)) {
+			auto &lc = static_cast<LcFor &>(*expr);
+			foldAssignments(lc.arguments);
+			const size_t loop = this->bound.size();
+			bind(lc.arguments);
+			fold(lc.expr);
+			hoist(lc, loop);
+			this->bound.resize(loop);
+		}
+		else if (type == typeid(LcForC)) {
+			auto &lc = static_cast<LcForC &>(*expr);
+			const size_t size = this->bound.size();
+			bind(lc.arguments);
+			foldAssignments(lc.arguments);
+			fold(lc.cond);
+			foldAssignments(lc.incr_arguments);
+			fold(lc.expr);
+			this->bound.resize(size);
+		}
+	}
+
+	void foldBinary(shared_ptr<Expression> &expr)
+	{
+		auto &op = static_cast<BinaryOp &>(*expr);
+		fold(op.left);
+		fold(op.right);
+		if (!is_literal(op.left)) return;
+
+		if (op.op == BinaryOp::Op::LogicalAnd || op.op == BinaryOp::Op::LogicalOr) {
+			// Short-circuit: the right operand doesn't matter
+			const bool left = static_cast<const Literal &>(*op.left).value;
+			if (op.op == BinaryOp::Op::LogicalAnd ? !left : left) {
+				expr = make_shared<Literal>(ValuePtr(left), expr->location());
+				return;
+			}
+		}
+		if (is_literal(op.right)) evaluate(expr);
+	}
+
+	// Folds the expressions of the assignments, returns true if all of them are literals now
+	bool foldAssignments(const AssignmentList &assignments)
+	{
+		bool literal = true;
+		for (const auto &assignment : assignments) {
+			foldAssignment(*assignment);
+			literal = literal && is_literal(assignment->getExpr());
+		}
+		return literal;
+	}
+
+	void foldAssignment(Assignment &assignment)
+	{
+		auto expr = assignment.getExpr();
+		if (!expr) return;
+		fold(expr);
+		assignment.setExpr(expr);
+	}
+
+	// let(), function definitions: the assigned names are visible in the body
+	void foldScope(const AssignmentList &assignments, shared_ptr<Expression> &body)
+	{
+		const size_t size = this->bound.size();
+		bind(assignments);
+		foldAssignments(assignments);
+		fold(body);
+		this->bound.resize(size);
+	}
+
+	// Replaces expr by its value, unless evaluating it fails or prints anything
+	void evaluate(shared_ptr<Expression> &expr)
+	{
+		std::vector<Message> messages;
+		ValuePtr value;
+		try {
+			MessageCapture capture(messages);
+			value = expr->evaluate(this->context.ctx);
+		} catch (const EvaluationException &) {
+			return;
+		}
+		if (messages.empty()) expr = make_shared<Literal>(value, expr->location());
+	}
+
+	void optimizeFunction(UserFunction &function)
+	{
+		foldScope(function.definition_arguments, function.expr);
+	}
+
+	void optimizeModule(UserModule &module)
+	{
+		const size_t size = this->bound.size();
+		bind(module.definition_arguments);
+		foldAssignments(module.definition_arguments);
+		optimizeScope(module.scope, true);
+		this->bound.resize(size);
+	}
+
+	void optimizeInstantiation(ModuleInstantiation &inst)
+	{
+		const size_t size = this->bound.size();
+		// for(), let() etc. make their arguments visible to the children
+		for (const auto &arg : inst.arguments) {
+			if (!arg->getName().empty()) this->bound.push_back(arg->getSymbol());
+		}
+		if (inst.name() != "assert") foldAssignments(inst.arguments);
+		optimizeScope(inst.scope, false);
+		if (const auto ifelse = dynamic_cast<IfElseModuleInstantiation *>(&inst)) {
+			optimizeScope(ifelse->else_scope, false);
+		}
+		this->bound.resize(size);
+	}
+
+	void optimizeScope(LocalScope &scope, bool module)
+	{
+		const size_t size = this->bound.size();
+		bind(scope.assignments);
+		for (const auto &assignment : scope.assignments) {
+			// Modules warn about parameters overwritten with literals, so don't make new ones
+			if (!module || assignment->getExpr()->isLiteral()) foldAssignment(*assignment);
+		}
+		for (const auto &f : scope.astFunctions) optimizeFunction(*f.second);
+		for (const auto &m : scope.astModules) optimizeModule(*m.second);
+		for (const auto &inst : scope.children_inst) optimizeInstantiation(*inst);
+		this->bound.resize(size);
+	}
+
+	/*
+		Loop invariant hoisting.
+
+		The largest subexpressions of the body which only read variables bound
+		outside the loop get evaluated once before it, see LcFor::evaluate().
+	*/
+	void hoist(LcFor &lc, size_t loop)
+	{
+		if (lc.hoisted) return;
+		AssignmentList invariants;
+		auto body = rewrite(lc.expr, loop, invariants);
+		if (invariants.empty()) return;
+		lc.invariants = std::move(invariants);
+		lc.hoisted = std::move(body);
+	}
+
+	// Returns expr with its invariants replaced by lookups, copying the nodes on the way
+	shared_ptr<Expression> rewrite(const shared_ptr<Expression> &expr, size_t loop, AssignmentList &invariants)
+	{
+		if (!expr) return expr;
+
+		const auto &type = typeid(*expr);
+		if (type != typeid(Literal) && type != typeid(Lookup) && isInvariant(*expr, loop)) {
+			std::string name;
+			do {
+				name = "_h" + std::to_string(this->hoistedCount++);
+			} while (Symbol::exists(name));
+			invariants.push_back(assignment(name, expr, expr->location()));
+			return make_shared<Lookup>(name, expr->location());
+		}
+
+		if (type == typeid(UnaryOp)) {
+			return rewriteNode<UnaryOp>(expr, loop, invariants, &UnaryOp::expr);
+		}
+		else if (type == typeid(BinaryOp)) {
+			return rewriteNode<BinaryOp>(expr, loop, invariants, &BinaryOp::left, &BinaryOp::right);
+		}
+		else if (type == typeid(TernaryOp)) {
+			return rewriteNode<TernaryOp>(expr, loop, invariants, &TernaryOp::cond, &TernaryOp::ifexpr, &TernaryOp::elseexpr);
+		}
+		else if (type == typeid(ArrayLookup)) {
+			return rewriteNode<ArrayLookup>(expr, loop, invariants, &ArrayLookup::array, &ArrayLookup::index);
+		}
+		else if (type == typeid(MemberLookup)) {
+			return rewriteNode<MemberLookup>(expr, loop, invariants, &MemberLookup::expr);
+		}
+		else if (type == typeid(Range)) {
+			return rewriteNode<Range>(expr, loop, invariants, &Range::begin, &Range::step, &Range::end);
+		}
+		else if (type == typeid(LcIf)) {
+			return rewriteNode<LcIf>(expr, loop, invariants, &LcIf::cond, &LcIf::ifexpr, &LcIf::elseexpr);
+		}
+		else if (type == typeid(LcEach)) {
+			return rewriteNode<LcEach>(expr, loop, invariants, &LcEach::expr);
+		}
+		else if (type == typeid(Vector)) {
+			const auto &vector = static_cast<const Vector &>(*expr);
+			std::vector<shared_ptr<Expression>> children;
+			bool changed = false;
+			for (const auto &child : vector.children) {
+				children.push_back(rewrite(child, loop, invariants));
+				changed = changed || children.back() != child;
+			}
+			if (!changed) return expr;
+			auto copy = make_shared<Vector>(vector);
+			copy->children = std::move(children);
+			return copy;
+		}
+		else if (type == typeid(FunctionCall)) {
+			const auto &call = static_cast<const FunctionCall &>(*expr);
+			AssignmentList arguments;
+			if (!rewriteAssignments(call.arguments, loop, invariants, arguments)) return expr;
+			auto copy = make_shared<FunctionCall>(call);
+			copy->arguments = std::move(arguments);
+			return copy;
+		}
+		else if (type == typeid(Let)) {
+			return rewriteScope<Let>(expr, loop, invariants);
+		}
+		else if (type == typeid(LcLet)) {
+			return rewriteScope<LcLet>(expr, loop, invariants);
+		}
+		// Nested loops hoist their own invariants
+		return expr;
+	}
+
+	template <typename T, typename... Members>
+	shared_ptr<Expression> rewriteNode(const shared_ptr<Expression> &expr, size_t loop, AssignmentList &invariants, Members... members)
+	{
+		const auto &node = static_cast<const T &>(*expr);
+		shared_ptr<T> copy;
+		for (const auto member : {members...}) {
+			auto child = rewrite(node.*member, loop, invariants);
+			if (child == node.*member) continue;
+			if (!copy) copy = make_shared<T>(node);
+			(*copy).*member = std::move(child);
+		}
+		return copy ? copy : expr;
+	}
+
+	template <typename T>
+	shared_ptr<Expression> rewriteScope(const shared_ptr<Expression> &expr, size_t loop, AssignmentList &invariants)
+	{
+		const auto &node = static_cast<const T &>(*expr);
+		const size_t size = this->bound.size();
+		bind(node.arguments);
+		AssignmentList arguments;
+		const bool changed = rewriteAssignments(node.arguments, loop, invariants, arguments);
+		auto body = rewrite(node.expr, loop, invariants);
+		this->bound.resize(size);
+		if (!changed && body == node.expr) return expr;
+		auto copy = make_shared<T>(node);
+		if (changed) copy->arguments = std::move(arguments);
+		copy->expr = std::move(body);
+		return copy;
+	}
+
+	// Returns true if any of the expressions changed, with the new assignments in result
+	bool rewriteAssignments(const AssignmentList &assignments, size_t loop, AssignmentList &invariants, AssignmentList &result)
+	{
+		bool changed = false;
+		for (const auto &a : assignments) {
+			auto expr = rewrite(a->getExpr(), loop, invariants);
+			if (expr == a->getExpr()) {
+				result.push_back(a);
+			}
+			else {
+				result.push_back(assignment(a->getName(), expr, a->location()));
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+	// True if expr has no side effects and doesn't read any variables bound by the loop or inside it
+	bool isInvariant(const Expression &expr, size_t loop) const
+	{
+		const auto &type = typeid(expr);
+		if (type == typeid(Literal)) {
+			return true;
+		}
+		else if (type == typeid(Lookup)) {
+			const auto &sym = static_cast<const Lookup &>(expr).symbol;
+			if (sym.isConfigVariable()) return false;
+			for (size_t i = loop; i < this->bound.size(); ++i) {
+				if (this->bound[i] == sym) return false;
+			}
+			return true;
+		}
+		else if (type == typeid(UnaryOp)) {
+			return isInvariant(*static_cast<const UnaryOp &>(expr).expr, loop);
+		}
+		else if (type == typeid(BinaryOp)) {
+			const auto &op = static_cast<const BinaryOp &>(expr);
+			return isInvariant(*op.left, loop) && isInvariant(*op.right, loop);
+		}
+		else if (type == typeid(TernaryOp)) {
+			const auto &op = static_cast<const TernaryOp &>(expr);
+			return isInvariant(*op.cond, loop) && isInvariant(*op.ifexpr, loop) && isInvariant(*op.elseexpr, loop);
+		}
+		else if (type == typeid(ArrayLookup)) {
+			const auto &lookup = static_cast<const ArrayLookup &>(expr);
+			return isInvariant(*lookup.array, loop) && isInvariant(*lookup.index, loop);
+		}
+		else if (type == typeid(MemberLookup)) {
+			return isInvariant(*static_cast<const MemberLookup &>(expr).expr, loop);
+		}
+		else if (type == typeid(Range)) {
+			const auto &range = static_cast<const Range &>(expr);
+			return isInvariant(*range.begin, loop) && (!range.step || isInvariant(*range.step, loop)) && isInvariant(*range.end, loop);
+		}
+		else if (type == typeid(Vector)) {
+			for (const auto &child : static_cast<const Vector &>(expr).children) {
+				if (dynamic_cast<const ListComprehension *>(child.get()) || !isInvariant(*child, loop)) return false;
+			}
+			return true;
+		}
+		else if (type == typeid(FunctionCall)) {
+			const auto &call = static_cast<const FunctionCall &>(expr);
+			if (!isFoldableCall(call)) return false;
+			for (const auto &arg : call.arguments) {
+				if (!isInvariant(*arg->getExpr(), loop)) return false;
+			}
+			return true;
+		}
+		return false;
+	}
+
+	// A call of a builtin function which can't be replaced by any function with the same name
+	bool isFoldableCall(const FunctionCall &call) const
+	{
+		return call.isLookup && !this->usesLibraries && is_foldable_builtin(call.name) &&
+			!this->functions.count(call.name) && !this->toplevel.count(call.name) && !isBound(Symbol(call.name));
+	}
+
+	void bind(const AssignmentList &assignments)
+	{
+		for (const auto &assignment : assignments) this->bound.push_back(assignment->getSymbol());
+	}
+
+	bool isBound(const Symbol &sym) const
+	{
+		for (const auto &b : this->bound) {
+			if (b == sym) return true;
+		}
+		return false;
+	}
+
+	// The value of a top-level variable, if it's a known constant here
+	const ValuePtr *constant(const Symbol &sym) const
+	{
+		if (sym.isConfigVariable() || isBound(sym)) return nullptr;
+		const auto it = this->constants->find(sym.index());
+		return it == this->constants->end() ? nullptr : &it->second;
+	}
+
+	// Context for evaluating folded expressions; these don't read any variables
+	ContextHandle<BuiltinContext> context;
+	// Variables bound by anything but top-level assignments, innermost last
+	std::vector<Symbol> bound;
+	const ConstantMap *constants;
+	std::unordered_set<std::string> toplevel;
+	std::unordered_set<std::string> functions;
+	// Set when visiting any call which might run user code
+	bool calls;
+	const bool usesLibraries;
+	size_t hoistedCount = 0;
+};
+
+void optimize_ast(FileModule &module)
+{
+	ASTOptimizer(module).optimize(module);
+}
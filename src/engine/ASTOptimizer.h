@@ -0,0 +1,19 @@
+#pragma once
+
+class FileModule;
+
+/*!
+	Simplifies the syntax tree of a parsed file before it is evaluated:
+
+	- Operators, vectors, ranges and calls of math builtins with constant
+	  operands are folded into literals.
+	- References to top-level variables with constant values are replaced by
+	  those values, where the variable is known to be set at that point.
+	- Subexpressions of list comprehension for() bodies which don't depend on
+	  the loop are evaluated once before the loop, instead of every iteration.
+
+	Evaluating the optimized tree gives the same results and messages as the
+	original one; anything which would print a message is left alone. Only
+	the file itself is optimized, not the libraries it uses.
+*/
+void optimize_ast(FileModule &module);
@@ -6,19 +6,21 @@
 #include "AST.h"
 #include "memory.h"
 #include "annotation.h"
+#include "symbol.h"
 
 class Assignment :  public ASTNode
 {
 public:
 	Assignment(std::string name, const Location &loc)
-				: ASTNode(loc), name(name) { }
+				: ASTNode(loc), name(name), symbol(name) { }
 	Assignment(std::string name,
 						 shared_ptr<class Expression> expr = shared_ptr<class Expression>(),
 						 const Location &loc = Location::NONE)
-		: ASTNode(loc), name(name), expr(expr) { }
+		: ASTNode(loc), name(name), symbol(name), expr(expr) { }
 	
 	void print(std::ostream &stream, const std::string &indent) const override;
 	const std::string& getName() const { return name; };
+	const Symbol& getSymbol() const { return symbol; };
 	const shared_ptr<Expression>& getExpr() const { return expr; };
 	// setExpr used by customizer parameterobject etc.
 	void setExpr(shared_ptr<Expression> e) { expr = std::move(e); };
@@ -29,6 +31,7 @@ public:
 
 protected:
 	const std::string name;
+	const Symbol symbol;
 	shared_ptr<class Expression> expr;
 	AnnotationMap annotations;
 };
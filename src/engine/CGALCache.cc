@@ -8,42 +8,61 @@ CGALCache::CGALCache(size_t limit) : cache(limit)
 {
 }
 
-shared_ptr<const CGAL_Nef_polyhedron> CGALCache::get(const std::string &id) const
+shared_ptr<const CGAL_Nef_polyhedron> CGALCache::get(const NodeKey &id) const
 {
-	const auto &N = this->cache[id]->N;
+	shared_ptr<const CGAL_Nef_polyhedron> N;
+	lookup(id, N);
+	return N;
+}
+
+/*!
+	Like contains() followed by get(), without the entry possibly being
+	evicted by another thread in between.
+*/
+bool CGALCache::lookup(const NodeKey &id, shared_ptr<const CGAL_Nef_polyhedron> &N) const
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	const auto entry = this->cache[id];
+	if (!entry) return false;
+	N = entry->N;
 #ifdef DEBUG
-	LOG(message_group::None,Location::NONE,"","CGAL Cache hit: %1$s (%2$d bytes)",id.substr(0, 40),N ? N->memsize() : 0);
+	LOG(message_group::None,Location::NONE,"","CGAL Cache hit: %1$s (%2$d bytes)",id,N ? N->memsize() : 0);
 #endif
-	return N;
+	return true;
 }
 
-bool CGALCache::insert(const std::string &id, const shared_ptr<const CGAL_Nef_polyhedron> &N)
+bool CGALCache::insert(const NodeKey &id, const shared_ptr<const CGAL_Nef_polyhedron> &N)
 {
+	std::lock_guard<std::mutex> lock(this->mutex);
 	auto inserted = this->cache.insert(id, new cache_entry(N), N ? N->memsize() : 0);
 #ifdef DEBUG
-	if (inserted) LOG(message_group::None,Location::NONE,"","CGAL Cache insert: %1$s (%2$d bytes)",id.substr(0, 40), (N ? N->memsize() : 0));
-	else LOG(message_group::None,Location::NONE,"","CGAL Cache insert failed: %1$s (%2$d bytes)",id.substr(0, 40), (N ? N->memsize() : 0));
+	if (inserted) LOG(message_group::None,Location::NONE,"","CGAL Cache insert: %1$s (%2$d bytes)",id, (N ? N->memsize() : 0));
+	else LOG(message_group::None,Location::NONE,"","CGAL Cache insert failed: %1$s (%2$d bytes)",id, (N ? N->memsize() : 0));
 #endif
 	return inserted;
 }
 
 size_t CGALCache::maxSizeMB() const
 {
+	std::lock_guard<std::mutex> lock(this->mutex);
 	return this->cache.maxCost()/(1024*1024);
 }
 
 void CGALCache::setMaxSizeMB(size_t limit)
 {
+	std::lock_guard<std::mutex> lock(this->mutex);
 	this->cache.setMaxCost(limit*1024*1024);
 }
 
 void CGALCache::clear()
 {
+	std::lock_guard<std::mutex> lock(this->mutex);
 	cache.clear();
 }
 
 void CGALCache::print()
 {
+	std::lock_guard<std::mutex> lock(this->mutex);
 	LOG(message_group::None,Location::NONE,"","CGAL Polyhedrons in cache: %1$d",this->cache.size());
 	LOG(message_group::None,Location::NONE,"","CGAL cache size in bytes: %1$d",this->cache.totalCost());
 }
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "cache.h"
+#include "nodehasher.h"
 #include "../common/memory.h"
+#include <mutex>
 
 /*!
 */
@@ -12,9 +14,10 @@ public:
 
 	static CGALCache *instance() { if (!inst) inst = new CGALCache; return inst; }
 
-	bool contains(const std::string &id) const { return this->cache.contains(id); }
-	shared_ptr<const class CGAL_Nef_polyhedron> get(const std::string &id) const;
-	bool insert(const std::string &id, const shared_ptr<const CGAL_Nef_polyhedron> &N);
+	bool contains(const NodeKey &id) const { std::lock_guard<std::mutex> lock(this->mutex); return this->cache.contains(id); }
+	shared_ptr<const class CGAL_Nef_polyhedron> get(const NodeKey &id) const;
+	bool lookup(const NodeKey &id, shared_ptr<const CGAL_Nef_polyhedron> &N) const;
+	bool insert(const NodeKey &id, const shared_ptr<const CGAL_Nef_polyhedron> &N);
 	size_t maxSizeMB() const;
 	void setMaxSizeMB(size_t limit);
 	void clear();
@@ -30,5 +33,7 @@ private:
 		~cache_entry() { }
 	};
 
-	Cache<std::string, cache_entry> cache;
+	Cache<NodeKey, cache_entry> cache;
+	// Render threads share the cache
+	mutable std::mutex mutex;
 };
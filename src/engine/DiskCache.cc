@@ -0,0 +1,418 @@
+#include "DiskCache.h"
+#include "../common/printutils.h"
+#include "../gui/version.h"
+#include "math/polyset.h"
+#include "math/hash.h"
+#include "math/Polygon2d.h"
+#ifdef ENABLE_CGAL
+#include "CGAL_Nef_polyhedron.h"
+#pragma push_macro("NDEBUG")
+#undef NDEBUG
+#include <CGAL/IO/Nef_polyhedron_iostream_3.h>
+#pragma pop_macro("NDEBUG")
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <tuple>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+DiskCache *DiskCache::inst = nullptr;
+
+namespace {
+	const uint32_t FILE_MAGIC = 0x4347534f; // "OSGC"
+	const uint32_t FILE_VERSION = 2;
+	const char *FILE_EXTENSION = ".geom";
+
+	enum class EntryType : uint8_t { Polygon2d = 1, PolySet = 2, Nef = 3 };
+
+	template <typename T> void write(std::ostream &out, const T &value)
+	{
+		out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+	}
+
+	template <typename T> bool read(std::istream &in, T &value)
+	{
+		in.read(reinterpret_cast<char *>(&value), sizeof(T));
+		return bool(in);
+	}
+
+	// Bytes left before end, so counts read from a corrupt entry are rejected
+	// before allocating for them
+	uint64_t remaining(std::istream &in, uint64_t end)
+	{
+		const auto pos = in.tellg();
+		return pos < 0 || uint64_t(pos) > end ? 0 : end - uint64_t(pos);
+	}
+
+	void write_string(std::ostream &out, const std::string &str)
+	{
+		write(out, uint32_t(str.size()));
+		out.write(str.data(), str.size());
+	}
+
+	bool read_string(std::istream &in, std::string &str, uint64_t end)
+	{
+		uint32_t size;
+		if (!read(in, size) || size > remaining(in, end)) return false;
+		str.resize(size);
+		in.read(&str[0], size);
+		return bool(in);
+	}
+
+	void write_polygon2d(std::ostream &out, const Polygon2d &poly)
+	{
+		write(out, uint8_t(poly.isSanitized()));
+		write(out, uint64_t(poly.outlines().size()));
+		for (const auto &outline : poly.outlines()) {
+			write(out, uint8_t(outline.positive));
+			write(out, uint64_t(outline.vertices.size()));
+			for (const auto &v : outline.vertices) {
+				write(out, v[0]);
+				write(out, v[1]);
+			}
+		}
+	}
+
+	bool read_polygon2d(std::istream &in, Polygon2d &poly, uint64_t end)
+	{
+		uint8_t sanitized;
+		uint64_t numoutlines;
+		if (!read(in, sanitized) || !read(in, numoutlines)) return false;
+		for (uint64_t i = 0; i < numoutlines; ++i) {
+			Outline2d outline;
+			uint8_t positive;
+			uint64_t numvertices;
+			if (!read(in, positive) || !read(in, numvertices) ||
+					numvertices > remaining(in, end) / (2 * sizeof(double))) return false;
+			outline.positive = positive;
+			outline.vertices.resize(numvertices);
+			for (auto &v : outline.vertices) {
+				if (!read(in, v[0]) || !read(in, v[1])) return false;
+			}
+			poly.addOutline(outline);
+		}
+		poly.setSanitized(sanitized);
+		return true;
+	}
+
+	void write_polyset(std::ostream &out, const PolySet &ps)
+	{
+		write(out, uint32_t(ps.getDimension()));
+		const auto convex = ps.convexValue();
+		write(out, uint8_t(convex ? 1 : !convex ? 0 : 2));
+		write_polygon2d(out, ps.getPolygon());
+		write(out, uint64_t(ps.vertices.size()));
+		for (const auto &v : ps.vertices) {
+			write(out, v[0]);
+			write(out, v[1]);
+			write(out, v[2]);
+		}
+		write(out, uint64_t(ps.indices.size()));
+		for (const auto &face : ps.indices) {
+			write(out, uint64_t(face.size()));
+			for (const auto idx : face) write(out, int32_t(idx));
+		}
+	}
+
+	PolySet *read_polyset(std::istream &in, uint64_t end)
+	{
+		uint32_t dim;
+		uint8_t convex;
+		Polygon2d origin;
+		if (!read(in, dim) || !read(in, convex) || !read_polygon2d(in, origin, end)) return nullptr;
+
+		std::unique_ptr<PolySet> ps(dim == 2 ? new PolySet(origin) :
+			new PolySet(dim, convex == 1 ? boost::tribool(true) : convex == 0 ? boost::tribool(false) : boost::tribool(unknown)));
+		uint64_t numvertices, numfaces;
+		if (!read(in, numvertices) || numvertices > remaining(in, end) / (3 * sizeof(double))) return nullptr;
+		ps->vertices.reserve(numvertices);
+		for (uint64_t i = 0; i < numvertices; ++i) {
+			Vector3d v;
+			if (!read(in, v[0]) || !read(in, v[1]) || !read(in, v[2])) return nullptr;
+			ps->add_vertex(v);
+		}
+		if (!read(in, numfaces)) return nullptr;
+		// Each face takes its size and its indices
+		uint64_t left = remaining(in, end);
+		if (numfaces > left / sizeof(uint64_t)) return nullptr;
+		ps->indices.resize(numfaces);
+		for (auto &face : ps->indices) {
+			uint64_t size;
+			if (!read(in, size)) return nullptr;
+			left -= sizeof(uint64_t);
+			if (size > left / sizeof(int32_t)) return nullptr;
+			left -= size * sizeof(int32_t);
+			face.resize(size);
+			for (auto &idx : face) {
+				int32_t i;
+				if (!read(in, i) || i < 0 || uint64_t(i) >= numvertices) return nullptr;
+				idx = i;
+			}
+		}
+		return ps.release();
+	}
+
+	bool write_geometry(std::ostream &out, const Geometry &geom)
+	{
+		if (const auto ps = dynamic_cast<const PolySet *>(&geom)) {
+			write(out, EntryType::PolySet);
+			write(out, int32_t(geom.getConvexity()));
+			write_polyset(out, *ps);
+		}
+		else if (const auto poly = dynamic_cast<const Polygon2d *>(&geom)) {
+			write(out, EntryType::Polygon2d);
+			write(out, int32_t(geom.getConvexity()));
+			write_polygon2d(out, *poly);
+		}
+#ifdef ENABLE_CGAL
+		else if (const auto N = dynamic_cast<const CGAL_Nef_polyhedron *>(&geom)) {
+			write(out, EntryType::Nef);
+			write(out, int32_t(geom.getConvexity()));
+			write(out, uint8_t(bool(N->p3)));
+			if (N->p3) out << *N->p3;
+		}
+#endif
+		else {
+			// GeometryList and friends are not worth persisting
+			return false;
+		}
+		return bool(out);
+	}
+
+	Geometry *read_geometry(std::istream &in, uint64_t end)
+	{
+		EntryType type;
+		int32_t convexity;
+		if (!read(in, type) || !read(in, convexity)) return nullptr;
+
+		Geometry *geom = nullptr;
+		switch (type) {
+		case EntryType::PolySet:
+			geom = read_polyset(in, end);
+			break;
+		case EntryType::Polygon2d: {
+			auto poly = new Polygon2d;
+			if (read_polygon2d(in, *poly, end)) geom = poly;
+			else delete poly;
+			break;
+		}
+#ifdef ENABLE_CGAL
+		case EntryType::Nef: {
+			uint8_t hasp3;
+			if (!read(in, hasp3)) break;
+			auto N = new CGAL_Nef_polyhedron;
+			if (hasp3) {
+				CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+				try {
+					N->p3.reset(new CGAL_Nef_polyhedron3);
+					in >> *N->p3;
+				} catch (const CGAL::Failure_exception &e) {
+					in.setstate(std::ios::failbit);
+				}
+				CGAL::set_error_behaviour(old_behaviour);
+			}
+			if (in) geom = N;
+			else delete N;
+			break;
+		}
+#endif
+		default:
+			break;
+		}
+		if (geom) geom->setConvexity(convexity);
+		return geom;
+	}
+}
+
+void DiskCache::setDirectory(const std::string &dir)
+{
+	this->dir.clear();
+	if (dir.empty()) return;
+
+	boost::system::error_code ec;
+	fs::create_directories(dir, ec);
+	if (ec || !fs::is_directory(dir)) {
+		LOG(message_group::Warning,Location::NONE,"","Can't use '%1$s' as geometry cache directory, disk cache disabled",dir);
+		return;
+	}
+	this->dir = dir;
+	this->size = scan(nullptr);
+	if (this->size > this->maxsize) trim();
+}
+
+/*!
+	Entries of other OpenSCAD versions get other names, so versions sharing a
+	directory don't replace each other's entries, and those which are no
+	longer used are trimmed like any other.
+*/
+std::string DiskCache::path(const NodeKey &key) const
+{
+	static const std::string version = []() {
+		const auto digest = hash128(openscad_versionnumber.data(), openscad_versionnumber.size(), FILE_VERSION);
+		char buffer[17];
+		snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)digest.first);
+		return std::string(buffer, 8);
+	}();
+	return (fs::path(this->dir) / (STR(key) + "-" + version + FILE_EXTENSION)).string();
+}
+
+bool DiskCache::contains(const NodeKey &key) const
+{
+	if (!isEnabled()) return false;
+	boost::system::error_code ec;
+	return fs::exists(path(key), ec);
+}
+
+shared_ptr<const Geometry> DiskCache::get(const NodeKey &key)
+{
+	if (!isEnabled()) return nullptr;
+
+	const auto filename = path(key);
+	boost::system::error_code ec;
+	const auto end = fs::file_size(filename, ec);
+	std::ifstream in(filename, std::ios::in | std::ios::binary);
+	if (ec || !in.good()) {
+		this->misses++;
+		return nullptr;
+	}
+
+	uint32_t magic, version;
+	std::string openscadversion;
+	shared_ptr<const Geometry> geom;
+	if (read(in, magic) && magic == FILE_MAGIC &&
+			read(in, version) && version == FILE_VERSION &&
+			read_string(in, openscadversion, end) && openscadversion == openscad_versionnumber) {
+		geom.reset(read_geometry(in, end));
+	}
+	in.close();
+
+	if (!geom) {
+		// Corrupt entry, as the name includes the version, make room for a fresh one
+		if (fs::remove(filename, ec)) this->size -= std::min<uintmax_t>(end, this->size);
+		this->misses++;
+		return nullptr;
+	}
+	// Mark as recently used
+	fs::last_write_time(filename, std::time(nullptr), ec);
+	this->hits++;
+#ifdef DEBUG
+	PRINTDB("Disk Cache hit: %s", key);
+#endif
+	return geom;
+}
+
+bool DiskCache::insert(const NodeKey &key, const shared_ptr<const Geometry> &geom)
+{
+	if (!isEnabled() || !geom) return false;
+
+	const auto filename = path(key);
+	boost::system::error_code ec;
+	if (fs::exists(filename, ec)) return true;
+
+	// Write to a unique temporary file and rename it into place, so other
+	// processes only ever see complete entries.
+	const auto tmpname = (fs::path(this->dir) / fs::unique_path("%%%%-%%%%-%%%%-%%%%.tmp")).string();
+	std::ofstream out(tmpname, std::ios::out | std::ios::binary);
+	if (!out.good()) return false;
+	write(out, FILE_MAGIC);
+	write(out, FILE_VERSION);
+	write_string(out, openscad_versionnumber);
+	bool ok = write_geometry(out, *geom);
+	const auto filesize = out.tellp();
+	out.close();
+	ok = ok && !out.fail();
+
+	if (ok) fs::rename(tmpname, filename, ec);
+	if (!ok || ec) {
+		fs::remove(tmpname, ec);
+		return false;
+	}
+	this->writes++;
+#ifdef DEBUG
+	PRINTDB("Disk Cache insert: %s", key);
+#endif
+	if ((this->size += uintmax_t(filesize)) > this->maxsize) trim();
+	return true;
+}
+
+/*!
+	Returns the total size of the entries in the directory, and lists them
+	if entries is given.
+*/
+uintmax_t DiskCache::scan(std::vector<std::tuple<std::time_t, uintmax_t, std::string>> *entries) const
+{
+	uintmax_t total = 0;
+	boost::system::error_code ec;
+	for (fs::directory_iterator it(this->dir, ec), end; !ec && it != end; it.increment(ec)) {
+		const auto &p = it->path();
+		if (p.extension() != FILE_EXTENSION) continue;
+		boost::system::error_code entry_ec;
+		const auto size = fs::file_size(p, entry_ec);
+		const auto mtime = entries ? fs::last_write_time(p, entry_ec) : 0;
+		if (entry_ec) continue; // removed by another process
+		if (entries) entries->emplace_back(mtime, size, p.string());
+		total += size;
+	}
+	return total;
+}
+
+/*!
+	Evicts the least recently used entries until the cache fits its size limit.
+	The directory is only scanned once the size of the entries written or seen
+	since the last scan exceeds the limit, as other processes share it.
+*/
+void DiskCache::trim()
+{
+	std::lock_guard<std::mutex> lock(this->trimmutex);
+	std::vector<std::tuple<std::time_t, uintmax_t, std::string>> entries;
+	uintmax_t total = scan(&entries);
+	if (total > this->maxsize) {
+		std::sort(entries.begin(), entries.end());
+		boost::system::error_code ec;
+		for (const auto &entry : entries) {
+			if (total <= this->maxsize) break;
+			fs::remove(std::get<2>(entry), ec);
+			total -= std::get<1>(entry);
+		}
+	}
+	this->size = total;
+}
+
+size_t DiskCache::maxSizeMB() const
+{
+	return this->maxsize/(1024*1024);
+}
+
+void DiskCache::setMaxSizeMB(size_t limit)
+{
+	this->maxsize = limit*1024*1024;
+	if (isEnabled() && this->size > this->maxsize) trim();
+}
+
+void DiskCache::clear()
+{
+	if (!isEnabled()) return;
+	boost::system::error_code ec;
+	for (fs::directory_iterator it(this->dir, ec), end; !ec && it != end; it.increment(ec)) {
+		if (it->path().extension() == FILE_EXTENSION) {
+			boost::system::error_code entry_ec;
+			fs::remove(it->path(), entry_ec);
+		}
+	}
+	this->size = 0;
+}
+
+void DiskCache::print()
+{
+	if (!isEnabled()) return;
+	LOG(message_group::None,Location::NONE,"","Disk cache directory: %1$s",this->dir);
+	LOG(message_group::None,Location::NONE,"","Disk cache hits: %1$d, misses: %2$d, writes: %3$d",size_t(this->hits),size_t(this->misses),size_t(this->writes));
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "nodehasher.h"
+#include "../common/memory.h"
+#include <atomic>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+/*!
+	Persistent, content-addressed geometry cache shared between OpenSCAD processes.
+
+	Evaluated PolySets, Polygon2ds and Nef polyhedra are stored as one file per
+	NodeKey in a user-specified directory. Files are written to a temporary name
+	and renamed into place, so concurrent readers never see partial entries.
+	Reading an entry refreshes its modification time, which is used for
+	least-recently-used eviction once the directory exceeds its size limit.
+
+	The cache is disabled until a directory is set.
+*/
+class DiskCache
+{
+public:
+	DiskCache(size_t limit = 1024*1024*1024) : maxsize(limit), size(0), hits(0), misses(0), writes(0) {}
+
+	static DiskCache *instance() { if (!inst) inst = new DiskCache; return inst; }
+
+	bool isEnabled() const { return !this->dir.empty(); }
+	const std::string &directory() const { return this->dir; }
+	void setDirectory(const std::string &dir);
+
+	bool contains(const NodeKey &key) const;
+	shared_ptr<const class Geometry> get(const NodeKey &key);
+	bool insert(const NodeKey &key, const shared_ptr<const Geometry> &geom);
+	size_t maxSizeMB() const;
+	void setMaxSizeMB(size_t limit);
+	void clear();
+	void print();
+
+private:
+	static DiskCache *inst;
+
+	std::string path(const NodeKey &key) const;
+	uintmax_t scan(std::vector<std::tuple<std::time_t, uintmax_t, std::string>> *entries) const;
+	void trim();
+
+	std::string dir;
+	size_t maxsize;
+	// Size of the entries, as of the last scan and the writes since
+	std::atomic<uintmax_t> size;
+	std::mutex trimmutex;
+	// Entries may be read and written from several render threads
+	std::atomic<size_t> hits, misses, writes;
+};
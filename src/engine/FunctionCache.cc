@@ -0,0 +1,158 @@
+#include "FunctionCache.h"
+#include "../common/printutils.h"
+#include <cstring>
+#include <boost/functional/hash.hpp>
+
+FunctionCache *FunctionCache::inst = nullptr;
+
+namespace {
+	thread_local uint64_t impure_calls = 0;
+
+	uint64_t bits(double d)
+	{
+		uint64_t b;
+		std::memcpy(&b, &d, sizeof(b));
+		return b;
+	}
+
+	size_t value_hash(const Value &value)
+	{
+		size_t seed = size_t(value.type());
+		switch (value.type()) {
+		case Value::Type::BOOL:
+			boost::hash_combine(seed, value.toBool());
+			break;
+		case Value::Type::NUMBER:
+			boost::hash_combine(seed, bits(value.toDouble()));
+			break;
+		case Value::Type::STRING:
+			boost::hash_combine(seed, value.toString());
+			break;
+		case Value::Type::VECTOR: {
+			const auto &vec = value.toVector();
+			if (vec.isNumeric()) {
+				for (size_t i = 0; i < vec.size(); ++i) boost::hash_combine(seed, bits(vec.numbers()[i]));
+			}
+			else {
+				for (const auto &v : vec) boost::hash_combine(seed, value_hash(*v));
+			}
+			break;
+		}
+		case Value::Type::RANGE: {
+			const auto range = value.toRange();
+			boost::hash_combine(seed, bits(range.begin_value()));
+			boost::hash_combine(seed, bits(range.step_value()));
+			boost::hash_combine(seed, bits(range.end_value()));
+			break;
+		}
+		case Value::Type::FUNCTION:
+			boost::hash_combine(seed, value.toFunction().getExpr().get());
+			break;
+		default:
+			break;
+		}
+		return seed;
+	}
+
+	bool identical(const Value &a, const Value &b)
+	{
+		if (a.type() != b.type()) return false;
+		switch (a.type()) {
+		case Value::Type::UNDEFINED:
+			return true;
+		case Value::Type::BOOL:
+			return a.toBool() == b.toBool();
+		case Value::Type::NUMBER:
+			return bits(a.toDouble()) == bits(b.toDouble());
+		case Value::Type::STRING:
+			return a.toString() == b.toString();
+		case Value::Type::VECTOR: {
+			const auto &va = a.toVector(), &vb = b.toVector();
+			if (va.size() != vb.size()) return false;
+			if (va.isNumeric() && vb.isNumeric()) {
+				return std::memcmp(va.numbers(), vb.numbers(), va.size() * sizeof(double)) == 0;
+			}
+			for (size_t i = 0; i < va.size(); ++i) {
+				if (!identical(*va[i], *vb[i])) return false;
+			}
+			return true;
+		}
+		case Value::Type::RANGE: {
+			const auto ra = a.toRange(), rb = b.toRange();
+			return bits(ra.begin_value()) == bits(rb.begin_value()) &&
+				bits(ra.step_value()) == bits(rb.step_value()) &&
+				bits(ra.end_value()) == bits(rb.end_value());
+		}
+		case Value::Type::FUNCTION:
+			return bool(a.toFunction() == b.toFunction());
+		}
+		return false;
+	}
+}
+
+FunctionCallKey::FunctionCallKey(uint64_t function, std::vector<ValuePtr> args)
+	: function(function), args(std::move(args)), hash(0)
+{
+	boost::hash_combine(this->hash, function);
+	for (const auto &arg : this->args) boost::hash_combine(this->hash, value_hash(*arg));
+}
+
+bool FunctionCallKey::operator==(const FunctionCallKey &other) const
+{
+	if (this->function != other.function || this->hash != other.hash || this->args.size() != other.args.size()) return false;
+	for (size_t i = 0; i < this->args.size(); ++i) {
+		if (!identical(*this->args[i], *other.args[i])) return false;
+	}
+	return true;
+}
+
+std::ostream &operator<<(std::ostream &stream, const FunctionCallKey &key)
+{
+	stream << "function " << key.function << "(";
+	for (size_t i = 0; i < key.args.size(); ++i) stream << (i > 0 ? ", " : "") << *key.args[i];
+	return stream << ")";
+}
+
+bool FunctionCache::lookup(const FunctionCallKey &key, ValuePtr &result)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	const auto entry = this->cache[key];
+	if (!entry) {
+		this->misses++;
+		return false;
+	}
+	result = *entry;
+	this->hits++;
+	return true;
+}
+
+void FunctionCache::insert(const FunctionCallKey &key, const ValuePtr &result)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->cache.insert(key, new ValuePtr(result), 1);
+}
+
+void FunctionCache::clear()
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->cache.clear();
+	this->hits = 0;
+	this->misses = 0;
+}
+
+void FunctionCache::print()
+{
+	if (this->hits == 0 && this->misses == 0) return;
+	std::lock_guard<std::mutex> lock(this->mutex);
+	LOG(message_group::None,Location::NONE,"","Function cache hits: %1$d, misses: %2$d, entries: %3$d",size_t(this->hits),size_t(this->misses),this->cache.size());
+}
+
+void FunctionCache::markImpure()
+{
+	impure_calls++;
+}
+
+uint64_t FunctionCache::impurity()
+{
+	return impure_calls + thread_message_count();
+}
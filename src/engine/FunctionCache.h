@@ -0,0 +1,63 @@
+#pragma once
+
+#include "cache.h"
+#include "value.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+/*!
+	A call of a user-defined function: the function's id and the values of
+	its parameters in order of definition. Values are compared exactly, e.g.
+	0 and -0 are different arguments.
+*/
+struct FunctionCallKey
+{
+	FunctionCallKey(uint64_t function, std::vector<ValuePtr> args);
+	bool operator==(const FunctionCallKey &other) const;
+
+	uint64_t function;
+	std::vector<ValuePtr> args;
+	size_t hash;
+};
+std::ostream &operator<<(std::ostream &stream, const FunctionCallKey &key);
+
+namespace std {
+	template<> struct hash<FunctionCallKey> {
+		size_t operator()(const FunctionCallKey &key) const { return key.hash; }
+	};
+}
+
+/*!
+	Results of calls of pure user-defined functions, used with the "memoize"
+	feature, see UserFunction::evaluate(). The least recently used entries
+	are evicted once the cache holds its maximum number of results.
+*/
+class FunctionCache
+{
+public:
+	FunctionCache(size_t maxentries = 100000) : cache(maxentries), hits(0), misses(0) {}
+
+	static FunctionCache *instance() { if (!inst) inst = new FunctionCache; return inst; }
+
+	bool lookup(const FunctionCallKey &key, ValuePtr &result);
+	void insert(const FunctionCallKey &key, const ValuePtr &result);
+	void clear();
+	void print();
+
+	// Makes the results of the calls in progress on this thread uncacheable
+	static void markImpure();
+	// Changes whenever markImpure() is called or a message is printed on this thread
+	static uint64_t impurity();
+
+private:
+	static FunctionCache *inst;
+
+	Cache<FunctionCallKey, ValuePtr> cache;
+	std::atomic<size_t> hits;
+	std::atomic<size_t> misses;
+	// Calls may be evaluated from multiple threads
+	std::mutex mutex;
+};
@@ -11,40 +11,59 @@
 
 GeometryCache *GeometryCache::inst = nullptr;
 
-shared_ptr<const Geometry> GeometryCache::get(const std::string &id) const
+shared_ptr<const Geometry> GeometryCache::get(const NodeKey &id) const
 {
-	const auto &geom = this->cache[id]->geom;
+	shared_ptr<const Geometry> geom;
+	lookup(id, geom);
+	return geom;
+}
+
+/*!
+	Like contains() followed by get(), but without another thread being able to
+	evict the entry in between. Cached geometry may be nullptr, so the return
+	value tells whether the entry was found.
+*/
+bool GeometryCache::lookup(const NodeKey &id, shared_ptr<const Geometry> &geom) const
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	const auto entry = this->cache[id];
+	if (!entry) return false;
+	geom = entry->geom;
 #ifdef DEBUG
-	PRINTDB("Geometry Cache hit: %s (%d bytes)", id.substr(0, 40) % (geom ? geom->memsize() : 0));
+	PRINTDB("Geometry Cache hit: %s (%d bytes)", id % (geom ? geom->memsize() : 0));
 #endif
-	return geom;
+	return true;
 }
 
-bool GeometryCache::insert(const std::string &id, const shared_ptr<const Geometry> &geom)
+bool GeometryCache::insert(const NodeKey &id, const shared_ptr<const Geometry> &geom)
 {
+	std::lock_guard<std::mutex> lock(this->mutex);
 	auto inserted = this->cache.insert(id, new cache_entry(geom), geom ? geom->memsize() : 0);
 #ifdef DEBUG
 	assert(!dynamic_cast<const CGAL_Nef_polyhedron*>(geom.get()));
 	if (inserted) PRINTDB("Geometry Cache insert: %s (%d bytes)",
-                         id.substr(0, 40) % (geom ? geom->memsize() : 0));
+                         id % (geom ? geom->memsize() : 0));
 	else PRINTDB("Geometry Cache insert failed: %s (%d bytes)",
-                id.substr(0, 40) % (geom ? geom->memsize() : 0));
+                id % (geom ? geom->memsize() : 0));
 #endif
 	return inserted;
 }
 
 size_t GeometryCache::maxSizeMB() const
 {
+	std::lock_guard<std::mutex> lock(this->mutex);
 	return this->cache.maxCost()/(1024*1024);
 }
 
 void GeometryCache::setMaxSizeMB(size_t limit)
 {
+	std::lock_guard<std::mutex> lock(this->mutex);
 	this->cache.setMaxCost(limit*1024*1024);
 }
 
 void GeometryCache::print()
 {
+	std::lock_guard<std::mutex> lock(this->mutex);
 	LOG(message_group::None,Location::NONE,"","Geometries in cache: %1$d",this->cache.size());
 	LOG(message_group::None,Location::NONE,"","Geometry cache size in bytes: %1$d",this->cache.totalCost());
 }
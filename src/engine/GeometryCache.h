@@ -1,7 +1,9 @@
 #pragma once
 
 #include "cache.h"
+#include "nodehasher.h"
 #include "../common/memory.h"
+#include <mutex>
 #include "math/Geometry.h"
 
 class GeometryCache
@@ -11,12 +13,13 @@ public:
 
 	static GeometryCache *instance() { if (!inst) inst = new GeometryCache; return inst; }
 
-	bool contains(const std::string &id) const { return this->cache.contains(id); }
-	shared_ptr<const class Geometry> get(const std::string &id) const;
-	bool insert(const std::string &id, const shared_ptr<const Geometry> &geom);
+	bool contains(const NodeKey &id) const { std::lock_guard<std::mutex> lock(this->mutex); return this->cache.contains(id); }
+	shared_ptr<const class Geometry> get(const NodeKey &id) const;
+	bool lookup(const NodeKey &id, shared_ptr<const Geometry> &geom) const;
+	bool insert(const NodeKey &id, const shared_ptr<const Geometry> &geom);
 	size_t maxSizeMB() const;
 	void setMaxSizeMB(size_t limit);
-	void clear() { cache.clear(); }
+	void clear() { std::lock_guard<std::mutex> lock(this->mutex); cache.clear(); }
 	void print();
 
 private:
@@ -29,5 +32,7 @@ private:
 		~cache_entry() { }
 	};
 
-	Cache<std::string, cache_entry> cache;
+	Cache<NodeKey, cache_entry> cache;
+	// Render threads share the cache
+	mutable std::mutex mutex;
 };
@@ -2,6 +2,7 @@
 #include "Tree.h"
 #include "GeometryCache.h"
 #include "CGALCache.h"
+#include "DiskCache.h"
 #include "math/Polygon2d.h"
 #include "module.h"
 #include "ModuleInstantiation.h"
@@ -23,6 +24,8 @@
 #include "math/polyset.h"
 #include "calc.h"
 #include "../common/printutils.h"
+#include "../common/ThreadPool.h"
+#include "Trace.h"
 #include "svg.h"
 #include "calc.h"
 #include "../porters/dxfdata.h"
@@ -48,7 +51,7 @@ GeometryEvaluator::GeometryEvaluator(const class Tree &tree):
 shared_ptr<const Geometry> GeometryEvaluator::evaluateGeometry(const AbstractNode &node, 
 																															 bool allownef)
 {
-	const std::string &key = this->tree.getIdString(node);
+	const auto key = this->tree.getNodeKey(node);
 	if (!GeometryCache::instance()->contains(key)) {
 		shared_ptr<const CGAL_Nef_polyhedron> N;
 		if (CGALCache::instance()->contains(key)) {
@@ -60,7 +63,7 @@ shared_ptr<const Geometry> GeometryEvaluator::evaluateGeometry(const AbstractNod
 			this->root = N;
 		}	
 		else {
-			this->traverse(node);
+			this->traverseNode(node);
 		}
 
 		if (!allownef) {
@@ -142,6 +145,12 @@ GeometryEvaluator::ResultObject GeometryEvaluator::applyToChildren3D(const Abstr
 	// Only one child -> this is a noop
 	if (children.size() == 1) return ResultObject(children.front().second);
 
+	if (Feature::ExperimentalCorefinement.is_enabled() && op != OpenSCADOperator::MINKOWSKI) {
+		PolySet *ps = new PolySet(3);
+		if (CGALUtils::applyCorefinement3D(children, op, *ps)) return ps;
+		delete ps;
+	}
+
 	switch(op) {
 		case OpenSCADOperator::MINKOWSKI:
 		{
@@ -156,6 +165,9 @@ GeometryEvaluator::ResultObject GeometryEvaluator::applyToChildren3D(const Abstr
 		}
 		case OpenSCADOperator::UNION:
 		{
+			if (Feature::ExperimentalDisjointUnion.is_enabled()) {
+				return ResultObject(CGALUtils::applyClusteredUnion3D(children));
+			}
 			return ResultObject(CGALUtils::applyUnion3D(children.begin(), children.end()));
 			break;
 		}
@@ -279,7 +291,7 @@ std::vector<const class Polygon2d *> GeometryEvaluator::collectChildren2D(const
 void GeometryEvaluator::smartCacheInsert(const AbstractNode &node, 
 																				 const shared_ptr<const Geometry> &geom)
 {
-	const std::string &key = this->tree.getIdString(node);
+	const auto key = this->tree.getNodeKey(node);
 
 	shared_ptr<const CGAL_Nef_polyhedron> N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(geom);
 	if (N) {
@@ -292,23 +304,52 @@ void GeometryEvaluator::smartCacheInsert(const AbstractNode &node,
 			}
 		}
 	}
+
+	// Leaf geometry is cheap to recreate, so only persist results of operations
+	if (!node.getChildren().empty()) DiskCache::instance()->insert(key, geom);
 }
 
+/*!
+	Returns true if the node's geometry is available from the in-memory caches
+	or the disk cache. The cached geometry is fetched right away and kept
+	around for smartCacheGet(), as the caches may drop it in the meantime, e.g.
+	because it's too large for the memory caches or another render thread
+	needed the space.
+*/
 bool GeometryEvaluator::isSmartCached(const AbstractNode &node)
 {
-	const std::string &key = this->tree.getIdString(node);
-	return (GeometryCache::instance()->contains(key) ||
-					CGALCache::instance()->contains(key));
+	if (this->cachehits.count(node.index())) return true;
+
+	const auto key = this->tree.getNodeKey(node);
+	CacheHit hit;
+	shared_ptr<const CGAL_Nef_polyhedron> N;
+	hit.hasgeom = GeometryCache::instance()->lookup(key, hit.geom);
+	hit.hascgal = CGALCache::instance()->lookup(key, N);
+	hit.N = N;
+	const char *cache = hit.hascgal ? "CGAL cache" : "geometry cache";
+	if (!hit.hasgeom && !hit.hascgal) {
+		if (!DiskCache::instance()->isEnabled()) return false;
+		hit.geom = DiskCache::instance()->get(key);
+		if (!hit.geom) return false;
+		hit.hasgeom = true;
+		smartCacheInsert(node, hit.geom);
+		cache = "disk cache";
+	}
+	if (Trace::enabled()) Trace::instant("cache", std::string(cache) + " hit: " + node.name());
+	this->cachehits[node.index()] = hit;
+	return true;
 }
 
 shared_ptr<const Geometry> GeometryEvaluator::smartCacheGet(const AbstractNode &node, bool preferNef)
 {
-	const std::string &key = this->tree.getIdString(node);
 	shared_ptr<const Geometry> geom;
-	bool hasgeom = GeometryCache::instance()->contains(key);
-	bool hascgal = CGALCache::instance()->contains(key);
-	if (hascgal && (preferNef || !hasgeom)) geom = CGALCache::instance()->get(key);
-	else if (hasgeom) geom = GeometryCache::instance()->get(key);
+	auto it = this->cachehits.find(node.index());
+	if (it != this->cachehits.end()) {
+		const auto &hit = it->second;
+		if (hit.hascgal && (preferNef || !hit.hasgeom)) geom = hit.N;
+		else geom = hit.geom;
+		this->cachehits.erase(it);
+	}
 	return geom;
 }
 
@@ -411,6 +452,57 @@ void GeometryEvaluator::addToParent(const State &state,
 	}
 }
 
+/*!
+	Evaluates the child subtrees of the given node concurrently, if rendering
+	uses more than one thread.
+
+	Each child gets its own evaluator. Once all are done, their geometries are
+	added to our list of visited children in child order, and ThreadPool
+	replays messages and rethrows exceptions in that order as well, so the
+	result is the same as evaluating the children one after another.
+*/
+Response GeometryEvaluator::traverseChildren(const AbstractNode &node, const State &state)
+{
+	const auto &children = node.getChildren();
+	if (!ThreadPool::instance()->isParallel() || children.size() < 2) {
+		for (const auto &chnode : children) {
+			const auto response = traverseNode(*chnode, state);
+			if (response == Response::AbortTraversal) return response;
+		}
+		return Response::ContinueTraversal;
+	}
+
+	std::vector<Response> responses(children.size());
+	std::vector<Geometry::Geometries> geometries(children.size());
+	std::vector<ThreadPool::Task> tasks;
+	for (size_t i = 0; i < children.size(); ++i) {
+		tasks.push_back([this, &node, &state, &children, &responses, &geometries, i]() {
+			GeometryEvaluator evaluator(this->tree);
+			responses[i] = evaluator.traverseNode(*children[i], state);
+			geometries[i] = std::move(evaluator.visitedchildren[node.index()]);
+		});
+	}
+	ThreadPool::instance()->run(tasks);
+
+	auto &visited = this->visitedchildren[node.index()];
+	for (size_t i = 0; i < children.size(); ++i) {
+		visited.insert(visited.end(), geometries[i].begin(), geometries[i].end());
+		if (responses[i] == Response::AbortTraversal) return responses[i];
+	}
+	return Response::ContinueTraversal;
+}
+
+/*!
+	Traverses the given node, and records the time spent evaluating the geometry
+	of its subtree in the trace.
+*/
+Response GeometryEvaluator::traverseNode(const AbstractNode &node, const State &state)
+{
+	if (!Trace::enabled()) return traverse(node, state);
+	Trace::Span span("geometry", node.name(), node.location);
+	return traverse(node, state);
+}
+
 /*!
 	Custom nodes are handled here => implicit union
 */
@@ -632,7 +724,7 @@ Response GeometryEvaluator::visit(State &state, const TextNode &node)
 			}
 			geom.reset(ClipperUtils::apply(polygonlist, ClipperLib::ctUnion));
 		}
-		else geom = GeometryCache::instance()->get(this->tree.getIdString(node));
+		else geom = smartCacheGet(node, false);
 		addToParent(state, node, geom);
 		node.progress_report();
 	}
@@ -744,10 +836,8 @@ Response GeometryEvaluator::visit(State &state, const TransformNode &node)
 
 static void translate_PolySet(PolySet &ps, const Vector3d &translation)
 {
-	for(auto &p : ps.polygons) {
-		for(auto &v : p) {
-			v += translation;
-		}
+	for(auto &v : ps.vertices) {
+		v += translation;
 	}
 }
 
@@ -896,8 +986,8 @@ static Geometry *extrudePolygon(const LinearExtrudeNode &node, const Polygon2d &
 	PolySet *ps_bottom = poly.tessellate(); // bottom
 	
 	// Flip vertex ordering for bottom polygon
-	for(auto &p : ps_bottom->polygons) {
-		std::reverse(p.begin(), p.end());
+	for(auto &face : ps_bottom->indices) {
+		std::reverse(face.begin(), face.end());
 	}
 	translate_PolySet(*ps_bottom, Vector3d(0,0,h1));
 
@@ -955,6 +1045,8 @@ static Geometry *extrudePolygon(const LinearExtrudeNode &node, const Polygon2d &
 										1 - (1-node.scale_y)*(j+1) / slices);
 		add_slice(ps, poly, rot1, rot2, height1, height2, scale1, scale2);
 	}
+	// Let neighbouring slices and the caps share their vertices
+	ps->mergeVertices();
 
 	return ps;
 }
@@ -1068,8 +1160,8 @@ static Geometry *rotatePolygon(const RotateExtrudeNode &node, const Polygon2d &p
 		ps_start->transform(rot);
 		// Flip vertex ordering
 		if (!flip_faces) {
-			for(auto &p : ps_start->polygons) {
-				std::reverse(p.begin(), p.end());
+			for(auto &face : ps_start->indices) {
+				std::reverse(face.begin(), face.end());
 			}
 		}
 		ps->append(*ps_start);
@@ -1079,8 +1171,8 @@ static Geometry *rotatePolygon(const RotateExtrudeNode &node, const Polygon2d &p
 		Transform3d rot2(angle_axis_degrees(node.angle, Vector3d::UnitZ()) * angle_axis_degrees(90, Vector3d::UnitX()));
 		ps_end->transform(rot2);
 		if (flip_faces) {
-			for(auto &p : ps_end->polygons) {
-				std::reverse(p.begin(), p.end());
+			for(auto &face : ps_end->indices) {
+				std::reverse(face.begin(), face.end());
 			}
 		}
 		ps->append(*ps_end);
@@ -1113,6 +1205,8 @@ static Geometry *rotatePolygon(const RotateExtrudeNode &node, const Polygon2d &p
 			}
 		}
 	}
+	// Let neighbouring rings and the end faces share their vertices
+	ps->mergeVertices();
 	
 	return ps;
 }
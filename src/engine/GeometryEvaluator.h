@@ -37,6 +37,9 @@ public:
 
 	const Tree &getTree() const { return this->tree; }
 
+protected:
+	Response traverseChildren(const AbstractNode &node, const State &state) override;
+
 private:
 	class ResultObject {
 	public:
@@ -58,6 +61,7 @@ private:
 		shared_ptr<const Geometry> const_pointer;
 	};
 
+	Response traverseNode(const AbstractNode &node, const State &state = NodeVisitor::nullstate);
 	void smartCacheInsert(const AbstractNode &node, const shared_ptr<const Geometry> &geom);
 	shared_ptr<const Geometry> smartCacheGet(const AbstractNode &node, bool preferNef);
 	bool isSmartCached(const AbstractNode &node);
@@ -74,7 +78,17 @@ private:
 	void addToParent(const State &state, const AbstractNode &node, const shared_ptr<const Geometry> &geom);
 	Response lazyEvaluateRootNode(State &state, const AbstractNode& node);
 
+	// Cache entries found by isSmartCached(). Holding on to them keeps them
+	// available to smartCacheGet() even if another render thread evicts them.
+	struct CacheHit {
+		CacheHit() : hasgeom(false), hascgal(false) {}
+		bool hasgeom, hascgal;
+		shared_ptr<const Geometry> geom, N;
+	};
+
 	std::map<int, Geometry::Geometries> visitedchildren;
+	// By node index
+	std::map<int, CacheHit> cachehits;
 	const Tree &tree;
 	shared_ptr<const Geometry> root;
 
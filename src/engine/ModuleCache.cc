@@ -3,6 +3,7 @@
 #include "FileModule.h"
 #include "../common/printutils.h"
 #include "openscad.h"
+#include "Trace.h"
 #include "../common/boost-utils.h"
 #include <boost/format.hpp>
 
@@ -29,6 +30,7 @@ ModuleCache *ModuleCache::inst = nullptr;
 */
 std::time_t ModuleCache::evaluate(const std::string &mainFile,const std::string &filename, FileModule *&module)
 {
+	Trace::Span span("parse", "load ", filename);
 	module = nullptr;
 	auto entry = this->entries.find(filename);
 	bool found{entry != this->entries.end()};
@@ -4,6 +4,7 @@
 #include "expression.h"
 #include "exceptions.h"
 #include "../common/printutils.h"
+#include "Profiler.h"
 #include <boost/filesystem.hpp>
 #include "../common/boost-utils.h"
 namespace fs = boost::filesystem;
@@ -83,6 +84,7 @@ static void NOINLINE print_trace(const ModuleInstantiation *mod, const std::shar
 
 AbstractNode *ModuleInstantiation::evaluate(const std::shared_ptr<Context> ctx) const
 {
+	Profiler::Scope profile(Profiler::Kind::Instantiation, this, name(), this->loc);
 	ContextHandle<EvalContext> c{Context::create<EvalContext>(ctx, this->arguments, this->loc, &this->scope)};
 
 #if 0 && DEBUG
@@ -16,10 +16,8 @@ Response NodeVisitor::traverse(const AbstractNode &node, const State &state)
 	// Pruned traversals mean don't traverse children
 	if (response == Response::ContinueTraversal) {
 		newstate.setParent(&node);
-		for(const auto &chnode : node.getChildren()) {
-			response = this->traverse(*chnode, newstate);
-			if (response == Response::AbortTraversal) return response; // Abort immediately
-		}
+		response = traverseChildren(node, newstate);
+		if (response == Response::AbortTraversal) return response; // Abort immediately
 	}
 
 	// Postfix is executed for all non-aborted traversals
@@ -33,3 +31,12 @@ Response NodeVisitor::traverse(const AbstractNode &node, const State &state)
 	if (response != Response::AbortTraversal) response = Response::ContinueTraversal;
 	return response;
 }
+
+Response NodeVisitor::traverseChildren(const AbstractNode &node, const State &state)
+{
+	for(const auto &chnode : node.getChildren()) {
+		const auto response = this->traverse(*chnode, state);
+		if (response == Response::AbortTraversal) return response; // Abort immediately
+	}
+	return Response::ContinueTraversal;
+}
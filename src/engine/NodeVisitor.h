@@ -94,6 +94,10 @@ public:
 	}
 	// Add visit() methods for new visitable subtypes of AbstractNode here
 
+protected:
+	// Traverses all children of node in order; state has node as its parent
+	virtual Response traverseChildren(const AbstractNode &node, const class State &state);
+
 private:
 	static State nullstate;
 };
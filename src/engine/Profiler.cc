@@ -0,0 +1,201 @@
+#include "Profiler.h"
+#include "Trace.h"
+#include "../common/printutils.h"
+#include "../common/boost-utils.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <boost/format.hpp>
+
+std::atomic<bool> Profiler::enable_flag{false};
+
+struct Profiler::Entry
+{
+	Kind kind = Kind::Function;
+	std::string name;
+	Location loc = Location::NONE;
+	size_t calls = 0;
+	std::chrono::steady_clock::duration inclusive_time{0};
+	std::chrono::steady_clock::duration exclusive_time{0};
+	size_t inclusive_allocations = 0;
+	size_t exclusive_allocations = 0;
+	// Number of scopes in progress, to find the outermost of recursive calls
+	size_t active = 0;
+};
+
+namespace {
+	typedef std::chrono::steady_clock Clock;
+
+	// Rows of the printed table
+	const size_t MAX_ROWS = 100;
+
+	// Results of each thread which profiled anything, kept after the thread exits
+	typedef std::unordered_map<const void *, Profiler::Entry> Entries;
+
+	struct Results
+	{
+		std::mutex mutex;
+		std::vector<std::shared_ptr<Entries>> threads;
+	};
+
+	Results &results()
+	{
+		static Results results;
+		return results;
+	}
+
+	const char *kind_name(Profiler::Kind kind)
+	{
+		switch (kind) {
+		case Profiler::Kind::Function: return "function";
+		case Profiler::Kind::Module: return "module";
+		case Profiler::Kind::Instantiation: return "instantiation";
+		case Profiler::Kind::BuiltinFunction: return "builtin function";
+		case Profiler::Kind::BuiltinModule: return "builtin module";
+		}
+		return "";
+	}
+
+	std::string location_string(const Location &loc, const std::string &docPath)
+	{
+		if (loc.isNone()) return "";
+		return boostfs_uncomplete(loc.filePath(), docPath).generic_string() + ":" + std::to_string(loc.firstLine());
+	}
+
+	double milliseconds(Clock::duration d)
+	{
+		return std::chrono::duration<double, std::milli>(d).count();
+	}
+
+}
+
+struct Profiler::ThreadState
+{
+	ThreadState() : entries(std::make_shared<Entries>()) {
+		auto &r = results();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		r.threads.push_back(this->entries);
+	}
+
+	Scope *current = nullptr;
+	size_t allocations = 0;
+	// Merged by print(), so scopes don't need to lock
+	std::shared_ptr<Entries> entries;
+};
+
+namespace {
+	thread_local Profiler::ThreadState own_state;
+	// Set on stack segments, which continue with the state of the thread which started them
+	thread_local Profiler::ThreadState *shared_state = nullptr;
+}
+
+Profiler::ThreadState *Profiler::threadState()
+{
+	return shared_state ? shared_state : &own_state;
+}
+
+void Profiler::setThreadState(ThreadState *state)
+{
+	shared_state = state;
+}
+
+void Profiler::enable()
+{
+	auto &r = results();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	for (const auto &entries : r.threads) entries->clear();
+	enable_flag = true;
+}
+
+void Profiler::countAllocation()
+{
+	threadState()->allocations++;
+}
+
+void Profiler::Scope::begin(Kind kind, const void *key, const std::string &name, const Location &loc)
+{
+	auto state = threadState();
+	this->entry = &(*state->entries)[key];
+	if (this->entry->calls == 0 && this->entry->active == 0) {
+		this->entry->kind = kind;
+		this->entry->name = name;
+		this->entry->loc = loc;
+	}
+	this->allocations = state->allocations;
+	this->nested_time = Clock::duration::zero();
+	this->nested_allocations = 0;
+	this->outermost = this->entry->active++ == 0;
+	this->parent = state->current;
+	state->current = this;
+	this->start = Clock::now();
+}
+
+void Profiler::Scope::end()
+{
+	const auto time = Clock::now() - this->start;
+	auto state = threadState();
+	const size_t allocations = state->allocations - this->allocations;
+	state->current = this->parent;
+	if (this->parent) {
+		this->parent->nested_time += time;
+		this->parent->nested_allocations += allocations;
+	}
+
+	auto &entry = *this->entry;
+	if (Trace::enabled()) Trace::record(kind_name(entry.kind), entry.name, entry.loc, this->start, time);
+
+	entry.active--;
+	entry.calls++;
+	if (this->outermost) {
+		entry.inclusive_time += time;
+		entry.inclusive_allocations += allocations;
+	}
+	entry.exclusive_time += time - this->nested_time;
+	entry.exclusive_allocations += allocations - this->nested_allocations;
+}
+
+void Profiler::print(const std::string &docPath)
+{
+	auto &r = results();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	Entries merged;
+	for (const auto &thread : r.threads) {
+		for (const auto &it : *thread) {
+			const auto &e = it.second;
+			auto &m = merged[it.first];
+			if (m.calls == 0) {
+				m.kind = e.kind;
+				m.name = e.name;
+				m.loc = e.loc;
+			}
+			m.calls += e.calls;
+			m.inclusive_time += e.inclusive_time;
+			m.exclusive_time += e.exclusive_time;
+			m.inclusive_allocations += e.inclusive_allocations;
+			m.exclusive_allocations += e.exclusive_allocations;
+		}
+	}
+	std::vector<const Entry *> entries;
+	for (const auto &entry : merged) entries.push_back(&entry.second);
+	std::sort(entries.begin(), entries.end(), [](const Entry *a, const Entry *b) {
+		return a->exclusive_time > b->exclusive_time;
+	});
+
+	LOG(message_group::None,Location::NONE,"","Profile, sorted by self time:");
+	LOG(message_group::None,Location::NONE,"","%1$s",(boost::format("%10s %10s %10s %12s %12s  %-16s %s")
+		% "Self ms" % "Total ms" % "Calls" % "Self allocs" % "Total allocs" % "Kind" % "Name").str());
+	for (size_t i = 0; i < entries.size() && i < MAX_ROWS; ++i) {
+		const auto &e = *entries[i];
+		std::string name = e.name;
+		const auto loc = location_string(e.loc, docPath);
+		if (!loc.empty()) name += " (" + loc + ")";
+		LOG(message_group::None,Location::NONE,"","%1$s",(boost::format("%10.2f %10.2f %10d %12d %12d  %-16s %s")
+			% milliseconds(e.exclusive_time) % milliseconds(e.inclusive_time) % e.calls
+			% e.exclusive_allocations % e.inclusive_allocations % kind_name(e.kind) % name).str());
+	}
+	if (entries.size() > MAX_ROWS) {
+		LOG(message_group::None,Location::NONE,"","... and %1$d more",entries.size() - MAX_ROWS);
+	}
+}
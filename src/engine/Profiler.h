@@ -0,0 +1,81 @@
+#pragma once
+
+#include "AST.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+
+/*!
+	Script-level profiler, enabled with --profile.
+
+	Calls of user functions, user modules and builtins, and module
+	instantiations are measured with a Scope each, and summed up per function, module or instantiation.
+	Inclusive time and allocations include those of nested scopes, while
+	exclusive ("self") ones don't. Recursive calls only count once towards
+	the inclusive numbers of the outermost call.
+
+	Allocations are the contexts, vectors and nodes created, as those make
+	up most of the memory used while evaluating.
+
+	The results are printed as a table sorted by exclusive time. If the
+	Trace is enabled as well, each call is added to its timeline.
+*/
+class Profiler
+{
+public:
+	enum class Kind { Function, Module, Instantiation, BuiltinFunction, BuiltinModule };
+
+	// Per-thread state of the scopes in progress, see StackSegment
+	struct ThreadState;
+	// Results of one function, module or instantiation on one thread
+	struct Entry;
+
+	/*!
+		Measures the time from construction to destruction, if the profiler
+		is enabled. key identifies what is measured, e.g. the called function,
+		name and location are used in the output.
+	*/
+	class Scope
+	{
+	public:
+		Scope(Kind kind, const void *key, const std::string &name, const Location &loc) : active(Profiler::enabled()) {
+			if (this->active) begin(kind, key, name, loc);
+		}
+		~Scope() { if (this->active) end(); }
+		Scope(const Scope &) = delete;
+		Scope &operator=(const Scope &) = delete;
+
+	private:
+		void begin(Kind kind, const void *key, const std::string &name, const Location &loc);
+		void end();
+
+		bool active;
+		Entry *entry;
+		std::chrono::steady_clock::time_point start;
+		size_t allocations;
+		// Time and allocations of nested scopes
+		std::chrono::steady_clock::duration nested_time;
+		size_t nested_allocations;
+		bool outermost;
+		Scope *parent;
+	};
+
+	static bool enabled() { return enable_flag.load(std::memory_order_relaxed); }
+	// Starts profiling, and clears the results so far
+	static void enable();
+
+	// Counts the allocation of a context, vector or node
+	static void allocated() { if (enabled()) countAllocation(); }
+
+	static ThreadState *threadState();
+	static void setThreadState(ThreadState *state);
+
+	// Prints the table of results of all threads, with file names relative to docPath.
+	// Evaluation must be done, as the threads record their results without locking.
+	static void print(const std::string &docPath);
+
+private:
+	static void countAllocation();
+
+	static std::atomic<bool> enable_flag;
+};
@@ -29,6 +29,13 @@ public:
     }
   }
 
+  /*!
+    Makes room for the given number of elements without rehashing
+  */
+  void reserve(std::size_t size) {
+    this->map.reserve(size);
+  }
+
   /*!
     Returns the current size of the new element array
   */
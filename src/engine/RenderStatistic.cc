@@ -26,6 +26,8 @@
 #include "../common/printutils.h"
 #include "GeometryCache.h"
 #include "CGALCache.h"
+#include "DiskCache.h"
+#include "FunctionCache.h"
 #include "math/polyset.h"
 #include "math/Polygon2d.h"
 #include "../common/boost-utils.h"
@@ -42,6 +44,20 @@ void RenderStatistic::printCacheStatistic()
 #ifdef ENABLE_CGAL
   CGALCache::instance()->print();
 #endif
+  DiskCache::instance()->print();
+  FunctionCache::instance()->print();
+}
+
+std::atomic<size_t> RenderStatistic::prunedDifferenceOperands{0};
+std::atomic<size_t> RenderStatistic::prunedIntersectionOperands{0};
+
+void RenderStatistic::printPruningStatistic()
+{
+  const size_t difference = prunedDifferenceOperands.exchange(0);
+  const size_t intersection = prunedIntersectionOperands.exchange(0);
+  if (difference || intersection) {
+    LOG(message_group::None,Location::NONE,"","Operands pruned by bounding box: %1$d in differences, %2$d in intersections",difference,intersection);
+  }
 }
 
 void RenderStatistic::printRenderingTime(std::chrono::milliseconds ms)
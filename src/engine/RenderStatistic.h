@@ -28,6 +28,7 @@
 
 #include "math/Geometry.h"
 
+#include <atomic>
 #include <chrono>
 
 /**
@@ -44,10 +45,24 @@ public:
   
   /**
    * Print some statistic on cache usage. Namely, stats on the @ref GeometryCache
-   * and @ref CGALCache (if enabled).
+   * and @ref CGALCache (if enabled), and on the @ref FunctionCache if used.
    */
   static void printCacheStatistic();
   
+  /**
+   * Print how many operands of difference() and intersection() were skipped
+   * because their bounding boxes showed they can't affect the result, and
+   * reset the counts.
+   */
+  static void printPruningStatistic();
+
+  /**
+   * Subtrahends dropped from difference() and operands of intersection()
+   * skipped because the intersection is known to be empty.
+   */
+  static std::atomic<size_t> prunedDifferenceOperands;
+  static std::atomic<size_t> prunedIntersectionOperands;
+
   /**
    * Format and print time elapsed by rendering.
    * @arg time elapsed by rendering in seconds
@@ -0,0 +1,186 @@
+#include "TableIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <boost/functional/hash.hpp>
+
+namespace {
+	// Tables with fewer rows are scanned instead
+	const size_t MIN_ROWS = 16;
+	// Indices of more tables than this are dropped
+	const size_t MAX_TABLES = 256;
+	// Column used in the keys of lookup() indices
+	const int LOOKUP = -1;
+
+	size_t number_hash(double d)
+	{
+		size_t seed = size_t(Value::Type::NUMBER);
+		// 0 == -0, so they need the same hash
+		boost::hash_combine(seed, d == 0 ? 0.0 : d);
+		return seed;
+	}
+
+	// A table with the number of rows it had when indexed, and the column indexed
+	struct TableKey
+	{
+		std::weak_ptr<const void> table;
+		size_t rows;
+		int column;
+
+		bool operator<(const TableKey &other) const {
+			if (this->table.owner_before(other.table)) return true;
+			if (other.table.owner_before(this->table)) return false;
+			return std::make_pair(this->rows, this->column) < std::make_pair(other.rows, other.column);
+		}
+	};
+
+	class IndexCache
+	{
+	public:
+		bool find(const TableKey &key, std::shared_ptr<const void> &index)
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			auto it = this->indices.find(key);
+			if (it == this->indices.end()) return false;
+			index = it->second;
+			return true;
+		}
+
+		void insert(const TableKey &key, const std::shared_ptr<const void> &index)
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			if (this->indices.size() >= MAX_TABLES) {
+				for (auto it = this->indices.begin(); it != this->indices.end();) {
+					if (it->first.table.expired()) it = this->indices.erase(it);
+					else ++it;
+				}
+				if (this->indices.size() >= MAX_TABLES) this->indices.clear();
+			}
+			this->indices[key] = index;
+		}
+
+	private:
+		// Indices may be built from multiple threads
+		std::mutex mutex;
+		// Null for tables which can't be indexed
+		std::map<TableKey, std::shared_ptr<const void>> indices;
+	};
+
+	IndexCache &cache()
+	{
+		static IndexCache cache;
+		return cache;
+	}
+
+	template <typename Index, typename Create>
+	std::shared_ptr<const Index> cached(const VectorType &table, int column, Create create)
+	{
+		if (table.size() < MIN_ROWS) return nullptr;
+		const TableKey key{table.identity(), table.size(), column};
+		std::shared_ptr<const void> index;
+		if (!cache().find(key, index)) {
+			// Built without holding the lock, as it may take a while
+			index = create();
+			cache().insert(key, index);
+		}
+		return std::static_pointer_cast<const Index>(index);
+	}
+}
+
+SearchIndex::SearchIndex(const VectorType &table, unsigned int column)
+{
+	for (size_t i = 0; i < table.size(); ++i) {
+		// Same as the condition in builtin_search()
+		const auto &row = table[i];
+		if (column == 0) this->rows[hash(*row)].push_back(uint32_t(i));
+		if (column < row->toVector().size()) {
+			auto &candidates = this->rows[hash(*row->toVector()[column])];
+			if (candidates.empty() || candidates.back() != i) candidates.push_back(uint32_t(i));
+		}
+	}
+}
+
+const std::vector<uint32_t> *SearchIndex::candidates(const Value &value) const
+{
+	auto it = this->rows.find(hash(value));
+	return it == this->rows.end() ? nullptr : &it->second;
+}
+
+size_t SearchIndex::hash(const Value &value)
+{
+	// Values of different types are never equal, and ranges, functions and
+	// undef are rarely searched for, so are only hashed by type
+	size_t seed = size_t(value.type());
+	switch (value.type()) {
+	case Value::Type::BOOL:
+		boost::hash_combine(seed, value.toBool());
+		break;
+	case Value::Type::NUMBER:
+		seed = number_hash(value.toDouble());
+		break;
+	case Value::Type::STRING:
+		boost::hash_combine(seed, value.toString());
+		break;
+	case Value::Type::VECTOR: {
+		// Packed and unpacked vectors with the same elements are equal
+		const auto &vec = value.toVector();
+		if (vec.isNumeric()) {
+			for (size_t i = 0; i < vec.size(); ++i) boost::hash_combine(seed, number_hash(vec.numbers()[i]));
+		}
+		else {
+			for (const auto &v : vec) boost::hash_combine(seed, hash(*v));
+		}
+		break;
+	}
+	default:
+		break;
+	}
+	return seed;
+}
+
+std::shared_ptr<const LookupIndex> LookupIndex::create(const VectorType &table)
+{
+	auto index = std::make_shared<LookupIndex>();
+	for (const auto &row : table) {
+		double key, value;
+		if (!row->getVec2(key, value) || std::isnan(key)) return nullptr;
+		if (!index->keys.empty() && key < index->keys.back()) return nullptr;
+		index->keys.push_back(key);
+		index->values.push_back(value);
+	}
+	return index;
+}
+
+double LookupIndex::lookup(double p) const
+{
+	// The scan picks the first of rows with equal keys, and the first row
+	// if there is no key on one side of p
+	const auto first = this->keys.begin(), last = this->keys.end();
+	const auto above = std::lower_bound(first, last, p);
+	const size_t high = above == last ? 0 : above - first;
+	const auto upper = std::upper_bound(first, last, p);
+	const size_t low = upper == first ? 0 : std::lower_bound(first, last, *(upper - 1)) - first;
+
+	const double low_p = this->keys[low], low_v = this->values[low];
+	const double high_p = this->keys[high], high_v = this->values[high];
+	if (p <= low_p) return high_v;
+	if (p >= high_p) return low_v;
+	double f = (p-low_p) / (high_p-low_p);
+	return high_v * f + low_v * (1-f);
+}
+
+std::shared_ptr<const SearchIndex> TableIndex::search(const VectorType &table, unsigned int column)
+{
+	return cached<SearchIndex>(table, int(column), [&]() {
+		return std::make_shared<const SearchIndex>(table, column);
+	});
+}
+
+std::shared_ptr<const LookupIndex> TableIndex::lookup(const VectorType &table)
+{
+	return cached<LookupIndex>(table, LOOKUP, [&]() {
+		return LookupIndex::create(table);
+	});
+}
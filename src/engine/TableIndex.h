@@ -0,0 +1,58 @@
+#pragma once
+
+#include "value.h"
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/*!
+	Hash index of a search() table, mapping the hash of a key to the rows
+	which have a matching key in the searched column. Hashes are consistent
+	with value equality, so the rows equal to a value are among its
+	candidates(), which still have to be compared with the value.
+*/
+class SearchIndex
+{
+public:
+	SearchIndex(const VectorType &table, unsigned int column);
+
+	// Rows which may match the value in ascending order, or null if none
+	const std::vector<uint32_t> *candidates(const Value &value) const;
+
+	static size_t hash(const Value &value);
+
+private:
+	std::unordered_map<size_t, std::vector<uint32_t>> rows;
+};
+
+/*!
+	Keys and values of a lookup() table with [key, value] rows sorted by
+	key, allowing binary search instead of scanning all rows.
+*/
+class LookupIndex
+{
+public:
+	// Returns null if the table is not a valid table sorted by key
+	static std::shared_ptr<const LookupIndex> create(const VectorType &table);
+
+	// Gives the same result as the scan in builtin_lookup()
+	double lookup(double p) const;
+
+private:
+	std::vector<double> keys;
+	std::vector<double> values;
+};
+
+/*!
+	Indices of the tables passed to search() and lookup(), so calling them
+	repeatedly with the same table only scans it once. Tables are identified
+	by their elements, which are shared by all copies of a vector value.
+	Small tables are not indexed, as scanning them is cheap enough.
+*/
+class TableIndex
+{
+public:
+	static std::shared_ptr<const SearchIndex> search(const VectorType &table, unsigned int column);
+	static std::shared_ptr<const LookupIndex> lookup(const VectorType &table);
+};
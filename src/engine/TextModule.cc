@@ -4,9 +4,12 @@
 #include "context.h"
 #include "calc.h"
 #include "builtin.h"
+#include "parallelfor.h"
 
 AbstractNode *TextModule::instantiate(const std::shared_ptr<Context>& ctx, const ModuleInstantiation *inst, const std::shared_ptr<EvalContext>& evalctx) const
 {
+  // The font cache is not thread safe
+  ParallelFor::checkSafe();
   auto node = new TextNode(inst, evalctx);
 
   AssignmentList args{assignment("text"), assignment("size"), assignment("font")};
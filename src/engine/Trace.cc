@@ -0,0 +1,146 @@
+#include "Trace.h"
+#include "../common/printutils.h"
+#include "../common/boost-utils.h"
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <boost/format.hpp>
+
+std::atomic<bool> Trace::enable_flag{false};
+
+namespace {
+	typedef Trace::Clock Clock;
+
+	// Events recorded in total, later ones are dropped
+	const size_t MAX_EVENTS = 1000000;
+
+	struct Event
+	{
+		const char *category;
+		std::string name;
+		Location loc;
+		Clock::time_point start;
+		Clock::duration duration;
+		bool instant;
+	};
+
+	// Events of one thread. Kept after the thread ends, e.g. for stack segments.
+	struct Buffer
+	{
+		size_t thread;
+		// Only contended while writing the file
+		std::mutex mutex;
+		std::vector<Event> events;
+	};
+
+	struct Timeline
+	{
+		std::mutex mutex;
+		std::vector<std::shared_ptr<Buffer>> buffers;
+		Clock::time_point start;
+		std::atomic<size_t> events{0};
+	};
+
+	Timeline &timeline()
+	{
+		static Timeline timeline;
+		return timeline;
+	}
+
+	thread_local std::shared_ptr<Buffer> thread_buffer;
+
+	void add_buffer()
+	{
+		auto &t = timeline();
+		thread_buffer = std::make_shared<Buffer>();
+		std::lock_guard<std::mutex> lock(t.mutex);
+		thread_buffer->thread = t.buffers.size() + 1;
+		t.buffers.push_back(thread_buffer);
+	}
+
+	void add(Event event)
+	{
+		if (timeline().events++ >= MAX_EVENTS) return;
+		if (!thread_buffer) add_buffer();
+		std::lock_guard<std::mutex> lock(thread_buffer->mutex);
+		thread_buffer->events.push_back(std::move(event));
+	}
+
+	double microseconds(Clock::duration d)
+	{
+		return std::chrono::duration<double, std::micro>(d).count();
+	}
+
+	std::string json_string(const std::string &s)
+	{
+		std::string result = "\"";
+		for (const char c : s) {
+			if (c == '"' || c == '\\') {
+				result += '\\';
+				result += c;
+			}
+			else if (static_cast<unsigned char>(c) < 0x20) {
+				result += (boost::format("\\u%04x") % int(c)).str();
+			}
+			else {
+				result += c;
+			}
+		}
+		return result + "\"";
+	}
+}
+
+void Trace::enable()
+{
+	timeline().start = Clock::now();
+	// The main thread comes first
+	if (!thread_buffer) add_buffer();
+	enable_flag = true;
+}
+
+void Trace::record(const char *category, const std::string &name, const Location &loc, Clock::time_point start, Clock::duration duration)
+{
+	add({category, name, loc, start, duration, false});
+}
+
+void Trace::instant(const char *category, const std::string &name)
+{
+	if (enabled()) add({category, name, Location::NONE, Clock::now(), Clock::duration::zero(), true});
+}
+
+bool Trace::write(const std::string &filename, const std::string &docPath)
+{
+	std::ofstream stream(filename, std::ios::out | std::ios::trunc);
+	if (!stream) return false;
+
+	auto &t = timeline();
+	std::lock_guard<std::mutex> lock(t.mutex);
+	stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	for (const auto &buffer : t.buffers) {
+		std::lock_guard<std::mutex> lock(buffer->mutex);
+		if (!first) stream << ",\n";
+		first = false;
+		stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread
+			<< ",\"args\":{\"name\":" << json_string(buffer->thread == 1 ? "main" : "thread " + std::to_string(buffer->thread)) << "}}";
+		for (const auto &event : buffer->events) {
+			stream << ",\n{\"name\":" << json_string(event.name)
+				<< ",\"cat\":" << json_string(event.category)
+				<< ",\"pid\":1,\"tid\":" << buffer->thread
+				<< ",\"ts\":" << microseconds(event.start - t.start);
+			if (event.instant) stream << ",\"ph\":\"i\",\"s\":\"t\"";
+			else stream << ",\"ph\":\"X\",\"dur\":" << microseconds(event.duration);
+			if (!event.loc.isNone()) {
+				const auto loc = boostfs_uncomplete(event.loc.filePath(), docPath).generic_string() + ":" + std::to_string(event.loc.firstLine());
+				stream << ",\"args\":{\"location\":" << json_string(loc) << "}";
+			}
+			stream << "}";
+		}
+	}
+	stream << "\n]}\n";
+	if (t.events > MAX_EVENTS) {
+		LOG(message_group::Warning,Location::NONE,"","Trace is missing the last %1$d events",t.events - MAX_EVENTS);
+	}
+	return bool(stream);
+}
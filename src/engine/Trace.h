@@ -0,0 +1,73 @@
+#pragma once
+
+#include "AST.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+
+/*!
+	Timeline of the render pipeline, enabled with --trace.
+
+	A Span measures a stage from construction to destruction, e.g. parsing a
+	file, evaluating a node's geometry, a CGAL conversion or exporting. Spans
+	nest on the thread they run on, and cache hits are recorded as instant
+	events. With --profile, each function and module call is recorded as
+	well, see Profiler.
+
+	The events are written as a Chrome trace event file with a track per
+	thread, which can be loaded into chrome://tracing or Perfetto.
+
+	When disabled, a Span only checks a flag, and doesn't build its name
+	unless given as a std::string.
+*/
+class Trace
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	class Span
+	{
+	public:
+		Span(const char *category, const std::string &name, const Location &loc = Location::NONE) : active(Trace::enabled()) {
+			if (this->active) begin(category, name, loc);
+		}
+		// The name is only built if tracing is enabled, e.g. for constant names on hot paths
+		Span(const char *category, const char *name) : active(Trace::enabled()) {
+			if (this->active) begin(category, name, Location::NONE);
+		}
+		Span(const char *category, const char *prefix, const std::string &name) : active(Trace::enabled()) {
+			if (this->active) begin(category, prefix + name, Location::NONE);
+		}
+		~Span() { if (this->active) Trace::record(this->category, this->name, *this->loc, this->start, Clock::now() - this->start); }
+		Span(const Span &) = delete;
+		Span &operator=(const Span &) = delete;
+
+	private:
+		void begin(const char *category, const std::string &name, const Location &loc) {
+			this->category = category;
+			this->name = name;
+			this->loc = &loc;
+			this->start = Clock::now();
+		}
+
+		bool active;
+		const char *category;
+		std::string name;
+		const Location *loc;
+		Clock::time_point start;
+	};
+
+	static bool enabled() { return enable_flag.load(std::memory_order_relaxed); }
+	static void enable();
+
+	// Records a span which ran on the current thread
+	static void record(const char *category, const std::string &name, const Location &loc, Clock::time_point start, Clock::duration duration);
+	// Records an event without duration, e.g. a cache hit
+	static void instant(const char *category, const std::string &name);
+
+	// Writes the events, with file names relative to docPath. Returns false if the file can't be written.
+	static bool write(const std::string &filename, const std::string &docPath);
+
+private:
+	static std::atomic<bool> enable_flag;
+};
@@ -10,6 +10,7 @@
 Tree::~Tree()
 {
 	this->nodecachemap.clear();
+	this->nodekeys.clear();
 }
 
 /*!
@@ -19,6 +20,7 @@ Tree::~Tree()
 const std::string Tree::getString(const AbstractNode &node, const std::string &indent) const
 {
 	assert(this->root_node);
+	std::lock_guard<std::recursive_mutex> lock(this->mutex);
 	bool idString = false;
 
 	// Retrieve a nodecache given a tuple of NodeDumper constructor options
@@ -44,6 +46,7 @@ const std::string Tree::getString(const AbstractNode &node, const std::string &i
 const std::string Tree::getIdString(const AbstractNode &node) const
 {
 	assert(this->root_node);
+	std::lock_guard<std::recursive_mutex> lock(this->mutex);
 	const std::string indent = "";
 	const bool idString = true;
 
@@ -60,6 +63,40 @@ const std::string Tree::getIdString(const AbstractNode &node) const
 	return nodecache[node];
 }
 
+/*!
+	Returns the cached structural hash of the subtree rooted by \a node.
+	If node is not cached, the keys of the whole tree will be recomputed.
+
+	Subtrees with different ID strings get different keys, modulo hash
+	collisions. To detect those, NodeKey::verify makes the key carry the ID
+	string as well.
+*/
+NodeKey Tree::getNodeKey(const AbstractNode &node) const
+{
+	assert(this->root_node);
+	std::lock_guard<std::recursive_mutex> lock(this->mutex);
+
+	auto it = this->nodekeys.find(node.index());
+	if (it == this->nodekeys.end()) {
+		this->nodekeys.clear();
+		NodeHasher hasher(this->nodekeys);
+		hasher.traverse(*this->root_node);
+		assert(this->nodekeys.count(this->root_node->index()) &&
+					 "NodeHasher failed to create keys");
+		it = this->nodekeys.find(node.index());
+		// A node outside of this tree is hashed on its own
+		if (it == this->nodekeys.end()) {
+			NodeHasher(this->nodekeys).traverse(node);
+			it = this->nodekeys.find(node.index());
+			assert(it != this->nodekeys.end() && "NodeHasher failed to create a key");
+		}
+	}
+	if (NodeKey::verify && it->second.idString.empty()) {
+		it->second.idString = getIdString(node);
+	}
+	return it->second;
+}
+
 /*!
 	Sets a new root. Will clear the existing cache.
  */
@@ -67,6 +104,7 @@ void Tree::setRoot(const AbstractNode *root)
 {
 	this->root_node = root; 
 	this->nodecachemap.clear();
+	this->nodekeys.clear();
 }
 
 void Tree::setDocumentPath(const std::string path){
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "nodecache.h"
+#include "nodehasher.h"
 #include <map>
+#include <mutex>
 
 /*!  
 	For now, just an abstraction of the node tree which keeps a dump
@@ -21,11 +23,15 @@ public:
 
 	const std::string getString(const AbstractNode &node, const std::string &indent) const;
 	const std::string getIdString(const AbstractNode &node) const;
+	NodeKey getNodeKey(const AbstractNode &node) const;
 	const std::string getDocumentPath() const;
 
 private:
 	const AbstractNode *root_node;
 	// keep a separate nodecache per tuple of NodeDumper constructor parameters
 	mutable std::map<std::tuple<std::string, bool>, NodeCache>  nodecachemap;
+	mutable std::unordered_map<size_t, NodeKey> nodekeys;
+	// The caches above are filled lazily, possibly from several render threads
+	mutable std::recursive_mutex mutex;
 	std::string document_path;
 };
@@ -30,6 +30,8 @@
 #include "evalcontext.h"
 #include "exceptions.h"
 #include "stackcheck.h"
+#include "stacksegment.h"
+#include "Profiler.h"
 #include "modcontext.h"
 #include "expression.h"
 #include "../common/printutils.h"
@@ -37,7 +39,7 @@
 #include <sstream>
 #include "../common/boost-utils.h"
 
-std::vector<std::string> StaticModuleNameStack::stack;
+thread_local std::vector<std::string> StaticModuleNameStack::stack;
 
 static void NOINLINE print_err(std::string name, const Location &loc,const std::shared_ptr<const Context> ctx){
 	LOG(message_group::Error,loc,ctx->documentPath(),"Recursion detected calling module '%1$s'",name);
@@ -50,6 +52,11 @@ AbstractNode *UserModule::instantiate(const std::shared_ptr<Context>& ctx, const
 		throw RecursionException::create("module", inst->name(),loc);
 		return nullptr;
 	}
+	if (StackSegment::needed()) {
+		AbstractNode *node = nullptr;
+		if (StackSegment::run([&]() { node = instantiate(ctx, inst, evalctx); })) return node;
+	}
+	Profiler::Scope profile(Profiler::Kind::Module, this, inst->name(), loc);
 
 	// At this point we know that nobody will modify the dependencies of the local scope
 	// passed to this instance, so we can populate the context
@@ -17,9 +17,11 @@ public:
 
 	static int size() { return stack.size(); }
 	static const std::string& at(int idx) { return stack[idx]; }
+	// Each thread has its own stack, parallel tasks swap in a copy of the one of the thread which started them
+	static void swap(std::vector<std::string> &names) { stack.swap(names); }
 
 private:
-	static std::vector<std::string> stack;
+	static thread_local std::vector<std::string> stack;
 };
 
 class UserModule : public AbstractModule, public ASTNode
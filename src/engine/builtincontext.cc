@@ -7,6 +7,7 @@
 #include "function.h"
 #include "ModuleInstantiation.h"
 #include "../common/printutils.h"
+#include "Profiler.h"
 #include "evalcontext.h"
 #include "../common/boost-utils.h"
 
@@ -28,6 +29,7 @@ ValuePtr BuiltinContext::evaluate_function(const std::string &name, const std::s
 	const auto &search = Builtins::instance()->getFunctions().find(name);
 	if (search != Builtins::instance()->getFunctions().end()) {
 		AbstractFunction *f = search->second;
+		Profiler::Scope profile(Profiler::Kind::BuiltinFunction, f, name, Location::NONE);
 		if (f->is_enabled()) return f->evaluate((const_cast<BuiltinContext *>(this))->get_shared_ptr(), evalctx);
 		else LOG(message_group::Warning,evalctx->loc,this->documentPath(),"Experimental builtin function '%1$s' is not enabled",name);
 	}
@@ -47,6 +49,7 @@ class AbstractNode *BuiltinContext::instantiate_module(const class ModuleInstant
 		if (!replacement.empty()) {
 			LOG(message_group::Deprecated,evalctx->loc,this->documentPath(),"The %1$s() module will be removed in future releases. Use %2$s instead.", std::string(name),std::string(replacement));
 		}
+		Profiler::Scope profile(Profiler::Kind::BuiltinModule, m, name, Location::NONE);
 		return m->instantiate((const_cast<BuiltinContext *>(this))->get_shared_ptr(), &inst, evalctx);
 	}
 	return Context::instantiate_module(inst, evalctx);
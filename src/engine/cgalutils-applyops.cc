@@ -11,6 +11,8 @@
 #include "math/polyset-utils.h"
 #include "grid.h"
 #include "node.h"
+#include "RenderStatistic.h"
+#include "../common/ThreadPool.h"
 
 #include "cgal.h"
 #pragma push_macro("NDEBUG")
@@ -30,6 +32,8 @@
 #include "Reindexer.h"
 #include "math/GeometryUtils.h"
 
+#include <algorithm>
+#include <functional>
 #include <map>
 #include <queue>
 #include <unordered_set>
@@ -72,11 +76,70 @@ namespace CGALUtils {
 		return visited.size() == p.size_of_facets();
 	}
 
+	static BoundingBox boundingBox(const Geometry &geom)
+	{
+		if (const auto N = dynamic_cast<const CGAL_Nef_polyhedron *>(&geom)) {
+			const auto box = boundingBox(*N->p3);
+			return BoundingBox(vector_convert<Vector3d>(box.min()), vector_convert<Vector3d>(box.max()));
+		}
+		return geom.getBoundingBox();
+	}
+
+	/*!
+		Drops subtrahends of a difference whose bounding boxes don't overlap the
+		first child, as they can't remove anything from it. Returns false if the
+		result is empty: the first child is empty, or the bounding boxes of an
+		intersection's operands show that it is.
+	*/
+	static bool pruneOperands(Geometry::Geometries &children, OpenSCADOperator op)
+	{
+		const auto &first = children.front().second;
+		if (!first || first->isEmpty()) {
+			auto &pruned = op == OpenSCADOperator::DIFFERENCE ?
+				RenderStatistic::prunedDifferenceOperands : RenderStatistic::prunedIntersectionOperands;
+			pruned += children.size() - 1;
+			return false;
+		}
+
+		auto region = boundingBox(*first);
+		// Boxes of non-empty operands are never empty, unless they weren't computed
+		if (region.isEmpty()) return true;
+		size_t pruned = 0;
+		for (auto it = std::next(children.begin()); it != children.end();) {
+			// Empty operands are dealt with by applyOperator3D()
+			if (!it->second || it->second->isEmpty()) {
+				++it;
+				continue;
+			}
+			const auto box = boundingBox(*it->second);
+			if (box.isEmpty()) {
+				++it;
+				continue;
+			}
+			if (op == OpenSCADOperator::DIFFERENCE && !box.intersects(region)) {
+				if (it->first) it->first->progress_report();
+				it = children.erase(it);
+				pruned++;
+				continue;
+			}
+			if (op == OpenSCADOperator::INTERSECTION) {
+				region = region.intersection(box);
+				if (region.isEmpty()) {
+					RenderStatistic::prunedIntersectionOperands += children.size() - 1;
+					return false;
+				}
+			}
+			++it;
+		}
+		RenderStatistic::prunedDifferenceOperands += pruned;
+		return true;
+	}
+
 /*!
 	Applies op to all children and returns the result.
 	The child list should be guaranteed to contain non-NULL 3D or empty Geometry objects
 */
-	CGAL_Nef_polyhedron *applyOperator3D(const Geometry::Geometries &children, OpenSCADOperator op)
+	CGAL_Nef_polyhedron *applyOperator3D(const Geometry::Geometries &operands, OpenSCADOperator op)
 	{
 		CGAL_Nef_polyhedron *N = nullptr;
 		CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
@@ -85,6 +148,25 @@ namespace CGALUtils {
 		bool foundFirst = false;
 
 		try {
+			Geometry::Geometries children = operands;
+			if (!children.empty() && (op == OpenSCADOperator::DIFFERENCE || op == OpenSCADOperator::INTERSECTION)) {
+				if (!pruneOperands(children, op)) {
+					CGAL::set_error_behaviour(old_behaviour);
+					return nullptr;
+				}
+			}
+			// With several threads, subtracting the union of all subtrahends at once
+			// is cheaper than subtracting them one by one, as the union runs in parallel.
+			if (op == OpenSCADOperator::DIFFERENCE && children.size() > 2 && ThreadPool::instance()->isParallel()) {
+				Geometry::Geometries subtrahends(std::next(children.begin()), children.end());
+				shared_ptr<const Geometry> subtrahend(applyUnion3D(subtrahends.begin(), subtrahends.end()));
+				for (const auto &item : subtrahends) {
+					if (item.first) item.first->progress_report();
+				}
+				children.erase(std::next(children.begin()), children.end());
+				children.push_back(std::make_pair(nullptr, subtrahend));
+			}
+
 			for(const auto &item : children) {
 				const shared_ptr<const Geometry> &chgeom = item.second;
 				shared_ptr<const CGAL_Nef_polyhedron> chN = 
@@ -140,6 +222,40 @@ namespace CGALUtils {
 	}
 
 
+	/*!
+		Unions neighbouring pairs concurrently, level by level, like a balanced
+		binary tree. Each level is ordered by size first, so small polyhedra get
+		merged with each other. Pairs only depend on that order, so the result
+		does not depend on thread scheduling.
+	*/
+	static shared_ptr<const CGAL_Nef_polyhedron> applyUnion3DBalanced(std::vector<shared_ptr<const CGAL_Nef_polyhedron>> level)
+	{
+		while (level.size() > 1) {
+			std::stable_sort(level.begin(), level.end(), [](const shared_ptr<const CGAL_Nef_polyhedron> &lhs, const shared_ptr<const CGAL_Nef_polyhedron> &rhs) {
+				return lhs->p3->number_of_facets() < rhs->p3->number_of_facets();
+			});
+			std::vector<shared_ptr<const CGAL_Nef_polyhedron>> next((level.size() + 1) / 2);
+			std::vector<ThreadPool::Task> tasks;
+			for (size_t i = 0; i + 1 < level.size(); i += 2) {
+				tasks.push_back([&level, &next, i]() {
+					CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+					try {
+						next[i / 2] = make_shared<const CGAL_Nef_polyhedron>(*level[i] + *level[i + 1]);
+					} catch (...) {
+						CGAL::set_error_behaviour(old_behaviour);
+						throw;
+					}
+					CGAL::set_error_behaviour(old_behaviour);
+					progress_tick();
+				});
+			}
+			if (level.size() % 2) next.back() = level.back();
+			ThreadPool::instance()->run(tasks);
+			level.swap(next);
+		}
+		return level.front();
+	}
+
 	CGAL_Nef_polyhedron *applyUnion3D(Geometry::Geometries::iterator chbegin, Geometry::Geometries::iterator chend)
 	{
 		typedef std::pair<shared_ptr<const CGAL_Nef_polyhedron>, int> QueueConstItem;
@@ -155,24 +271,41 @@ namespace CGALUtils {
 		std::priority_queue<QueueConstItem, std::vector<QueueConstItem>, QueueItemGreater> q;
 
 		try {
+			// Converting PolySets is costly as well, so do it concurrently when possible
+			std::vector<Geometry::Geometries::iterator> children;
+			for (auto it = chbegin; it != chend; ++it) children.push_back(it);
+			std::vector<shared_ptr<const CGAL_Nef_polyhedron>> polyhedra(children.size());
+			std::vector<ThreadPool::Task> tasks;
+			for (size_t i = 0; i < children.size(); ++i) {
+				tasks.push_back([&children, &polyhedra, i]() {
+					const shared_ptr<const Geometry> &chgeom = children[i]->second;
+					polyhedra[i] = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(chgeom);
+					if (!polyhedra[i]) {
+						const PolySet *chps = dynamic_cast<const PolySet*>(chgeom.get());
+						if (chps) polyhedra[i].reset(createNefPolyhedronFromGeometry(*chps));
+					}
+				});
+			}
+			ThreadPool::instance()->run(tasks);
+
 			// sort children by fewest faces
-			for (auto it = chbegin; it != chend; ++it) {
-				const shared_ptr<const Geometry> &chgeom = it->second;
-				shared_ptr<const CGAL_Nef_polyhedron> curChild = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(chgeom);
-				if (!curChild) {
-					const PolySet *chps = dynamic_cast<const PolySet*>(chgeom.get());
-					if (chps) curChild.reset(createNefPolyhedronFromGeometry(*chps));
-				}
+			for (size_t i = 0; i < children.size(); ++i) {
+				const auto &curChild = polyhedra[i];
 				if (curChild && !curChild->isEmpty()) {
 					int node_mark = -1;
-					if (it->first) {
-						node_mark = it->first->progress_mark;
+					if (children[i]->first) {
+						node_mark = children[i]->first->progress_mark;
 					}
 					q.emplace(curChild, node_mark);
 				}
 			}
 
 			progress_tick();
+			if (ThreadPool::instance()->isParallel() && q.size() > 2) {
+				std::vector<shared_ptr<const CGAL_Nef_polyhedron>> sorted;
+				for (; !q.empty(); q.pop()) sorted.push_back(q.top().first);
+				return new CGAL_Nef_polyhedron(applyUnion3DBalanced(sorted)->p3);
+			}
 			while (q.size() > 1) {
 				auto p1 = q.top();
 				q.pop();
@@ -196,6 +329,120 @@ namespace CGALUtils {
 
 
 
+	/*!
+		Groups children into clusters of transitively overlapping bounding boxes,
+		by sweeping the boxes along the x axis. Touching boxes count as
+		overlapping, since their union has to merge them. Clusters are listed
+		in order of their first child, with children in their original order.
+	*/
+	static std::vector<std::vector<size_t>> findOverlapClusters(const std::vector<BoundingBox> &boxes)
+	{
+		std::vector<size_t> parent(boxes.size());
+		for (size_t i = 0; i < parent.size(); ++i) parent[i] = i;
+		std::function<size_t(size_t)> root = [&](size_t i) {
+			return parent[i] == i ? i : (parent[i] = root(parent[i]));
+		};
+
+		std::vector<size_t> order(boxes.size());
+		for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+		std::sort(order.begin(), order.end(), [&boxes](size_t a, size_t b) {
+			return boxes[a].min()[0] < boxes[b].min()[0];
+		});
+		std::vector<size_t> active;
+		for (const auto i : order) {
+			// Drop boxes which end before this one starts
+			active.erase(std::remove_if(active.begin(), active.end(), [&](size_t j) {
+				return boxes[j].max()[0] < boxes[i].min()[0];
+			}), active.end());
+			for (const auto j : active) {
+				if (boxes[i].intersects(boxes[j])) parent[root(i)] = root(j);
+			}
+			active.push_back(i);
+		}
+
+		std::vector<std::vector<size_t>> clusters;
+		std::map<size_t, size_t> clusterindex;
+		for (size_t i = 0; i < boxes.size(); ++i) {
+			auto it = clusterindex.emplace(root(i), clusters.size()).first;
+			if (it->second == clusters.size()) clusters.emplace_back();
+			clusters[it->second].push_back(i);
+		}
+		return clusters;
+	}
+
+	/*!
+		Unions 3D children, but only sends clusters of children with overlapping
+		bounding boxes through Nef polyhedra. Clusters are disjoint from each
+		other, so their union is just the concatenation of their meshes.
+
+		Returns a PolySet unless all children end up in the same cluster, in which
+		case the result is the CGAL_Nef_polyhedron from applyUnion3D(). May return
+		nullptr if there are no non-empty children.
+	*/
+	Geometry *applyClusteredUnion3D(const Geometry::Geometries &children)
+	{
+		Geometry::Geometries nonempty;
+		std::vector<BoundingBox> boxes;
+		try {
+			for (const auto &item : children) {
+				if (!item.second || item.second->isEmpty()) continue;
+				auto box = boundingBox(*item.second);
+				// Allow for rounding when converting Nef results back to PolySets
+				box.extend(box.min() - Vector3d(GRID_FINE, GRID_FINE, GRID_FINE));
+				box.extend(box.max() + Vector3d(GRID_FINE, GRID_FINE, GRID_FINE));
+				nonempty.push_back(item);
+				boxes.push_back(box);
+			}
+		}
+		catch (const CGAL::Failure_exception &e) {
+			LOG(message_group::Error, Location::NONE, "", "CGAL error in CGALUtils::applyClusteredUnion3D: %1$s", e.what());
+			return nullptr;
+		}
+		if (nonempty.empty()) return nullptr;
+
+		const auto clusters = findOverlapClusters(boxes);
+		std::vector<Geometry::Geometries::iterator> items;
+		for (auto it = nonempty.begin(); it != nonempty.end(); ++it) items.push_back(it);
+		if (clusters.size() == 1) return applyUnion3D(nonempty.begin(), nonempty.end());
+
+		// Union each overlapping cluster on its own, concurrently if possible
+		std::vector<shared_ptr<const Geometry>> parts(clusters.size());
+		std::vector<ThreadPool::Task> tasks;
+		for (size_t c = 0; c < clusters.size(); ++c) {
+			const auto &cluster = clusters[c];
+			if (cluster.size() == 1) {
+				parts[c] = items[cluster.front()]->second;
+				continue;
+			}
+			tasks.push_back([&parts, &cluster, &items, c]() {
+				Geometry::Geometries clusterchildren;
+				for (const auto i : cluster) clusterchildren.push_back(*items[i]);
+				parts[c].reset(applyUnion3D(clusterchildren.begin(), clusterchildren.end()));
+			});
+		}
+		ThreadPool::instance()->run(tasks);
+
+		auto ps = new PolySet(3);
+		for (const auto &part : parts) {
+			if (!part) continue;
+			ps->setConvexity(std::max(ps->getConvexity(), part->getConvexity()));
+			if (const auto partps = dynamic_cast<const PolySet *>(part.get())) {
+				ps->append(*partps);
+			}
+			else if (const auto N = dynamic_cast<const CGAL_Nef_polyhedron *>(part.get())) {
+				if (N->isEmpty()) continue;
+				PolySet nefps(3);
+				if (createPolySetFromNefPolyhedron3(*N->p3, nefps)) {
+					// Can't represent the cluster as a mesh, fall back to a full Nef union
+					delete ps;
+					return applyUnion3D(nonempty.begin(), nonempty.end());
+				}
+				ps->append(nefps);
+			}
+		}
+		return ps;
+	}
+
 	bool applyHull(const Geometry::Geometries &children, PolySet &result)
 	{
 		typedef CGAL::Epick K;
@@ -216,8 +463,9 @@ namespace CGALUtils {
 			} else {
 				const PolySet *ps = dynamic_cast<const PolySet *>(chgeom.get());
 				if (ps) {
-					for(const auto &p : ps->polygons) {
-						for(const auto &v : p) {
+					for(const auto &face : ps->indices) {
+						for(const auto idx : face) {
+							const auto &v = ps->vertices[idx];
 							points.push_back(K::Point_3(v[0], v[1], v[2]));
 						}
 					}
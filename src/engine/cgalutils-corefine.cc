@@ -0,0 +1,168 @@
+#include "cgalutils.h"
+#include "../common/printutils.h"
+#include "math/polyset-utils.h"
+
+#pragma push_macro("NDEBUG")
+#undef NDEBUG
+#if CGAL_VERSION_NR >= CGAL_VERSION_NUMBER(4,13,0)
+  #include <CGAL/Exact_predicates_exact_constructions_kernel.h>
+  #include <CGAL/Surface_mesh.h>
+  #include <CGAL/boost/graph/helpers.h>
+  #include <CGAL/Polygon_mesh_processing/corefinement.h>
+  #include <CGAL/Polygon_mesh_processing/orientation.h>
+  #include <CGAL/Polygon_mesh_processing/self_intersections.h>
+#endif
+#pragma pop_macro("NDEBUG")
+
+#if CGAL_VERSION_NR >= CGAL_VERSION_NUMBER(4,13,0)
+
+namespace /* anonymous */ {
+	// Filtered exact predicates with lazily evaluated exact constructions
+	typedef CGAL::Epeck CorefinementKernel;
+	typedef CGAL::Surface_mesh<CorefinementKernel::Point_3> TriangleMesh;
+	namespace PMP = CGAL::Polygon_mesh_processing;
+
+	/*!
+		Builds an indexed triangle mesh from a PolySet or Nef polyhedron.
+
+		Returns false if the result is not a closed, self-intersection free
+		2-manifold, since corefinement can't bound a volume otherwise.
+	*/
+	bool createMeshFromGeometry(const Geometry &geom, TriangleMesh &mesh)
+	{
+		PolySet nefps(3);
+		const PolySet *ps = dynamic_cast<const PolySet *>(&geom);
+		if (const auto N = dynamic_cast<const CGAL_Nef_polyhedron *>(&geom)) {
+			if (!N->p3 || CGALUtils::createPolySetFromNefPolyhedron3(*N->p3, nefps)) return false;
+			ps = &nefps;
+		}
+		if (!ps) return false;
+
+		PolySet triangles(3);
+		PolysetUtils::tessellate_faces(*ps, triangles);
+
+		// The tessellated PolySet shares its vertices, so it maps directly to the mesh
+		std::vector<TriangleMesh::Vertex_index> vertices(triangles.vertices.size(), TriangleMesh::null_vertex());
+		for (const auto &triangle : triangles.indices) {
+			if (triangle.size() != 3) return false;
+			TriangleMesh::Vertex_index v[3];
+			for (int i = 0; i < 3; ++i) {
+				auto &vertex = vertices[triangle[i]];
+				if (vertex == TriangleMesh::null_vertex()) {
+					const auto &p = triangles.vertices[triangle[i]];
+					vertex = mesh.add_vertex(CorefinementKernel::Point_3(p[0], p[1], p[2]));
+				}
+				v[i] = vertex;
+			}
+			if (v[0] == v[1] || v[1] == v[2] || v[2] == v[0]) continue;
+			// add_face() refuses faces which would make the mesh non-manifold
+			if (mesh.add_face(v[0], v[1], v[2]) == TriangleMesh::null_face()) return false;
+		}
+
+		if (!CGAL::is_valid_polygon_mesh(mesh) || !CGAL::is_closed(mesh)) return false;
+		if (PMP::does_self_intersect(mesh)) return false;
+		if (!PMP::is_outward_oriented(mesh)) PMP::reverse_face_orientations(mesh);
+		return true;
+	}
+
+	void createPolySetFromMesh(const TriangleMesh &mesh, PolySet &ps)
+	{
+		// Vertex indices count removed vertices as well
+		std::vector<int> indices(mesh.number_of_vertices() + mesh.number_of_removed_vertices(), -1);
+		for (const auto v : mesh.vertices()) {
+			indices[size_t(v)] = ps.add_vertex(vector_convert<Vector3d>(mesh.point(v)));
+		}
+		for (const auto f : mesh.faces()) {
+			IndexedFace face;
+			for (const auto v : CGAL::vertices_around_face(mesh.halfedge(f), mesh)) {
+				face.push_back(indices[size_t(v)]);
+			}
+			ps.append_poly(face);
+		}
+	}
+
+	bool corefine(TriangleMesh &a, TriangleMesh &b, OpenSCADOperator op, TriangleMesh &out)
+	{
+		switch (op) {
+		case OpenSCADOperator::UNION:
+			return PMP::corefine_and_compute_union(a, b, out);
+		case OpenSCADOperator::INTERSECTION:
+			return PMP::corefine_and_compute_intersection(a, b, out);
+		case OpenSCADOperator::DIFFERENCE:
+			return PMP::corefine_and_compute_difference(a, b, out);
+		default:
+			return false;
+		}
+	}
+}
+
+#endif // CGAL_VERSION_NR >= CGAL_VERSION_NUMBER(4,13,0)
+
+namespace CGALUtils {
+
+	/*!
+		Applies union, intersection or difference to 3D children by corefining
+		their triangle meshes, which is much faster than going through Nef
+		polyhedra.
+
+		Returns false without touching \a result if any operand is not a closed
+		manifold, or if CGAL can't compute the result. The caller is expected to
+		fall back to the Nef polyhedron based operators in that case.
+	*/
+	bool applyCorefinement3D(const Geometry::Geometries &children, OpenSCADOperator op, PolySet &result)
+	{
+#if CGAL_VERSION_NR >= CGAL_VERSION_NUMBER(4,13,0)
+		if (op != OpenSCADOperator::UNION &&
+				op != OpenSCADOperator::INTERSECTION &&
+				op != OpenSCADOperator::DIFFERENCE) return false;
+
+		CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+		bool ok = true;
+		try {
+			TriangleMesh acc;
+			bool first = true;
+			for (const auto &item : children) {
+				const shared_ptr<const Geometry> &chgeom = item.second;
+				const bool isempty = !chgeom || chgeom->isEmpty();
+				if (isempty) {
+					// Empty operands don't contribute to unions or as subtrahends
+					if (op == OpenSCADOperator::UNION || (op == OpenSCADOperator::DIFFERENCE && !first)) continue;
+					acc.clear();
+					break;
+				}
+
+				TriangleMesh operand;
+				if (!createMeshFromGeometry(*chgeom, operand)) {
+					PRINTD("Corefinement: non-manifold operand, falling back to Nef polyhedra");
+					ok = false;
+					break;
+				}
+				if (first || (op == OpenSCADOperator::UNION && acc.is_empty())) {
+					acc = std::move(operand);
+					first = false;
+					continue;
+				}
+
+				TriangleMesh out;
+				if (!corefine(acc, operand, op, out)) {
+					ok = false;
+					break;
+				}
+				acc = std::move(out);
+				// Nothing can be added back by intersecting or subtracting
+				if (acc.is_empty() && op != OpenSCADOperator::UNION) break;
+			}
+			if (ok) createPolySetFromMesh(acc, result);
+		}
+		catch (const CGAL::Failure_exception &e) {
+			PRINTDB("Corefinement failed, falling back to Nef polyhedra: %s", e.what());
+			ok = false;
+		}
+		CGAL::set_error_behaviour(old_behaviour);
+		return ok;
+#else
+		return false;
+#endif
+	}
+
+}; // namespace CGALUtils
@@ -13,6 +13,7 @@
 #pragma pop_macro("NDEBUG")
 
 #include <boost/range/adaptor/reversed.hpp>
+#include <unordered_map>
 
 #undef GEN_SURFACE_DEBUG
 namespace /* anonymous */ {
@@ -49,19 +50,24 @@ namespace /* anonymous */ {
 			Grid3d<int> grid(GRID_FINE);
 			std::vector<CGALPoint> vertices;
 			std::vector<std::vector<size_t>> indices;
+			// Grid index of each PolySet vertex, or -1 if not aligned yet
+			std::vector<int> gridindices(ps.vertices.size(), -1);
 
-			// Align all vertices to grid and build vertex array in vertices
-			for(const auto &p : ps.polygons) {
+			// Align all used vertices to grid and build vertex array in vertices
+			for(const auto &face : ps.indices) {
 				indices.push_back(std::vector<size_t>());
-				indices.back().reserve(p.size());
-				for (auto v : boost::adaptors::reverse(p)) {
-					// align v to the grid; the CGALPoint will receive the aligned vertex
-					size_t idx = grid.align(v);
-					if (idx == vertices.size()) {
-						CGALPoint p(v[0], v[1], v[2]);
-						vertices.push_back(p);
+				indices.back().reserve(face.size());
+				for (auto i : boost::adaptors::reverse(face)) {
+					if (gridindices[i] < 0) {
+						// align v to the grid; the CGALPoint will receive the aligned vertex
+						Vector3d v = ps.vertices[i];
+						gridindices[i] = grid.align(v);
+						if (size_t(gridindices[i]) == vertices.size()) {
+							CGALPoint p(v[0], v[1], v[2]);
+							vertices.push_back(p);
+						}
 					}
-					indices.back().push_back(idx);
+					indices.back().push_back(gridindices[i]);
 				}
 			}
 
@@ -69,7 +75,7 @@ namespace /* anonymous */ {
 			printf("polyhedron(faces=[");
 			int pidx = 0;
 #endif
-			B.begin_surface(vertices.size(), ps.polygons.size());
+			B.begin_surface(vertices.size(), ps.indices.size());
 			for(const auto &p : vertices) {
 				B.add_vertex(p);
 			}
@@ -119,12 +125,13 @@ namespace /* anonymous */ {
 				std::vector<size_t> indices(3);
 
 				// Estimating same # of vertices as polygons (very rough)
-				B.begin_surface(ps.polygons.size(), ps.polygons.size());
+				B.begin_surface(ps.indices.size(), ps.indices.size());
 				int pidx = 0;
 #ifdef GEN_SURFACE_DEBUG
 				printf("polyhedron(faces=[");
 #endif
-				for(const auto &p : ps.polygons) {
+				for (size_t f = 0; f < ps.indices.size(); ++f) {
+					const Polygon p = ps.getFace(f);
 #ifdef GEN_SURFACE_DEBUG
 					if (pidx++ > 0) printf(",");
 #endif
@@ -270,19 +277,23 @@ namespace CGALUtils {
 	{
 		bool err = false;
 		typedef typename Polyhedron::Vertex                                 Vertex;
+		typedef typename Polyhedron::Vertex_const_iterator                  VCI;
 		typedef typename Polyhedron::Facet_const_iterator                   FCI;
 		typedef typename Polyhedron::Halfedge_around_facet_const_circulator HFCC;
-		
+
+		std::unordered_map<const Vertex *, int> indices;
+		for (VCI vi = p.vertices_begin(); vi != p.vertices_end(); ++vi) {
+			double x = CGAL::to_double(vi->point().x());
+			double y = CGAL::to_double(vi->point().y());
+			double z = CGAL::to_double(vi->point().z());
+			indices[&*vi] = ps.add_vertex(Vector3d(x, y, z));
+		}
 		for (FCI fi = p.facets_begin(); fi != p.facets_end(); ++fi) {
 			HFCC hc = fi->facet_begin();
 			HFCC hc_end = hc;
 			ps.append_poly();
 			do {
-				Vertex const& v = *((hc++)->vertex());
-				double x = CGAL::to_double(v.point().x());
-				double y = CGAL::to_double(v.point().y());
-				double z = CGAL::to_double(v.point().z());
-				ps.append_vertex(x, y, z);
+				ps.indices.back().push_back(indices[&*((hc++)->vertex())]);
 			} while (hc != hc_end);
 		}
 		return err;
@@ -29,6 +29,7 @@
 #include "Reindexer.h"
 #include "math/hash.h"
 #include "math/GeometryUtils.h"
+#include "Trace.h"
 
 #include <map>
 #include <queue>
@@ -51,9 +52,9 @@ static CGAL_Nef_polyhedron *createNefPolyhedronFromPolySet(const PolySet &ps)
 		// NB! CGAL's convex_hull_3() doesn't like std::set iterators, so we use a list
 		// instead.
 		std::list<K::Point_3> points;
-		for (const auto &poly : psq.polygons) {
-			for (const auto &p : poly) {
-				points.push_back(vector_convert<K::Point_3>(p));
+		for (const auto &face : psq.indices) {
+			for (const auto idx : face) {
+				points.push_back(vector_convert<K::Point_3>(psq.vertices[idx]));
 			}
 		}
 
@@ -170,16 +171,16 @@ namespace CGALUtils {
 		typedef std::map<Edge, int, VecPairCompare> Edge_to_facet_map;
 		Edge_to_facet_map edge_to_facet_map;
 		std::vector<Plane> facet_planes;
-		facet_planes.reserve(ps.polygons.size());
+		facet_planes.reserve(ps.indices.size());
 
-		for (size_t i = 0; i < ps.polygons.size(); ++i) {
+		for (size_t i = 0; i < ps.indices.size(); ++i) {
 			Plane plane;
-			auto N = ps.polygons[i].size();
+			auto N = ps.indices[i].size();
 			if (N >= 3) {
 				std::vector<Point> v(N);
 				for (size_t j = 0; j < N; ++j) {
-					v[j] = vector_convert<Point>(ps.polygons[i][j]);
-					Edge edge(ps.polygons[i][j],ps.polygons[i][(j+1)%N]);
+					v[j] = vector_convert<Point>(ps.vertices[ps.indices[i][j]]);
+					Edge edge(ps.vertices[ps.indices[i][j]],ps.vertices[ps.indices[i][(j+1)%N]]);
 					if (edge_to_facet_map.count(edge)) return false; // edge already exists: nonmanifold
 					edge_to_facet_map[edge] = i;
 				}
@@ -190,18 +191,18 @@ namespace CGALUtils {
 			facet_planes.push_back(plane);
 		}
 
-		for (size_t i = 0; i < ps.polygons.size(); ++i) {
-			auto N = ps.polygons[i].size();
+		for (size_t i = 0; i < ps.indices.size(); ++i) {
+			auto N = ps.indices[i].size();
 			if (N < 3) continue;
 			for (size_t j = 0; j < N; ++j) {
-				Edge other_edge(ps.polygons[i][(j+1)%N], ps.polygons[i][j]);
+				Edge other_edge(ps.vertices[ps.indices[i][(j+1)%N]], ps.vertices[ps.indices[i][j]]);
 				if (edge_to_facet_map.count(other_edge) == 0) return false;//
 				//Edge_to_facet_map::const_iterator it = edge_to_facet_map.find(other_edge);
 				//if (it == edge_to_facet_map.end()) return false; // not a closed manifold
 				//int other_facet = it->second;
 				int other_facet = edge_to_facet_map[other_edge];
 
-				auto p = vector_convert<Point>(ps.polygons[i][(j+2)%N]);
+				auto p = vector_convert<Point>(ps.vertices[ps.indices[i][(j+2)%N]]);
 
 				if (facet_planes[other_facet].has_on_positive_side(p)) {
 					// Check angle
@@ -224,9 +225,9 @@ namespace CGALUtils {
 		while(!facets_to_visit.empty()) {
 			int f = facets_to_visit.front(); facets_to_visit.pop();
 
-			for (size_t i = 0; i < ps.polygons[f].size(); ++i) {
-				int j = (i+1) % ps.polygons[f].size();
-				auto it = edge_to_facet_map.find(Edge(ps.polygons[f][j], ps.polygons[f][i]));
+			for (size_t i = 0; i < ps.indices[f].size(); ++i) {
+				int j = (i+1) % ps.indices[f].size();
+				auto it = edge_to_facet_map.find(Edge(ps.vertices[ps.indices[f][j]], ps.vertices[ps.indices[f][i]]));
 				if (it == edge_to_facet_map.end()) return false; // Nonmanifold
 				if (!explored_facets.count(it->second)) {
 					explored_facets.insert(it->second);
@@ -236,12 +237,13 @@ namespace CGALUtils {
 		}
 
 		// Make sure that we were able to reach all polygons during our visit
-		return explored_facets.size() == ps.polygons.size();
+		return explored_facets.size() == ps.indices.size();
 	}
 
 
 	CGAL_Nef_polyhedron *createNefPolyhedronFromGeometry(const Geometry &geom)
 	{
+		Trace::Span span("cgal", "createNefPolyhedronFromGeometry");
 		if (auto ps = dynamic_cast<const PolySet*>(&geom)) {
 			return createNefPolyhedronFromPolySet(*ps);
 		}
@@ -268,6 +270,7 @@ namespace CGALUtils {
 		// 4. Validate mesh (manifoldness)
 		// 5. Create PolySet
 
+		Trace::Span span("cgal", "createPolySetFromNefPolyhedron3");
 		bool err = false;
 
 		// 1. Build Indexed PolyMesh
@@ -373,11 +376,10 @@ namespace CGALUtils {
 			LOG(message_group::Error,Location::NONE,"","Non-manifold mesh created: %1$d unconnected edges",unconnected2);
 		}
 
+		const int offset = ps.vertices.size();
+		for (const auto &v : verts) ps.add_vertex(v.cast<double>());
 		for (const auto &t : allTriangles) {
-			ps.append_poly();
-			ps.append_vertex(verts[t[0]]);
-			ps.append_vertex(verts[t[1]]);
-			ps.append_vertex(verts[t[2]]);
+			ps.append_poly(IndexedFace{offset + t[0], offset + t[1], offset + t[2]});
 		}
 
 #if 0 // For debugging
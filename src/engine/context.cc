@@ -32,15 +32,54 @@
 #include "UserModule.h"
 #include "ModuleInstantiation.h"
 #include "builtin.h"
+#include "Profiler.h"
 #include "../common/printutils.h"
 #include <boost/filesystem.hpp>
 #include "../common/boost-utils.h"
 namespace fs = boost::filesystem;
 
+namespace {
+	// Past this size, VariableMap lookups use a hash index instead of a linear search
+	const size_t VARIABLE_INDEX_THRESHOLD = 16;
+}
+
+uint32_t VariableMap::slot(const Symbol &sym) const
+{
+	if (!mayContain(sym)) return npos;
+	if (!this->index.empty()) {
+		const auto it = this->index.find(sym.index());
+		return it == this->index.end() ? npos : it->second;
+	}
+	for (size_t i = 0; i < this->symbols.size(); ++i) {
+		if (this->symbols[i] == sym) return i;
+	}
+	return npos;
+}
+
+void VariableMap::set(const Symbol &sym, const ValuePtr &value)
+{
+	const uint32_t s = slot(sym);
+	if (s != npos) {
+		this->values[s] = value;
+		return;
+	}
+	this->symbols.push_back(sym);
+	this->values.push_back(value);
+	this->filter |= bit(sym);
+	if (!this->index.empty()) {
+		this->index.emplace(sym.index(), this->symbols.size() - 1);
+	}
+	else if (this->symbols.size() > VARIABLE_INDEX_THRESHOLD) {
+		for (size_t i = 0; i < this->symbols.size(); ++i) {
+			this->index.emplace(this->symbols[i].index(), i);
+		}
+	}
+}
+
 // $children is not a config_variable. config_variables have dynamic scope, 
 // meaning they are passed down the call chain implicitly.
 // $children is simply misnamed and shouldn't have included the '$'.
-static bool is_config_variable(const std::string &name)
+bool Context::is_config_variable(const std::string &name)
 {
 	return name[0] == '$' && name != "$children";
 }
@@ -52,6 +91,7 @@ static bool is_config_variable(const std::string &name)
 */
 Context::Context(const std::shared_ptr<Context> parent) : parent(parent)
 {
+	Profiler::allocated();
 	if (parent) {
 		assert(parent->ctx_stack && "Parent context stack was null!");
 		this->ctx_stack = parent->ctx_stack;
@@ -70,13 +110,47 @@ Context::~Context()
 
 void Context::push(std::shared_ptr<Context> ctx)
 {
-	this->ctx_stack->push_back(ctx);
+	stack().push_back(ctx);
 }
 
 void Context::pop()
 {
 	assert(this->ctx_stack && "Context stack was null at destruction!");
-	this->ctx_stack->pop_back();
+	stack().pop_back();
+}
+
+namespace {
+	// The innermost ThreadStack of the current thread, if any
+	thread_local Context::ThreadStack *thread_stack = nullptr;
+}
+
+Context::ThreadStack::ThreadStack(const Context &ctx, const Stack &stack)
+	: shared(ctx.ctx_stack), copy(stack), previous(thread_stack)
+{
+	thread_stack = this;
+}
+
+Context::ThreadStack::~ThreadStack()
+{
+	thread_stack = this->previous;
+}
+
+Context::ThreadStack *Context::ThreadStack::current()
+{
+	return thread_stack;
+}
+
+void Context::ThreadStack::setCurrent(ThreadStack *stack)
+{
+	thread_stack = stack;
+}
+
+Context::Stack &Context::stack() const
+{
+	for (auto s = thread_stack; s; s = s->previous) {
+		if (s->shared == this->ctx_stack) return s->copy;
+	}
+	return *this->ctx_stack;
 }
 
 /*!
@@ -87,13 +161,13 @@ void Context::setVariables(const std::shared_ptr<EvalContext> evalctx, const Ass
 {
 	// Set any default values
 	for (const auto &arg : args) {
-		set_variable(arg->getName(), arg->getExpr() ? arg->getExpr()->evaluate(this->parent) : ValuePtr::undefined);
+		set_variable(arg->getSymbol(), arg->getExpr() ? arg->getExpr()->execute(this->parent) : ValuePtr::undefined);
 	}
 	
 	if (evalctx) {
 		auto assignments = evalctx->resolveArguments(args, optargs, usermodule && !OpenSCAD::parameterCheck);
 		for (const auto &ass : assignments) {
-			this->set_variable(ass.first, ass.second->evaluate(evalctx));
+			this->set_variable(ass.first, ass.second->execute(evalctx));
 		}
 	}
 }
@@ -101,7 +175,13 @@ void Context::setVariables(const std::shared_ptr<EvalContext> evalctx, const Ass
 void Context::set_variable(const std::string &name, const ValuePtr &value)
 {
 	if (is_config_variable(name)) this->config_variables[name] = value;
-	else this->variables[name] = value;
+	else this->variables.set(Symbol(name), value);
+}
+
+void Context::set_variable(const Symbol &sym, const ValuePtr &value)
+{
+	if (sym.isConfigVariable()) this->config_variables[sym.name()] = value;
+	else this->variables.set(sym, value);
 }
 
 void Context::set_variable(const std::string &name, const Value &value)
@@ -111,11 +191,12 @@ void Context::set_variable(const std::string &name, const Value &value)
 
 void Context::set_constant(const std::string &name, const ValuePtr &value)
 {
-	if (this->constants.find(name) != this->constants.end()) {
+	const Symbol sym(name);
+	if (this->constants.find(sym)) {
 		LOG(message_group::Warning,Location::NONE,"","Attempt to modify constant '%1$s'.",name);
 	}
 	else {
-		this->constants[name] = value;
+		this->constants.set(sym, value);
 	}
 }
 
@@ -126,8 +207,8 @@ void Context::set_constant(const std::string &name, const Value &value)
 
 void Context::apply_variables(const std::shared_ptr<Context> other)
 {
-	for (const auto &var : other->variables) {
-		set_variable(var.first, var.second);
+	for (size_t i = 0; i < other->variables.size(); ++i) {
+		this->variables.set(other->variables.symbolAt(i), other->variables.valueAt(i));
 	}
 }
 
@@ -153,8 +234,9 @@ ValuePtr Context::lookup_variable(const std::string &name, bool silent, const Lo
 {
 	assert(this->ctx_stack && "Context had null stack in lookup_variable()!!");
 	if (is_config_variable(name)) {
-		for (int i = this->ctx_stack->size()-1; i >= 0; i--) {
-			const auto &confvars = ctx_stack->at(i)->config_variables;
+		const Stack &stack = this->stack();
+		for (int i = stack.size()-1; i >= 0; i--) {
+			const auto &confvars = stack[i]->config_variables;
 			if (confvars.find(name) != confvars.end()) {
 				return confvars.find(name)->second;
 			}
@@ -164,17 +246,79 @@ ValuePtr Context::lookup_variable(const std::string &name, bool silent, const Lo
 		}
 		return ValuePtr::undefined;
 	}
-	if (!this->parent && this->constants.find(name) != this->constants.end()) {
-		return this->constants.find(name)->second;
+	ResolvedSlot resolved;
+	return lookup_variable(Symbol(name), resolved, silent, loc);
+}
+
+/*!
+	Finds a variable by walking up the context chain. Returns the context
+	depth and slot it was found at, so lookups of the same reference can try
+	there first next time.
+*/
+const ValuePtr *Context::find_variable(const Symbol &sym, uint32_t &depth, uint32_t &slot) const
+{
+	depth = 0;
+	for (const Context *c = this; c; c = c->parent.get(), ++depth) {
+		if (!c->parent) {
+			slot = c->constants.slot(sym);
+			if (slot != VariableMap::npos) {
+				slot |= ResolvedSlot::CONSTANT;
+				return &c->constants.valueAt(slot & ~ResolvedSlot::CONSTANT);
+			}
+		}
+		slot = c->variables.slot(sym);
+		if (slot != VariableMap::npos) return &c->variables.valueAt(slot);
 	}
-	if (this->variables.find(name) != this->variables.end()) {
-		return this->variables.find(name)->second;
+	return nullptr;
+}
+
+/*!
+	Looks up a variable by symbol, trying the context depth and slot it was
+	found at by the previous lookup through \a resolved first. Contexts
+	below that depth are only searched if their filter says they may
+	contain the symbol, which almost never happens in practice.
+*/
+ValuePtr Context::lookup_variable(const Symbol &sym, ResolvedSlot &resolved, bool silent, const Location &loc) const
+{
+	if (sym.isConfigVariable()) return lookup_variable(sym.name(), silent, loc);
+
+	const uint32_t depth = resolved.depth.load(std::memory_order_relaxed);
+	if (depth != UINT32_MAX) {
+		const Context *c = this;
+		for (uint32_t i = 0; c && i < depth; ++i) {
+			// Shadowed by a closer definition
+			if (c->variables.find(sym) || (!c->parent && c->constants.find(sym))) {
+				c = nullptr;
+				break;
+			}
+			c = c->parent.get();
+		}
+		const uint32_t slot = resolved.slot.load(std::memory_order_relaxed);
+		const uint32_t index = slot & ~ResolvedSlot::CONSTANT;
+		if (!c) {
+			// Fall through to a full lookup
+		}
+		else if (slot & ResolvedSlot::CONSTANT) {
+			if (!c->parent && index < c->constants.size() && c->constants.symbolAt(index) == sym) {
+				return c->constants.valueAt(index);
+			}
+		}
+		else if (index < c->variables.size() && c->variables.symbolAt(index) == sym &&
+						 (c->parent || !c->constants.find(sym))) {
+			return c->variables.valueAt(index);
+		}
 	}
-	if (this->parent) {
-		return this->parent->lookup_variable(name, silent, loc);
+
+	uint32_t newdepth, newslot;
+	if (const auto value = find_variable(sym, newdepth, newslot)) {
+		resolved.depth.store(newdepth, std::memory_order_relaxed);
+		resolved.slot.store(newslot, std::memory_order_relaxed);
+		return *value;
 	}
 	if (!silent) {
-		LOG(message_group::Warning,loc,this->documentPath(),"Ignoring unknown variable '%1$s'",name);
+		const Context *root = this;
+		while (root->parent) root = root->parent.get();
+		LOG(message_group::Warning,loc,root->documentPath(),"Ignoring unknown variable '%1$s'",sym.name());
 	}
 	return ValuePtr::undefined;
 }
@@ -207,10 +351,18 @@ bool Context::has_local_variable(const std::string &name) const
 	if (is_config_variable(name)) {
 		return config_variables.find(name) != config_variables.end();
 	}
-	if (!parent && constants.find(name) != constants.end()) {
+	return has_local_variable(Symbol(name));
+}
+
+bool Context::has_local_variable(const Symbol &sym) const
+{
+	if (sym.isConfigVariable()) {
+		return config_variables.find(sym.name()) != config_variables.end();
+	}
+	if (!parent && constants.find(sym)) {
 		return true;
 	}
-	return variables.find(name) != variables.end();
+	return variables.find(sym) != nullptr;
 }
 
 /**
@@ -273,17 +425,16 @@ std::string Context::dump(const AbstractModule *mod, const ModuleInstantiation *
 		if (m) {
 			s << "  module args:";
 			for(const auto &arg : m->definition_arguments) {
-				s << boost::format("    %s = %s\n") % arg->getName() % variables[arg->getName()];
+				s << boost::format("    %s = %s\n") % arg->getName() % lookup_variable(arg->getName(), true);
 			}
 		}
 	}
-	typedef std::pair<std::string, ValuePtr> ValueMapType;
 	s << "  vars:\n";
-	for(const auto &v : constants) {
-		s << boost::format("    %s = %s\n") % v.first % v.second->toEchoString();
+	for (size_t i = 0; i < constants.size(); ++i) {
+		s << boost::format("    %s = %s\n") % constants.symbolAt(i).name() % constants.valueAt(i)->toEchoString();
 	}
-	for(const auto &v : variables) {
-		s << boost::format("    %s = %s\n") % v.first % v.second->toEchoString();
+	for (size_t i = 0; i < variables.size(); ++i) {
+		s << boost::format("    %s = %s\n") % variables.symbolAt(i).name() % variables.valueAt(i)->toEchoString();
 	}
 	for(const auto &v : config_variables) {
 		s << boost::format("    %s = %s\n") % v.first % v.second->toEchoString();
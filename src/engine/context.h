@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <map>
 #include <string>
 #include <vector>
@@ -7,6 +8,7 @@
 #include <unordered_map>
 #include "value.h"
 #include "Assignment.h"
+#include "symbol.h"
 #include "../common/memory.h"
 
 /**
@@ -36,6 +38,42 @@ struct ContextHandle
     const std::shared_ptr<T> ctx;
 };
 
+/*!
+	The variables of one context, in a flat array in order of first
+	assignment. Small maps are searched linearly by symbol, larger ones
+	(file and module scopes) get an index.
+
+	A 64 bit filter of the symbols present lets lookups skip contexts which
+	certainly don't define a variable, without searching them.
+*/
+class VariableMap
+{
+public:
+	static const uint32_t npos = UINT32_MAX;
+
+	VariableMap() : filter(0) {}
+
+	bool mayContain(const Symbol &sym) const { return this->filter & bit(sym); }
+	uint32_t slot(const Symbol &sym) const;
+	const ValuePtr *find(const Symbol &sym) const {
+		const uint32_t s = slot(sym);
+		return s == npos ? nullptr : &this->values[s];
+	}
+	void set(const Symbol &sym, const ValuePtr &value);
+
+	size_t size() const { return this->symbols.size(); }
+	const Symbol &symbolAt(size_t slot) const { return this->symbols[slot]; }
+	const ValuePtr &valueAt(size_t slot) const { return this->values[slot]; }
+
+private:
+	static uint64_t bit(const Symbol &sym) { return uint64_t(1) << (sym.index() & 63); }
+
+	std::vector<Symbol> symbols;
+	std::vector<ValuePtr> values;
+	std::unordered_map<uint32_t, uint32_t> index;
+	uint64_t filter;
+};
+
 class EvalContext;
 
 class Context : public std::enable_shared_from_this<Context>
@@ -49,6 +87,30 @@ public:
 	std::shared_ptr<Context> get_shared_ptr() { return shared_from_this(); }
 	void push(std::shared_ptr<Context> ctx);
 	void pop();
+	// The stack of this context's tree, or the current thread's copy of it
+	Stack &stack() const;
+
+	/*!
+		While in scope, the current thread uses its own copy of the stack of
+		a context tree, so parts of the tree can be evaluated on several
+		threads at once. The copy starts out with the given contexts.
+	*/
+	class ThreadStack
+	{
+	public:
+		ThreadStack(const Context &ctx, const Stack &stack);
+		~ThreadStack();
+
+		// The stacks of the current thread, for a StackSegment to continue with them
+		static ThreadStack *current();
+		static void setCurrent(ThreadStack *stack);
+
+	private:
+		const Stack *shared;
+		Stack copy;
+		ThreadStack *previous;
+		friend class Context;
+	};
 
     template<typename C, typename ... T>
     static ContextHandle<C> create(T&& ... t) {
@@ -66,17 +128,23 @@ public:
 
 	void set_variable(const std::string &name, const ValuePtr &value);
 	void set_variable(const std::string &name, const Value &value);
+	void set_variable(const Symbol &sym, const ValuePtr &value);
 	void set_constant(const std::string &name, const ValuePtr &value);
 	void set_constant(const std::string &name, const Value &value);
 
 	void apply_variables(const std::shared_ptr<Context> other);
 	void apply_config_variables(const std::shared_ptr<Context> other);
 	ValuePtr lookup_variable(const std::string &name, bool silent = false, const Location &loc=Location::NONE) const;
+	ValuePtr lookup_variable(const Symbol &sym, ResolvedSlot &resolved, bool silent = false, const Location &loc=Location::NONE) const;
 	double lookup_variable_with_default(const std::string &variable, const double &def, const Location &loc=Location::NONE) const;
 	std::string lookup_variable_with_default(const std::string &variable, const std::string &def, const Location &loc=Location::NONE) const;
 	ValuePtr lookup_local_config_variable(const std::string &name) const;
 
 	bool has_local_variable(const std::string &name) const;
+	bool has_local_variable(const Symbol &sym) const;
+	const VariableMap &local_variables() const { return this->variables; }
+
+	static bool is_config_variable(const std::string &name);
 
 	void setDocumentPath(const std::string &path) { this->document_path = std::make_shared<std::string>(path); }
 	const std::string &documentPath() const { return *this->document_path; }
@@ -88,24 +156,28 @@ protected:
 	const std::shared_ptr<Context> parent;
 	Stack *ctx_stack;
 
+	// Only used by the root context, and checked before its variables
+	VariableMap constants;
+	VariableMap variables;
+	// $-variables are dynamically scoped, so they're looked up by name
 	typedef std::unordered_map<std::string, ValuePtr> ValueMap;
-	ValueMap constants;
-	ValueMap variables;
 	ValueMap config_variables;
 
 	std::shared_ptr<std::string> document_path;
 
+private:
+	const ValuePtr *find_variable(const Symbol &sym, uint32_t &depth, uint32_t &slot) const;
+
 public:
 #ifdef DEBUG
 	virtual std::string dump(const class AbstractModule *mod, const ModuleInstantiation *inst);
 #endif
 
-	// Making friends with evaluate_function() to allow it to call the Context
+	// Making friends with evaluate_function_body() to allow it to call the Context
 	// constructor for creating ContextHandle objects in-place in the local
 	// context list. This is needed as ContextHandle handles the Context
 	// stack via RAII so we need to use emplace_front() to create the objects.
-	friend ValuePtr evaluate_function(const std::string& name,
+	friend ValuePtr evaluate_function_body(const std::string& name,
 			const std::shared_ptr<Expression>& expr, const AssignmentList &definition_arguments,
-			const std::shared_ptr<Context>& ctx, const std::shared_ptr<EvalContext>& evalctx,
-			const Location& loc);
+			const std::shared_ptr<Context>& c_next, const Location& loc);
 };
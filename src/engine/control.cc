@@ -31,6 +31,7 @@
 #include "modcontext.h"
 #include "expression.h"
 #include "builtin.h"
+#include "parallelfor.h"
 #include "../common/printutils.h"
 #include <cstdint>
 #include "../common/boost-utils.h"
@@ -56,8 +57,10 @@ public: // methods
 
 	AbstractNode *instantiate(const std::shared_ptr<Context>& ctx, const ModuleInstantiation *inst, const std::shared_ptr<EvalContext>& evalctx) const override;
 
-	static void for_eval(AbstractNode &node, const ModuleInstantiation &inst, size_t l,
+	static void for_eval(std::vector<AbstractNode *> &children, const ModuleInstantiation &inst, size_t l,
 						 const std::shared_ptr<Context> ctx, const std::shared_ptr<EvalContext> evalctx);
+	static void for_eval_parallel(std::vector<AbstractNode *> &children, const ModuleInstantiation &inst,
+								  const std::vector<ValuePtr> &values, const std::shared_ptr<EvalContext> evalctx);
 
 	static const std::shared_ptr<EvalContext> getLastModuleCtx(const std::shared_ptr<EvalContext> evalctx);
 
@@ -68,12 +71,14 @@ private: // data
 
 }; // class ControlModule
 
-void ControlModule::for_eval(AbstractNode &node, const ModuleInstantiation &inst, size_t l,
+void ControlModule::for_eval(std::vector<AbstractNode *> &children, const ModuleInstantiation &inst, size_t l,
 							const std::shared_ptr<Context> ctx, const std::shared_ptr<EvalContext> evalctx)
 {
 	if (evalctx->numArgs() > l) {
-		const std::string &it_name = evalctx->getArgName(l);
+		const Symbol &it_name = evalctx->getArgSymbol(l);
 		ValuePtr it_values = evalctx->getArgValue(l, ctx);
+		// Only the iterations of the first loop variable are split between threads
+		const bool parallel = l == 0;
 		ContextHandle<Context> c{Context::create<Context>(ctx)};
 		if (it_values->type() == Value::Type::RANGE) {
 			RangeType range = it_values->toRange();
@@ -81,39 +86,95 @@ void ControlModule::for_eval(AbstractNode &node, const ModuleInstantiation &inst
 			if (steps >= RangeType::MAX_RANGE_STEPS) {
 				LOG(message_group::Warning,inst.location(),ctx->documentPath(),
 					"Bad range parameter in for statement: too many elements (%1$lu)",steps);
+			} else if (parallel && ParallelFor::enabled(steps)) {
+				std::vector<ValuePtr> values;
+				for (double val : range) values.push_back(ValuePtr(val));
+				for_eval_parallel(children, inst, values, evalctx);
 			} else {
 				for (double val : range) {
 					c->set_variable(it_name, ValuePtr(val));
-					for_eval(node, inst, l+1, c.ctx, evalctx);
+					for_eval(children, inst, l+1, c.ctx, evalctx);
 				}
 			}
 		}
 		else if (it_values->type() == Value::Type::VECTOR) {
-			for (size_t i = 0; i < it_values->toVector().size(); ++i) {
-				c->set_variable(it_name, it_values->toVector()[i]);
-				for_eval(node, inst, l+1, c.ctx, evalctx);
+			const auto &vec = it_values->toVector();
+			if (parallel && ParallelFor::enabled(vec.size())) {
+				for_eval_parallel(children, inst, std::vector<ValuePtr>(vec.begin(), vec.end()), evalctx);
+			} else {
+				for (size_t i = 0; i < vec.size(); ++i) {
+					c->set_variable(it_name, vec[i]);
+					for_eval(children, inst, l+1, c.ctx, evalctx);
+				}
 			}
 		}
 		else if (it_values->type() == Value::Type::STRING) {
+			std::vector<ValuePtr> values;
 			utf8_split(it_values->toString(), [&](ValuePtr v) {
-				c->set_variable(it_name, v);
-				for_eval(node, inst, l+1, c.ctx, evalctx);
+				values.push_back(v);
 			});
+			if (parallel && ParallelFor::enabled(values.size())) {
+				for_eval_parallel(children, inst, values, evalctx);
+			} else {
+				for (const auto &v : values) {
+					c->set_variable(it_name, v);
+					for_eval(children, inst, l+1, c.ctx, evalctx);
+				}
+			}
 		}
 		else if (it_values->type() != Value::Type::UNDEFINED) {
 			c->set_variable(it_name, it_values);
-			for_eval(node, inst, l+1, c.ctx, evalctx);
+			for_eval(children, inst, l+1, c.ctx, evalctx);
 		}
 	} else if (l > 0) {
 		// At this point, the for loop variables have been set and we can initialize
 		// the local scope (as they may depend on the for loop variables
 		ContextHandle<Context> c{Context::create<Context>(ctx)};
 		for (const auto &assignment : inst.scope.assignments) {
-			c->set_variable(assignment->getName(), assignment->getExpr()->evaluate(c.ctx));
+			c->set_variable(assignment->getSymbol(), assignment->getExpr()->execute(c.ctx));
 		}
 
 		std::vector<AbstractNode *> instantiatednodes = inst.instantiateChildren(c.ctx);
-		node.children.insert(node.children.end(), instantiatednodes.begin(), instantiatednodes.end());
+		children.insert(children.end(), instantiatednodes.begin(), instantiatednodes.end());
+	}
+}
+
+/*!
+	Instantiates the children for each value of the first loop variable on
+	the thread pool, see ParallelFor. Nodes are numbered as if instantiated
+	serially.
+*/
+void ControlModule::for_eval_parallel(std::vector<AbstractNode *> &children, const ModuleInstantiation &inst,
+									  const std::vector<ValuePtr> &values, const std::shared_ptr<EvalContext> evalctx)
+{
+	const Symbol &it_name = evalctx->getArgSymbol(0);
+	ParallelFor loop(evalctx, values.size());
+	std::vector<std::vector<AbstractNode *>> chunks(loop.numChunks());
+	std::vector<size_t> indices(loop.numChunks());
+
+	const size_t done = loop.run([&](size_t chunk, size_t begin, size_t end) {
+		AbstractNode::IndexScope scope;
+		ContextHandle<Context> c{Context::create<Context>(evalctx)};
+		for (size_t i = begin; i < end; ++i) {
+			c->set_variable(it_name, values[i]);
+			for_eval(chunks[chunk], inst, 1, c.ctx, evalctx);
+		}
+		indices[chunk] = scope.size();
+	});
+
+	for (size_t chunk = 0; chunk < done; ++chunk) {
+		AbstractNode::adopt(chunks[chunk], indices[chunk]);
+		children.insert(children.end(), chunks[chunk].begin(), chunks[chunk].end());
+	}
+	for (size_t chunk = done; chunk < chunks.size(); ++chunk) {
+		for (auto node : chunks[chunk]) delete node;
+	}
+	if (done == loop.numChunks()) return;
+
+	ContextHandle<Context> c{Context::create<Context>(evalctx)};
+	for (size_t i = loop.begin(done); i < values.size(); ++i) {
+		c->set_variable(it_name, values[i]);
+		for_eval(children, inst, 1, c.ctx, evalctx);
 	}
 }
 
@@ -331,12 +392,12 @@ AbstractNode *ControlModule::instantiate(const std::shared_ptr<Context>& ctx, co
 	case Type::FOR:
 		if (Feature::ExperimentalLazyUnion.is_enabled()) node = new ListNode(inst, evalctx);
 		else node = new GroupNode(inst, evalctx);
-		for_eval(*node, *inst, 0, evalctx, evalctx);
+		for_eval(node->children, *inst, 0, evalctx, evalctx);
 		break;
 
 	case Type::INT_FOR:
 		node = new AbstractIntersectionNode(inst, evalctx);
-		for_eval(*node, *inst, 0, evalctx, evalctx);
+		for_eval(node->children, *inst, 0, evalctx, evalctx);
 		break;
 
 	case Type::IF: {
@@ -20,13 +20,19 @@ const std::string &EvalContext::getArgName(size_t i) const
 	return this->eval_arguments[i]->getName();
 }
 
+const Symbol &EvalContext::getArgSymbol(size_t i) const
+{
+	assert(i < this->eval_arguments.size());
+	return this->eval_arguments[i]->getSymbol();
+}
+
 ValuePtr EvalContext::getArgValue(size_t i, const std::shared_ptr<Context> ctx) const
 {
 	assert(i < this->eval_arguments.size());
 	const auto &arg = this->eval_arguments[i];
 	ValuePtr v;
 	if (arg->getExpr()) {
-		v = arg->getExpr()->evaluate(ctx ? ctx : (const_cast<EvalContext *>(this))->get_shared_ptr());
+		v = arg->getExpr()->execute(ctx ? ctx : (const_cast<EvalContext *>(this))->get_shared_ptr());
 	}
 	return v;
 }
@@ -87,14 +93,14 @@ void EvalContext::assignTo(std::shared_ptr<Context> target) const
 {
 	for (const auto &assignment : this->eval_arguments) {
 		ValuePtr v;
-		if (assignment->getExpr()) v = assignment->getExpr()->evaluate(target);
+		if (assignment->getExpr()) v = assignment->getExpr()->execute(target);
 		
 		if (assignment->getName().empty()){
 			LOG(message_group::Warning,this->loc,target->documentPath(),"Assignment without variable name %1$s",v->toEchoString());
-		} else if (target->has_local_variable(assignment->getName())) {
+		} else if (target->has_local_variable(assignment->getSymbol())) {
 			LOG(message_group::Warning,this->loc,target->documentPath(),"Ignoring duplicate variable assignment %1$s = %2$s",assignment->getName(),v->toEchoString());
 		} else {
-			target->set_variable(assignment->getName(), v);
+			target->set_variable(assignment->getSymbol(), v);
 		}
 	}
 }
@@ -135,7 +141,7 @@ std::string EvalContext::dump(const AbstractModule *mod, const ModuleInstantiati
 		if (m) {
 			s << boost::format("  module args:");
 			for(const auto &arg : m->definition_arguments) {
-				s << boost::format("    %s = %s") % arg->getName() % *(variables[arg->getName()]);
+				s << boost::format("    %s = %s") % arg->getName() % *lookup_variable(arg->getName(), true);
 			}
 		}
 	}
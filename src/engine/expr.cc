@@ -25,6 +25,9 @@
  */
 #include "compiler_specific.h"
 #include "expression.h"
+#include "exprcompiler.h"
+#include "FunctionCache.h"
+#include "parallelfor.h"
 #include "value.h"
 #include "evalcontext.h"
 #include <cstdint>
@@ -36,6 +39,7 @@
 #include <forward_list>
 #include "../common/printutils.h"
 #include "stackcheck.h"
+#include "stacksegment.h"
 #include "exceptions.h"
 #include "feature.h"
 #include "../common/printutils.h"
@@ -96,6 +100,19 @@ ValuePtr Expression::checkUndef(ValuePtr&& val, const std::shared_ptr<Context>&
 	return std::move(val);
 }
 
+ValuePtr Expression::execute(const std::shared_ptr<Context>& context) const
+{
+	if (!Feature::ExperimentalBytecode.is_enabled()) return evaluate(context);
+
+	auto program = std::atomic_load(&this->compiled);
+	if (!program) {
+		// Compiling the same expression in two threads at once is harmless
+		program = CompiledExpression::compile(*this);
+		std::atomic_store(&this->compiled, program);
+	}
+	return program->isTrivial() ? evaluate(context) : program->execute(context);
+}
+
 bool Expression::isLiteral() const
 {
     return false;
@@ -365,10 +382,7 @@ ValuePtr Vector::evaluate(const std::shared_ptr<Context>& context) const
 	for(const auto &e : this->children) {
 		ValuePtr tmpval = e->evaluate(context);
 		if (isListComprehension(e)) {
-			const VectorType result = tmpval->toVector();
-			for (size_t i = 0; i < result.size(); ++i) {
-				vec.push_back(result[i]);
-			}
+			vec.extend(tmpval->toVector());
 		} else {
 			vec.push_back(tmpval);
 		}
@@ -386,18 +400,18 @@ void Vector::print(std::ostream &stream, const std::string &) const
 	stream << "]";
 }
 
-Lookup::Lookup(const std::string &name, const Location &loc) : Expression(loc), name(name)
+Lookup::Lookup(const std::string &name, const Location &loc) : Expression(loc), name(name), symbol(name)
 {
 }
 
 ValuePtr Lookup::evaluate(const std::shared_ptr<Context>& context) const
 {
-	return context->lookup_variable(this->name,false,loc);
+	return context->lookup_variable(this->symbol,this->resolved,false,loc);
 }
 
 ValuePtr Lookup::evaluateSilently(const std::shared_ptr<Context>& context) const
 {
-	return context->lookup_variable(this->name,true);
+	return context->lookup_variable(this->symbol,this->resolved,true);
 }
 
 void Lookup::print(std::ostream &stream, const std::string &) const
@@ -514,7 +528,7 @@ void FunctionCall::prepareTailCallContext(const std::shared_ptr<Context> context
 		// Assign default values for unspecified parameters
 		for (const auto &arg : definition_arguments) {
 			if (this->resolvedArguments.find(arg->getName()) == this->resolvedArguments.end()) {
-				this->defaultArguments.emplace_back(arg->getName(), arg->getExpr() ? arg->getExpr()->evaluate(context) : ValuePtr::undefined);
+				this->defaultArguments.emplace_back(arg->getName(), arg->getExpr() ? arg->getExpr()->execute(context) : ValuePtr::undefined);
 			}
 		}
 	}
@@ -525,7 +539,7 @@ void FunctionCall::prepareTailCallContext(const std::shared_ptr<Context> context
 	variables.insert(variables.begin(), this->defaultArguments.begin(), this->defaultArguments.end());
 	// Set the given parameters
 	for (const auto &ass : this->resolvedArguments) {
-		variables.emplace_back(ass.first, ass.second->evaluate(context));
+		variables.emplace_back(ass.first, ass.second->execute(context));
 	}
 	// Apply to tailCallContext
 	for (const auto &var : variables) {
@@ -552,6 +566,12 @@ ValuePtr FunctionCall::evaluate(const std::shared_ptr<Context>& context) const
 				return ValuePtr::undefined;
 			} else {
 				auto func = v->toFunction();
+				// Function values may be closures over anything
+				FunctionCache::markImpure();
+				if (StackSegment::needed()) {
+					ValuePtr result;
+					if (StackSegment::run([&]() { result = evaluate_function(name, func.getExpr(), func.getArgs(), func.getCtx(), evalCtx.ctx, this->loc); })) return result;
+				}
 				return evaluate_function(name, func.getExpr(), func.getArgs(), func.getCtx(), evalCtx.ctx, this->loc);
 			}
 		} else if (isLookup) {
@@ -720,10 +740,7 @@ ValuePtr LcEach::evaluate(const std::shared_ptr<Context>& context) const
             }
         }
     } else if (v->type() == Value::Type::VECTOR) {
-        VectorType vector = v->toVector();
-        for (size_t i = 0; i < v->toVector().size(); ++i) {
-            vec.push_back(vector[i]);
-        }
+        vec.extend(v->toVector());
     } else if (v->type() == Value::Type::STRING) {
         utf8_split(v->toString(), [&](ValuePtr v) {
             vec.push_back(v);
@@ -758,35 +775,59 @@ ValuePtr LcFor::evaluate(const std::shared_ptr<Context>& context) const
     ContextHandle<Context> assign_context{Context::create<Context>(context)};
 
     // comprehension for statements are by the parser reduced to only contain one single element
-    const std::string &it_name = for_context->getArgName(0);
+    const Symbol &it_name = for_context->getArgSymbol(0);
     ValuePtr it_values = for_context->getArgValue(0, assign_context.ctx);
 
     ContextHandle<Context> c{Context::create<Context>(context)};
 
+    // Loop invariants are evaluated before the first iteration, if there is one
+    const Expression *body = nullptr;
+    auto evaluate_body = [&]() {
+        if (!body) body = this->hoisted && bindInvariants(context, c.ctx) ? this->hoisted.get() : this->expr.get();
+        return body->execute(c.ctx);
+    };
+
     if (it_values->type() == Value::Type::RANGE) {
         RangeType range = it_values->toRange();
         uint32_t steps = range.numValues();
         if (steps >= 1000000) {
            LOG(message_group::Warning,loc,context->documentPath(),"Bad range parameter in for statement: too many elements (%1$lu)",steps);
+        } else if (ParallelFor::enabled(steps)) {
+            std::vector<ValuePtr> values;
+            for (double val : range) values.push_back(ValuePtr(val));
+            evaluateParallel(context, it_name, values, vec);
         } else {
             for (double val : range) {
                 c->set_variable(it_name, ValuePtr(val));
-                vec.push_back(this->expr->evaluate(c.ctx));
+                vec.push_back(evaluate_body());
             }
         }
     } else if (it_values->type() == Value::Type::VECTOR) {
-        for (size_t i = 0; i < it_values->toVector().size(); ++i) {
-            c->set_variable(it_name, it_values->toVector()[i]);
-            vec.push_back(this->expr->evaluate(c.ctx));
+        const auto &values = it_values->toVector();
+        if (ParallelFor::enabled(values.size())) {
+            evaluateParallel(context, it_name, std::vector<ValuePtr>(values.begin(), values.end()), vec);
+        } else {
+            for (size_t i = 0; i < values.size(); ++i) {
+                c->set_variable(it_name, values[i]);
+                vec.push_back(evaluate_body());
+            }
         }
     } else if (it_values->type() == Value::Type::STRING) {
+        std::vector<ValuePtr> values;
         utf8_split(it_values->toString(), [&](ValuePtr v) {
-            c->set_variable(it_name, v);
-            vec.push_back(this->expr->evaluate(c.ctx));
+            values.push_back(v);
         });
+        if (ParallelFor::enabled(values.size())) {
+            evaluateParallel(context, it_name, values, vec);
+        } else {
+            for (const auto &v : values) {
+                c->set_variable(it_name, v);
+                vec.push_back(evaluate_body());
+            }
+        }
     } else if (it_values->type() != Value::Type::UNDEFINED) {
         c->set_variable(it_name, it_values);
-        vec.push_back(this->expr->evaluate(c.ctx));
+        vec.push_back(evaluate_body());
     }
 
     if (isListComprehension(this->expr)) {
@@ -796,9 +837,66 @@ ValuePtr LcFor::evaluate(const std::shared_ptr<Context>& context) const
     }
 }
 
+/*!
+	Evaluates the body for each of the values on the thread pool, see
+	ParallelFor. Loop invariants are evaluated once, before starting.
+*/
+void LcFor::evaluateParallel(const std::shared_ptr<Context>& context, const Symbol &it_name, const std::vector<ValuePtr> &values, VectorType &vec) const
+{
+    ContextHandle<Context> invariants{Context::create<Context>(context)};
+    const bool hoist = this->hoisted && bindInvariants(context, invariants.ctx);
+    const Expression *body = hoist ? this->hoisted.get() : this->expr.get();
+    const auto &parent = hoist ? invariants.ctx : context;
+
+    ParallelFor loop(context, values.size());
+    std::vector<std::vector<ValuePtr>> chunks(loop.numChunks());
+    const size_t done = loop.run([&](size_t chunk, size_t begin, size_t end) {
+        ContextHandle<Context> c{Context::create<Context>(parent)};
+        for (size_t i = begin; i < end; ++i) {
+            c->set_variable(it_name, values[i]);
+            chunks[chunk].push_back(body->execute(c.ctx));
+        }
+    });
+
+    for (size_t chunk = 0; chunk < done; ++chunk) {
+        for (const auto &v : chunks[chunk]) vec.push_back(v);
+    }
+    if (done == loop.numChunks()) return;
+
+    ContextHandle<Context> c{Context::create<Context>(parent)};
+    for (size_t i = loop.begin(done); i < values.size(); ++i) {
+        c->set_variable(it_name, values[i]);
+        vec.push_back(body->execute(c.ctx));
+    }
+}
+
+/*!
+	Evaluates the hoisted loop invariants into the loop context c. Returns
+	false if any of them fails or prints a message, in which case the loop
+	uses the original body, so messages are the same as without hoisting.
+*/
+bool LcFor::bindInvariants(const std::shared_ptr<Context>& context, const std::shared_ptr<Context>& c) const
+{
+	std::vector<Message> messages;
+	MessageCapture capture(messages);
+	try {
+		for (const auto &invariant : this->invariants) {
+			c->set_variable(invariant->getSymbol(), invariant->getExpr()->execute(context));
+		}
+	} catch (const EvaluationException &) {
+		return false;
+	}
+	return messages.empty();
+}
+
 void LcFor::print(std::ostream &stream, const std::string &) const
 {
-    stream << "for(" << this->arguments << ") (" << *this->expr << ")";
+    if (this->hoisted) {
+        stream << "let(" << this->invariants << ") (for(" << this->arguments << ") (" << *this->hoisted << "))";
+    }
+    else {
+        stream << "for(" << this->arguments << ") (" << *this->expr << ")";
+    }
 }
 
 LcForC::LcForC(const AssignmentList &args, const AssignmentList &incrargs, Expression *cond, Expression *expr, const Location &loc)
@@ -815,7 +913,7 @@ ValuePtr LcForC::evaluate(const std::shared_ptr<Context>& context) const
 
 	unsigned int counter = 0;
     while (this->cond->evaluate(c.ctx)) {
-        vec.push_back(this->expr->evaluate(c.ctx));
+        vec.push_back(this->expr->execute(c.ctx));
 
         if (counter++ == 1000000) {
 			LOG(message_group::Error,loc,context->documentPath(),"For loop counter exceeded limit");
@@ -897,7 +995,12 @@ ValuePtr evaluate_function(const std::string& name, const std::shared_ptr<Expres
 	if (!expr) return ValuePtr::undefined;
 	ContextHandle<Context> c_next{Context::create<Context>(ctx)}; // Context for next tail call
 	c_next->setVariables(evalctx, definition_arguments);
+	return evaluate_function_body(name, expr, definition_arguments, c_next.ctx, loc);
+}
 
+ValuePtr evaluate_function_body(const std::string& name, const std::shared_ptr<Expression>& expr, const AssignmentList &definition_arguments,
+		const std::shared_ptr<Context>& c_next, const Location& loc)
+{
 	// Outer loop: to allow tail calls
 	unsigned int counter = 0;
 	while (true) {
@@ -905,7 +1008,7 @@ ValuePtr evaluate_function(const std::string& name, const std::shared_ptr<Expres
 		// I.e. "let(x=33) let(x=42) x" should evaluate to 42.
 		// Cannot use std::vector, as it invalidates raw pointers.
 		std::forward_list<ContextHandle<Context>> c_local_stack;
-		c_local_stack.emplace_front(std::shared_ptr<Context>(new Context(c_next.ctx)));
+		c_local_stack.emplace_front(std::shared_ptr<Context>(new Context(c_next)));
 		std::shared_ptr<Context> c_local = c_local_stack.front().ctx;
 
 		// Inner loop: to follow a single execution path
@@ -940,21 +1043,21 @@ ValuePtr evaluate_function(const std::string& name, const std::shared_ptr<Expres
 					const shared_ptr<FunctionCall> &call = static_pointer_cast<FunctionCall>(subExpr);
 					if (name == call->get_name()) {
 						// Update c_next with new parameters for tail call
-						call->prepareTailCallContext(c_local, c_next.ctx, definition_arguments);
+						call->prepareTailCallContext(c_local, c_next, definition_arguments);
 						break;
 					}
 					else {
-						return subExpr->evaluate(c_local);
+						return subExpr->execute(c_local);
 					}
 				}
 				else {
-					return subExpr->evaluate(c_local);
+					return subExpr->execute(c_local);
 				}
 			}
 		}
 
 		if (counter++ == 1000000){
-			LOG(message_group::Error,loc,ctx->documentPath(),"Recursion detected calling function '%1$s'",name);
+			LOG(message_group::Error,loc,c_next->documentPath(),"Recursion detected calling function '%1$s'",name);
 			throw RecursionException::create("function", name,loc);
 		}
 	}
@@ -0,0 +1,267 @@
+#include "exprcompiler.h"
+#include "expression.h"
+#include "context.h"
+#include "exceptions.h"
+#include <cassert>
+#include <typeinfo>
+
+namespace {
+	// Member lookups on ranges are flagged, so .x isn't valid on a range and vice versa
+	const uint32_t MEMBER_RANGE = 0x10;
+	const uint32_t MEMBER_NONE = 0xff;
+
+	uint32_t member_index(const std::string &member)
+	{
+		if (member == "x") return 0;
+		if (member == "y") return 1;
+		if (member == "z") return 2;
+		if (member == "begin") return MEMBER_RANGE | 0;
+		if (member == "step") return MEMBER_RANGE | 1;
+		if (member == "end") return MEMBER_RANGE | 2;
+		return MEMBER_NONE;
+	}
+}
+
+/*!
+	Emits code for an expression tree into a CompiledExpression.
+	This is a friend of the Expression subclasses it knows how to compile.
+*/
+class ExpressionCompiler
+{
+public:
+	typedef CompiledExpression::OpCode OpCode;
+
+	ExpressionCompiler(CompiledExpression &program) : program(program) {}
+
+	void compile(const Expression &expr)
+	{
+		const auto &type = typeid(expr);
+		if (type == typeid(Literal)) {
+			const auto &literal = static_cast<const Literal &>(expr);
+			emit(OpCode::Constant, &expr, this->program.constants.size());
+			this->program.constants.push_back(literal.value);
+		}
+		else if (type == typeid(Lookup)) {
+			emit(OpCode::Lookup, &expr);
+		}
+		else if (type == typeid(UnaryOp)) {
+			const auto &unary = static_cast<const UnaryOp &>(expr);
+			compile(*unary.expr);
+			emit(unary.op == UnaryOp::Op::Not ? OpCode::Not : OpCode::Negate, &expr);
+		}
+		else if (type == typeid(BinaryOp)) {
+			compileBinary(static_cast<const BinaryOp &>(expr));
+		}
+		else if (type == typeid(TernaryOp)) {
+			const auto &ternary = static_cast<const TernaryOp &>(expr);
+			compile(*ternary.cond);
+			const size_t jumpelse = emit(OpCode::JumpIfFalse, &expr);
+			compile(*ternary.ifexpr);
+			const size_t jumpend = emit(OpCode::Jump, &expr);
+			patch(jumpelse);
+			compile(*ternary.elseexpr);
+			patch(jumpend);
+		}
+		else if (type == typeid(ArrayLookup)) {
+			const auto &lookup = static_cast<const ArrayLookup &>(expr);
+			compile(*lookup.array);
+			compile(*lookup.index);
+			emit(OpCode::Index, &expr);
+		}
+		else if (type == typeid(MemberLookup)) {
+			const auto &lookup = static_cast<const MemberLookup &>(expr);
+			compile(*lookup.expr);
+			emit(OpCode::Member, &expr, member_index(lookup.member));
+		}
+		else if (type == typeid(Vector)) {
+			const auto &vector = static_cast<const Vector &>(expr);
+			emit(OpCode::BeginVector, &expr);
+			for (const auto &child : vector.children) {
+				compile(*child);
+				const bool lc = dynamic_cast<const ListComprehension *>(child.get());
+				emit(lc ? OpCode::Extend : OpCode::Append, child.get());
+			}
+			emit(OpCode::EndVector, &expr);
+		}
+		else {
+			// Function calls, let(), echo(), list comprehensions, ranges etc.
+			emit(OpCode::Evaluate, &expr);
+		}
+	}
+
+private:
+	void compileBinary(const BinaryOp &binary)
+	{
+		if (binary.op == BinaryOp::Op::LogicalAnd || binary.op == BinaryOp::Op::LogicalOr) {
+			// Short-circuit: the right operand is only evaluated if needed
+			compile(*binary.left);
+			const size_t jump = emit(binary.op == BinaryOp::Op::LogicalAnd ? OpCode::And : OpCode::Or, &binary);
+			compile(*binary.right);
+			emit(OpCode::ToBool, &binary);
+			patch(jump);
+			return;
+		}
+
+		compile(*binary.left);
+		compile(*binary.right);
+		OpCode op;
+		switch (binary.op) {
+		case BinaryOp::Op::Exponent:     op = OpCode::Exponent; break;
+		case BinaryOp::Op::Multiply:     op = OpCode::Multiply; break;
+		case BinaryOp::Op::Divide:       op = OpCode::Divide; break;
+		case BinaryOp::Op::Modulo:       op = OpCode::Modulo; break;
+		case BinaryOp::Op::Plus:         op = OpCode::Plus; break;
+		case BinaryOp::Op::Minus:        op = OpCode::Minus; break;
+		case BinaryOp::Op::Less:         op = OpCode::Less; break;
+		case BinaryOp::Op::LessEqual:    op = OpCode::LessEqual; break;
+		case BinaryOp::Op::Greater:      op = OpCode::Greater; break;
+		case BinaryOp::Op::GreaterEqual: op = OpCode::GreaterEqual; break;
+		case BinaryOp::Op::Equal:        op = OpCode::Equal; break;
+		case BinaryOp::Op::NotEqual:     op = OpCode::NotEqual; break;
+		default:
+			assert(false && "Non-existent binary operator!");
+			throw EvaluationException("Non-existent binary operator!");
+		}
+		emit(op, &binary);
+	}
+
+	size_t emit(OpCode op, const Expression *node, uint32_t arg = 0)
+	{
+		this->program.code.push_back({op, arg, node});
+		return this->program.code.size() - 1;
+	}
+
+	// Makes the given jump instruction jump to the next instruction emitted
+	void patch(size_t jump)
+	{
+		this->program.code[jump].arg = this->program.code.size();
+	}
+
+	CompiledExpression &program;
+};
+
+shared_ptr<const CompiledExpression> CompiledExpression::compile(const Expression &expr)
+{
+	auto program = make_shared<CompiledExpression>();
+	ExpressionCompiler(*program).compile(expr);
+	return program;
+}
+
+ValuePtr CompiledExpression::execute(const std::shared_ptr<Context> &context) const
+{
+	std::vector<ValuePtr> stack;
+	// Vectors under construction, innermost last
+	std::vector<VectorType> vectors;
+	stack.reserve(8);
+
+	const size_t size = this->code.size();
+	size_t pc = 0;
+	while (pc < size) {
+		const Instruction &instr = this->code[pc++];
+		switch (instr.op) {
+		case OpCode::Constant:
+			stack.push_back(this->constants[instr.arg]);
+			break;
+		case OpCode::Lookup: {
+			stack.push_back(static_cast<const Lookup *>(instr.node)->Lookup::evaluate(context));
+			break;
+		}
+		case OpCode::Evaluate:
+			stack.push_back(instr.node->evaluate(context));
+			break;
+		case OpCode::Not:
+			stack.back() = !stack.back();
+			break;
+		case OpCode::Negate:
+			stack.back() = instr.node->checkUndef(-stack.back(), context);
+			break;
+
+#define BINARY_OP(opcode, oper)                                           \
+		case OpCode::opcode: {                                                \
+			ValuePtr right = std::move(stack.back());                           \
+			stack.pop_back();                                                   \
+			stack.back() = instr.node->checkUndef(stack.back() oper right, context); \
+			break;                                                              \
+		}
+		BINARY_OP(Exponent, ^)
+		BINARY_OP(Multiply, *)
+		BINARY_OP(Divide, /)
+		BINARY_OP(Modulo, %)
+		BINARY_OP(Plus, +)
+		BINARY_OP(Minus, -)
+		BINARY_OP(Less, <)
+		BINARY_OP(LessEqual, <=)
+		BINARY_OP(Greater, >)
+		BINARY_OP(GreaterEqual, >=)
+		BINARY_OP(Equal, ==)
+		BINARY_OP(NotEqual, !=)
+#undef BINARY_OP
+
+		case OpCode::Index: {
+			ValuePtr index = std::move(stack.back());
+			stack.pop_back();
+			stack.back() = stack.back()[index];
+			break;
+		}
+		case OpCode::Member: {
+			const ValuePtr &v = stack.back();
+			const bool range = instr.arg & MEMBER_RANGE;
+			const auto wanted = range ? Value::Type::RANGE : Value::Type::VECTOR;
+			if (instr.arg != MEMBER_NONE && v->type() == wanted) {
+				stack.back() = v[ValuePtr(int(instr.arg & ~MEMBER_RANGE))];
+			}
+			else {
+				stack.back() = ValuePtr::undefined;
+			}
+			break;
+		}
+		case OpCode::And:
+			if (!bool(stack.back())) {
+				stack.back() = ValuePtr(false);
+				pc = instr.arg;
+			}
+			else {
+				stack.pop_back();
+			}
+			break;
+		case OpCode::Or:
+			if (bool(stack.back())) {
+				stack.back() = ValuePtr(true);
+				pc = instr.arg;
+			}
+			else {
+				stack.pop_back();
+			}
+			break;
+		case OpCode::ToBool:
+			stack.back() = ValuePtr(bool(stack.back()));
+			break;
+		case OpCode::Jump:
+			pc = instr.arg;
+			break;
+		case OpCode::JumpIfFalse: {
+			const bool cond = stack.back();
+			stack.pop_back();
+			if (!cond) pc = instr.arg;
+			break;
+		}
+		case OpCode::BeginVector:
+			vectors.emplace_back();
+			break;
+		case OpCode::Append:
+			vectors.back().push_back(std::move(stack.back()));
+			stack.pop_back();
+			break;
+		case OpCode::Extend:
+			vectors.back().extend(stack.back()->toVector());
+			stack.pop_back();
+			break;
+		case OpCode::EndVector:
+			stack.push_back(ValuePtr(vectors.back()));
+			vectors.pop_back();
+			break;
+		}
+	}
+	assert(stack.size() == 1 && vectors.empty());
+	return stack.back();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "value.h"
+#include "memory.h"
+
+class Context;
+class Expression;
+
+/*!
+	Stack machine code compiled from an Expression tree.
+
+	Operators, literals, variable lookups, conditionals and vectors are
+	flattened into a linear instruction sequence, so evaluating them needs
+	neither virtual calls nor recursion. Everything else (function calls,
+	let(), list comprehensions, ...) becomes a single instruction evaluating
+	that subtree with the tree-walking interpreter, which in turn compiles
+	its own subexpressions as they get evaluated.
+
+	Results and warnings are the same as for Expression::evaluate().
+*/
+class CompiledExpression
+{
+public:
+	static shared_ptr<const CompiledExpression> compile(const Expression &expr);
+
+	ValuePtr execute(const std::shared_ptr<Context> &context) const;
+	// True if execute() would not save anything over Expression::evaluate()
+	bool isTrivial() const { return this->code.size() <= 1; }
+
+private:
+	enum class OpCode : uint8_t {
+		Constant,
+		Lookup,
+		Evaluate,
+		Not,
+		Negate,
+		Exponent,
+		Multiply,
+		Divide,
+		Modulo,
+		Plus,
+		Minus,
+		Less,
+		LessEqual,
+		Greater,
+		GreaterEqual,
+		Equal,
+		NotEqual,
+		Index,
+		Member,
+		And,
+		Or,
+		ToBool,
+		Jump,
+		JumpIfFalse,
+		BeginVector,
+		Append,
+		Extend,
+		EndVector
+	};
+
+	struct Instruction {
+		OpCode op;
+		// Constant index, jump target or member index, depending on op
+		uint32_t arg;
+		// Source node, for locations in warnings and for Lookup and Evaluate
+		const Expression *node;
+	};
+
+	std::vector<Instruction> code;
+	std::vector<ValuePtr> constants;
+
+	friend class ExpressionCompiler;
+};
@@ -13,7 +13,12 @@ public:
 	~Expression() {}
 	virtual bool isLiteral() const;
 	virtual ValuePtr evaluate(const std::shared_ptr<Context>& context) const = 0;
+	// Evaluates using the bytecode interpreter if the "bytecode" feature is enabled
+	ValuePtr execute(const std::shared_ptr<Context>& context) const;
 	ValuePtr checkUndef(ValuePtr&& val, const std::shared_ptr<Context>& context) const;
+private:
+	// Compiled lazily on first execute()
+	mutable shared_ptr<const class CompiledExpression> compiled;
 };
 
 class UnaryOp : public Expression
@@ -29,6 +34,10 @@ public:
 	void print(std::ostream &stream, const std::string &indent) const override;
 
 private:
+	friend class ExpressionCompiler;
+	friend class PurityChecker;
+	friend class ASTOptimizer;
+
 	const char *opString() const;
 
 	Op op;
@@ -60,6 +69,10 @@ public:
 	void print(std::ostream &stream, const std::string &indent) const override;
 
 private:
+	friend class ExpressionCompiler;
+	friend class PurityChecker;
+	friend class ASTOptimizer;
+
 	const char *opString() const;
 
 	Op op;
@@ -75,6 +88,10 @@ public:
 	ValuePtr evaluate(const std::shared_ptr<Context>& context) const override;
 	void print(std::ostream &stream, const std::string &indent) const override;
 private:
+	friend class ExpressionCompiler;
+	friend class PurityChecker;
+	friend class ASTOptimizer;
+
 	shared_ptr<Expression> cond;
 	shared_ptr<Expression> ifexpr;
 	shared_ptr<Expression> elseexpr;
@@ -87,6 +104,10 @@ public:
 	ValuePtr evaluate(const std::shared_ptr<Context>& context) const override;
 	void print(std::ostream &stream, const std::string &indent) const override;
 private:
+	friend class ExpressionCompiler;
+	friend class PurityChecker;
+	friend class ASTOptimizer;
+
 	shared_ptr<Expression> array;
 	shared_ptr<Expression> index;
 };
@@ -99,6 +120,9 @@ public:
 	void print(std::ostream &stream, const std::string &indent) const override;
 	bool isLiteral() const override { return true;}
 private:
+	friend class ExpressionCompiler;
+	friend class ASTOptimizer;
+
 	ValuePtr value;
 };
 
@@ -111,6 +135,9 @@ public:
 	void print(std::ostream &stream, const std::string &indent) const override;
 	bool isLiteral() const override;
 private:
+	friend class PurityChecker;
+	friend class ASTOptimizer;
+
 	shared_ptr<Expression> begin;
 	shared_ptr<Expression> step;
 	shared_ptr<Expression> end;
@@ -125,6 +152,10 @@ public:
 	void emplace_back(Expression *expr);
 	bool isLiteral() const override;
 private:
+	friend class ExpressionCompiler;
+	friend class PurityChecker;
+	friend class ASTOptimizer;
+
 	std::vector<shared_ptr<Expression>> children;
 };
 
@@ -137,7 +168,12 @@ public:
 	void print(std::ostream &stream, const std::string &indent) const override;
 	const std::string& get_name() const { return name; }
 private:
+	friend class PurityChecker;
+	friend class ASTOptimizer;
+
 	std::string name;
+	Symbol symbol;
+	mutable ResolvedSlot resolved;
 };
 
 class MemberLookup : public Expression
@@ -147,6 +183,10 @@ public:
 	ValuePtr evaluate(const std::shared_ptr<Context>& context) const override;
 	void print(std::ostream &stream, const std::string &indent) const override;
 private:
+	friend class ExpressionCompiler;
+	friend class PurityChecker;
+	friend class ASTOptimizer;
+
 	shared_ptr<Expression> expr;
 	std::string member;
 };
@@ -190,6 +230,8 @@ public:
 	ValuePtr evaluate(const std::shared_ptr<Context>& context) const override;
 	void print(std::ostream &stream, const std::string &indent) const override;
 private:
+	friend class ASTOptimizer;
+
 	AssignmentList arguments;
 	shared_ptr<Expression> expr;
 };
@@ -202,6 +244,8 @@ public:
 	ValuePtr evaluate(const std::shared_ptr<Context>& context) const override;
 	void print(std::ostream &stream, const std::string &indent) const override;
 private:
+	friend class ASTOptimizer;
+
 	AssignmentList arguments;
 	shared_ptr<Expression> expr;
 };
@@ -214,6 +258,9 @@ public:
 	ValuePtr evaluate(const std::shared_ptr<Context>& context) const override;
 	void print(std::ostream &stream, const std::string &indent) const override;
 private:
+	friend class PurityChecker;
+	friend class ASTOptimizer;
+
 	AssignmentList arguments;
 	shared_ptr<Expression> expr;
 };
@@ -232,6 +279,9 @@ public:
 	ValuePtr evaluate(const std::shared_ptr<Context>& context) const override;
 	void print(std::ostream &stream, const std::string &indent) const override;
 private:
+	friend class PurityChecker;
+	friend class ASTOptimizer;
+
 	shared_ptr<Expression> cond;
 	shared_ptr<Expression> ifexpr;
 	shared_ptr<Expression> elseexpr;
@@ -244,8 +294,18 @@ public:
 	ValuePtr evaluate(const std::shared_ptr<Context>& context) const override;
 	void print(std::ostream &stream, const std::string &indent) const override;
 private:
+	friend class PurityChecker;
+	friend class ASTOptimizer;
+
+	bool bindInvariants(const std::shared_ptr<Context>& context, const std::shared_ptr<Context>& c) const;
+	void evaluateParallel(const std::shared_ptr<Context>& context, const Symbol &it_name, const std::vector<ValuePtr> &values, VectorType &vec) const;
+
 	AssignmentList arguments;
 	shared_ptr<Expression> expr;
+	// Set by the ASTOptimizer: the subexpressions of expr which don't depend
+	// on the loop, and a copy of expr referring to them by name instead
+	AssignmentList invariants;
+	shared_ptr<Expression> hoisted;
 };
 
 class LcForC : public ListComprehension
@@ -255,6 +315,9 @@ public:
 	ValuePtr evaluate(const std::shared_ptr<Context>& context) const override;
 	void print(std::ostream &stream, const std::string &indent) const override;
 private:
+	friend class PurityChecker;
+	friend class ASTOptimizer;
+
 	AssignmentList arguments;
 	AssignmentList incr_arguments;
 	shared_ptr<Expression> cond;
@@ -268,6 +331,9 @@ public:
 	ValuePtr evaluate(const std::shared_ptr<Context>& context) const override;
 	void print(std::ostream &stream, const std::string &indent) const override;
 private:
+	friend class PurityChecker;
+	friend class ASTOptimizer;
+
 	shared_ptr<Expression> expr;
 };
 
@@ -278,6 +344,9 @@ public:
 	ValuePtr evaluate(const std::shared_ptr<Context>& context) const override;
 	void print(std::ostream &stream, const std::string &indent) const override;
 private:
+	friend class PurityChecker;
+	friend class ASTOptimizer;
+
 	AssignmentList arguments;
 	shared_ptr<Expression> expr;
 };
@@ -288,3 +357,7 @@ ValuePtr evaluate_function(const std::string& name,
 		const std::shared_ptr<Expression>& expr, const AssignmentList &definition_arguments,
 		const std::shared_ptr<Context>& ctx, const std::shared_ptr<EvalContext>& evalctx,
 		const Location& loc);
+// Like evaluate_function(), with the parameters already set in c_next
+ValuePtr evaluate_function_body(const std::string& name,
+		const std::shared_ptr<Expression>& expr, const AssignmentList &definition_arguments,
+		const std::shared_ptr<Context>& c_next, const Location& loc);
@@ -24,6 +24,14 @@ Feature::list_t Feature::feature_list;
 const Feature Feature::ExperimentalInputDriverDBus("input-driver-dbus", "Enable DBus input drivers (requires restart)");
 const Feature Feature::ExperimentalFunctionLiterals("function-literals", "Enable support for function literals");
 const Feature Feature::ExperimentalLazyUnion("lazy-union", "Enable lazy unions.");
+const Feature Feature::ExperimentalDisjointUnion("disjoint-union", "Enable combining non-overlapping objects in 3D unions without CGAL.");
+const Feature Feature::ExperimentalCorefinement("corefinement", "Enable corefinement of closed triangle meshes for 3D booleans, falling back to Nef polyhedra for other objects.");
+const Feature Feature::ExperimentalBytecode("bytecode", "Enable compiling expressions to bytecode instead of evaluating the syntax tree.");
+const Feature Feature::ExperimentalMemoize("memoize", "Enable caching the results of functions which only depend on their arguments.");
+const Feature Feature::ExperimentalAstOptimizer("ast-optimizer", "Enable simplifying the syntax tree before evaluation, e.g. folding constant expressions.");
+const Feature Feature::ExperimentalParallelFor("parallel-for", "Enable evaluating the iterations of for() loops on the render threads.");
+const Feature Feature::ExperimentalImportCache("import-cache", "Enable keeping a copy of each imported 3D mesh in a .scadmesh file next to it, which is read instead while the file is unchanged.");
+const Feature Feature::Experimental3mfInstances("3mf-instances", "Enable writing top-level objects which only differ in their transformation once in 3MF files, placed by build items. Requires lazy-union.");
 const Feature Feature::ExperimentalMouseSelection("mouse-selection", "Enable mouse selector");
 
 Feature::Feature(const std::string &name, const std::string &description)
@@ -17,6 +17,14 @@ public:
 	static const Feature ExperimentalInputDriverDBus;
 	static const Feature ExperimentalFunctionLiterals;
 	static const Feature ExperimentalLazyUnion;
+	static const Feature ExperimentalDisjointUnion;
+	static const Feature ExperimentalCorefinement;
+	static const Feature ExperimentalBytecode;
+	static const Feature ExperimentalMemoize;
+	static const Feature ExperimentalAstOptimizer;
+	static const Feature ExperimentalParallelFor;
+	static const Feature ExperimentalImportCache;
+	static const Feature Experimental3mfInstances;
 	static const Feature ExperimentalMouseSelection;
 
 	const std::string& get_name() const;
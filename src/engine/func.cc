@@ -33,6 +33,8 @@
 #include "exceptions.h"
 #include "../common/memory.h"
 #include "UserModule.h"
+#include "parallelfor.h"
+#include "TableIndex.h"
 #include "math/degree_trig.h"
 
 #include <cmath>
@@ -101,6 +103,8 @@ ValuePtr builtin_sign(const std::shared_ptr<Context> ctx, const std::shared_ptr<
 
 ValuePtr builtin_rands(const std::shared_ptr<Context> ctx, const std::shared_ptr<EvalContext> evalctx)
 {
+	// The random number generator is shared, so the order of calls matters
+	ParallelFor::checkSafe();
 	size_t n = evalctx->numArgs();
 	if (n == 3 || n == 4) {
 		ValuePtr v0 = evalctx->getArgValue(0);
@@ -541,9 +545,7 @@ ValuePtr builtin_concat(const std::shared_ptr<Context>, const std::shared_ptr<Ev
 	for (size_t i = 0; i < evalctx->numArgs(); ++i) {
 		ValuePtr val = evalctx->getArgValue(i);
 		if (val->type() == Value::Type::VECTOR) {
-			for(const auto &v : val->toVector()) { 
-				result.push_back(v);
-			}
+			result.extend(val->toVector());
 		} else {
 			result.push_back(val);
 		}
@@ -570,6 +572,7 @@ ValuePtr builtin_lookup(const std::shared_ptr<Context> ctx, const std::shared_pt
 
 	if (!vec[0]->getVec2(low_p, low_v) || !vec[0]->getVec2(high_p, high_v))
 		return ValuePtr::undefined;
+	if (auto index = TableIndex::lookup(vec)) return ValuePtr(index->lookup(p));
 	for (size_t i = 1; i < vec.size(); ++i) {
 		double this_p, this_v;
 		if (vec[i]->getVec2(this_p, this_v)) {
@@ -736,10 +739,21 @@ ValuePtr builtin_search(const std::shared_ptr<Context> ctx, const std::shared_pt
 
 	VectorType returnvec;
 
+	// Only rows with a key hashing like the value can match
+	std::shared_ptr<const SearchIndex> index;
+	if (findThis->type() == Value::Type::NUMBER || findThis->type() == Value::Type::VECTOR) {
+		index = TableIndex::search(searchTable->toVector(), index_col_num);
+	}
+	const std::vector<uint32_t> no_candidates;
+	auto candidates = [&](const ValuePtr &value) -> const std::vector<uint32_t> & {
+		auto rows = index->candidates(*value);
+		return rows ? *rows : no_candidates;
+	};
+
 	if (findThis->type() == Value::Type::NUMBER) {
 		unsigned int matchCount = 0;
 
-		for (size_t j = 0; j < searchTable->toVector().size(); ++j) {
+		auto matches = [&](size_t j) {
 			const ValuePtr &search_element = searchTable->toVector()[j];
 
 			if ((index_col_num == 0 && findThis == search_element) ||
@@ -747,8 +761,14 @@ ValuePtr builtin_search(const std::shared_ptr<Context> ctx, const std::shared_pt
 					 findThis      == search_element->toVector()[index_col_num])) {
 				returnvec.push_back(ValuePtr(double(j)));
 				matchCount++;
-				if (num_returns_per_match != 0 && matchCount >= num_returns_per_match) break;
+				if (num_returns_per_match != 0 && matchCount >= num_returns_per_match) return false;
 			}
+			return true;
+		};
+		if (index) {
+			for (auto j : candidates(findThis)) if (!matches(j)) break;
+		} else {
+			for (size_t j = 0; j < searchTable->toVector().size(); ++j) if (!matches(j)) break;
 		}
 	} else if (findThis->type() == Value::Type::STRING) {
 		if (searchTable->type() == Value::Type::STRING) {
@@ -764,7 +784,7 @@ ValuePtr builtin_search(const std::shared_ptr<Context> ctx, const std::shared_pt
 
 			const ValuePtr &find_value = findThis->toVector()[i];
 
-			for (size_t j = 0; j < searchTable->toVector().size(); ++j) {
+			auto matches = [&](size_t j) {
 
 				const ValuePtr &search_element = searchTable->toVector()[j];
 
@@ -775,13 +795,19 @@ ValuePtr builtin_search(const std::shared_ptr<Context> ctx, const std::shared_pt
 		      matchCount++;
 		      if (num_returns_per_match == 1) {
 						returnvec.push_back(resultValue);
-						break;
+						return false;
 		      } else {
 						resultvec.push_back(resultValue);
 		      }
-		      if (num_returns_per_match > 1 && matchCount >= num_returns_per_match) break;
+		      if (num_returns_per_match > 1 && matchCount >= num_returns_per_match) return false;
 		    }
-		  }
+				return true;
+		  };
+			if (index) {
+				for (auto j : candidates(find_value)) if (!matches(j)) break;
+			} else {
+				for (size_t j = 0; j < searchTable->toVector().size(); ++j) if (!matches(j)) break;
+			}
 		  if (num_returns_per_match == 1 && matchCount == 0) {
 		    returnvec.push_back(ValuePtr(resultvec));
 		  }
@@ -896,13 +922,15 @@ ValuePtr builtin_cross(const std::shared_ptr<Context> ctx, const std::shared_ptr
 		LOG(message_group::Warning,loc,ctx->documentPath(),"Invalid vector size of parameter for cross()");
 		return ValuePtr::undefined;
 	}
+	// Vectors of numbers only are always packed
+	const bool numeric = v0.isNumeric() && v1.isNumeric();
 	for (unsigned int a = 0; a < 3; ++a) {
-		if ((v0[a]->type() != Value::Type::NUMBER) || (v1[a]->type() != Value::Type::NUMBER)) {
+		if (!numeric && ((v0[a]->type() != Value::Type::NUMBER) || (v1[a]->type() != Value::Type::NUMBER))) {
 			LOG(message_group::Warning,loc,ctx->documentPath(),"Invalid value in parameter vector for cross()");
 			return ValuePtr::undefined;
 		}
-		double d0 = v0[a]->toDouble();
-		double d1 = v1[a]->toDouble();
+		double d0 = numeric ? v0.numbers()[a] : v0[a]->toDouble();
+		double d1 = numeric ? v1.numbers()[a] : v1[a]->toDouble();
 		if (std::isnan(d0) || std::isnan(d1)) {
 			LOG(message_group::Warning,loc,ctx->documentPath(),"Invalid value (NaN) in parameter vector for cross()");
 			return ValuePtr::undefined;
@@ -913,15 +941,9 @@ ValuePtr builtin_cross(const std::shared_ptr<Context> ctx, const std::shared_ptr
 		}
 	}
 	
-	double x = v0[1]->toDouble() * v1[2]->toDouble() - v0[2]->toDouble() * v1[1]->toDouble();
-	double y = v0[2]->toDouble() * v1[0]->toDouble() - v0[0]->toDouble() * v1[2]->toDouble();
-	double z = v0[0]->toDouble() * v1[1]->toDouble() - v0[1]->toDouble() * v1[0]->toDouble();
-	
-	VectorType result;
-	result.push_back(ValuePtr(x));
-	result.push_back(ValuePtr(y));
-	result.push_back(ValuePtr(z));
-	return ValuePtr(result);
+	assert(numeric);
+	const Vector3d result = Eigen::Map<const Vector3d>(v0.numbers()).cross(Eigen::Map<const Vector3d>(v1.numbers()));
+	return ValuePtr(VectorType(result[0], result[1], result[2]));
 }
 
 ValuePtr builtin_is_undef(const std::shared_ptr<Context> ctx, const std::shared_ptr<EvalContext> evalctx)
@@ -28,13 +28,23 @@
 #include "evalcontext.h"
 #include "expression.h"
 #include "../common/printutils.h"
+#include "FunctionCache.h"
+#include "purity.h"
+#include "Profiler.h"
+#include "stacksegment.h"
+#include <atomic>
+
+namespace {
+	std::atomic<uint64_t> next_function_id{1};
+}
 
 AbstractFunction::~AbstractFunction()
 {
 }
 
 UserFunction::UserFunction(const char *name, AssignmentList &definition_arguments, shared_ptr<Expression> expr, const Location &loc)
-	: ASTNode(loc), name(name), definition_arguments(definition_arguments), expr(expr)
+	: ASTNode(loc), name(name), definition_arguments(definition_arguments), expr(expr),
+		id(next_function_id++), pure(expr && is_pure(*expr, definition_arguments))
 {
 }
 
@@ -42,9 +52,41 @@ UserFunction::~UserFunction()
 {
 }
 
+/*!
+	With the "memoize" feature, results of pure functions are cached by
+	argument values. A result is only cached if evaluating it didn't call
+	any impure function or print any message, as a cache hit would skip
+	those side effects.
+*/
 ValuePtr UserFunction::evaluate(const std::shared_ptr<Context>& ctx, const std::shared_ptr<EvalContext>& evalctx) const
 {
-	return evaluate_function(name, expr, definition_arguments, ctx, evalctx, loc);
+	if (StackSegment::needed()) {
+		ValuePtr result;
+		if (StackSegment::run([&]() { result = evaluate(ctx, evalctx); })) return result;
+	}
+	Profiler::Scope profile(Profiler::Kind::Function, this, name, loc);
+	if (!Feature::ExperimentalMemoize.is_enabled()) {
+		return evaluate_function(name, expr, definition_arguments, ctx, evalctx, loc);
+	}
+	if (!this->pure) {
+		FunctionCache::markImpure();
+		return evaluate_function(name, expr, definition_arguments, ctx, evalctx, loc);
+	}
+
+	ContextHandle<Context> c_next{Context::create<Context>(ctx)};
+	c_next->setVariables(evalctx, definition_arguments);
+	const auto &variables = c_next->local_variables();
+	std::vector<ValuePtr> args;
+	args.reserve(variables.size());
+	for (size_t i = 0; i < variables.size(); ++i) args.push_back(variables.valueAt(i));
+	const FunctionCallKey key(this->id, std::move(args));
+
+	ValuePtr result;
+	if (FunctionCache::instance()->lookup(key, result)) return result;
+	const auto impurity = FunctionCache::impurity();
+	result = evaluate_function_body(name, expr, definition_arguments, c_next.ctx, loc);
+	if (FunctionCache::impurity() == impurity) FunctionCache::instance()->insert(key, result);
+	return result;
 }
 
 void UserFunction::print(std::ostream &stream, const std::string &indent) const
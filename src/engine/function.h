@@ -48,4 +48,10 @@ public:
 
 	ValuePtr evaluate(const std::shared_ptr<Context>& ctx, const std::shared_ptr<EvalContext>& evalctx) const override;
 	void print(std::ostream &stream, const std::string &indent) const override;
+
+private:
+	// Identifies the function in the FunctionCache, never reused
+	const uint64_t id;
+	// Result only depends on the arguments, see is_pure()
+	const bool pure;
 };
@@ -1,5 +1,6 @@
 #include "handle_dep.h"
 #include "common/printutils.h"
+#include "parallelfor.h"
 #include <string>
 #include <sstream>
 #include <cstdlib> // for system()
@@ -13,6 +14,7 @@ const char *make_command = nullptr;
 
 void handle_dep(const std::string &filename)
 {
+	ParallelFor::checkSafe();
 	fs::path filepath(filename);
 	std::string dep = boost::regex_replace(filepath.generic_string(), boost::regex("\\ "), "\\\\ ");
 	if (dependencies.find(dep) != dependencies.end()) {
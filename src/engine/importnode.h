@@ -12,6 +12,7 @@ enum class ImportType {
 	SVG,
 	DXF,
 	NEF3,
+	SCADMESH,
 };
 
 class ImportNode : public LeafNode
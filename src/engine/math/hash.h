@@ -1,6 +1,7 @@
 #pragma once
 
 #include "linalg.h"
+#include <utility>
 
 typedef Eigen::Matrix<int64_t, 3, 1> Vector3l;
 
@@ -15,3 +16,9 @@ namespace Eigen {
 	size_t hash_value(Vector3d const &v);
 	size_t hash_value(Vector3l const &v);
 }
+
+/*!
+	128-bit non-cryptographic hash of an arbitrary byte buffer (MurmurHash3, x64 variant).
+	Returns the two 64-bit halves of the digest.
+*/
+std::pair<uint64_t, uint64_t> hash128(const void *data, size_t len, uint64_t seed = 0);
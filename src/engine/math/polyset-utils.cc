@@ -17,9 +17,10 @@ namespace PolysetUtils {
 	Polygon2d *project(const PolySet &ps) {
 		auto poly = new Polygon2d;
 
-		for (const auto &p : ps.polygons) {
+		for (const auto &face : ps.indices) {
 			Outline2d outline;
-			for (const auto &v : p) {
+			for (const auto idx : face) {
+				const auto &v = ps.vertices[idx];
 				outline.vertices.emplace_back(v[0], v[1]);
 			}
 			poly->addOutline(outline);
@@ -51,11 +52,14 @@ namespace PolysetUtils {
 	{
 		int degeneratePolygons = 0;
 
-		// Build Indexed PolyMesh
+		// Build Indexed PolyMesh, merging vertices which are equal in float precision
 		Reindexer<Vector3f> allVertices;
+		std::vector<int> vertexmap;
+		vertexmap.reserve(inps.vertices.size());
+		for (const auto &v : inps.vertices) vertexmap.push_back(allVertices.lookup(v.cast<float>()));
 		std::vector<std::vector<IndexedFace>> polygons;
 
-		for (const auto &pgon : inps.polygons) {
+		for (const auto &pgon : inps.indices) {
 			if (pgon.size() < 3) {
 				degeneratePolygons++;
 				continue;
@@ -65,9 +69,9 @@ namespace PolysetUtils {
 			auto &faces = polygons.back();
 			faces.push_back(IndexedFace());
 			auto &currface = faces.back();
-			for (const auto &v : pgon) {
-				// Create vertex indices and remove consecutive duplicate vertices
-				auto idx = allVertices.lookup(v.cast<float>());
+			for (const auto i : pgon) {
+				// Remove consecutive duplicate vertices
+				auto idx = vertexmap[i];
 				if (currface.empty() || idx != currface.back()) currface.push_back(idx);
 			}
 			if (currface.front() == currface.back()) currface.pop_back();
@@ -79,7 +83,8 @@ namespace PolysetUtils {
 
 		// Tessellate indexed mesh
 		const auto& verts = allVertices.getArray();
-		std::vector<IndexedTriangle> allTriangles;
+		const int offset = outps.vertices.size();
+		for (const auto &v : verts) outps.add_vertex(v.cast<double>());
 		for (const auto &faces : polygons) {
 			std::vector<IndexedTriangle> triangles;
 			auto err = false;
@@ -91,10 +96,7 @@ namespace PolysetUtils {
 			}
 			if (!err) {
 				for (const auto &t : triangles) {
-					outps.append_poly();
-					outps.append_vertex(verts[t[0]]);
-					outps.append_vertex(verts[t[1]]);
-					outps.append_vertex(verts[t[2]]);
+					outps.append_poly(IndexedFace{offset + t[0], offset + t[1], offset + t[2]});
 				}
 			}
 		}
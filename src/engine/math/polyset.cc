@@ -29,6 +29,7 @@
 #include "linalg.h"
 #include "../../common/printutils.h"
 #include "../grid.h"
+#include "../Reindexer.h"
 #include <Eigen/LU>
 
 /*! /class PolySet
@@ -40,16 +41,24 @@
 	2) Store 2D outlines, used for rendering edges (2D only)
 	3) Rendering of polygons and edges
 
+	Meshes are stored indexed: faces are lists of indices into a shared vertex
+	array. append_vertex() and insert_vertex() build polygon soups, where each
+	call adds a new vertex; use mergeVertices() afterwards to share duplicates,
+	or build indexed meshes directly using add_vertex() and append_poly(IndexedFace).
+
+	The bounding box is computed on first use. Readers may also fill vertices
+	and indices of a new PolySet directly, but other code changing them must
+	do so through the methods, which invalidate the bounding box.
 
 	PolySet must only contain convex polygons
 
  */
 
-PolySet::PolySet(unsigned int dim, boost::tribool convex) : dim(dim), convex(convex), dirty(false)
+PolySet::PolySet(unsigned int dim, boost::tribool convex) : dim(dim), convex(convex), dirty(true)
 {
 }
 
-PolySet::PolySet(const Polygon2d &origin) : polygon(origin), dim(2), convex(unknown), dirty(false)
+PolySet::PolySet(const Polygon2d &origin) : polygon(origin), dim(2), convex(unknown), dirty(true)
 {
 }
 
@@ -63,15 +72,13 @@ std::string PolySet::dump() const
 	out << "PolySet:"
 	  << "\n dimensions:" << this->dim
 	  << "\n convexity:" << this->convexity
-	  << "\n num polygons: " << polygons.size()
+	  << "\n num polygons: " << indices.size()
 			<< "\n num outlines: " << polygon.outlines().size()
 	  << "\n polygons data:";
-	for (size_t i = 0; i < polygons.size(); ++i) {
+	for (const auto &face : indices) {
 		out << "\n  polygon begin:";
-		const Polygon *poly = &polygons[i];
-		for (size_t j = 0; j < poly->size(); ++j) {
-			Vector3d v = poly->at(j);
-			out << "\n   vertex:" << v.transpose();
+		for (const auto idx : face) {
+			out << "\n   vertex:" << vertices[idx].transpose();
 		}
 	}
 	out << "\n outlines data:";
@@ -80,15 +87,39 @@ std::string PolySet::dump() const
 	return out.str();
 }
 
+Polygon PolySet::getFace(size_t i) const
+{
+	Polygon poly;
+	poly.reserve(indices[i].size());
+	for (const auto idx : indices[i]) poly.push_back(vertices[idx]);
+	return poly;
+}
+
 void PolySet::append_poly()
 {
-	polygons.push_back(Polygon());
+	indices.push_back(IndexedFace());
 }
 
 void PolySet::append_poly(const Polygon &poly)
 {
-	polygons.push_back(poly);
+	append_poly();
+	for (const auto &v : poly) append_vertex(v);
+}
+
+void PolySet::append_poly(const IndexedFace &face)
+{
+	indices.push_back(face);
+	this->dirty = true;
+}
+
+/*!
+	Adds a vertex without adding it to any face. Returns its index.
+*/
+int PolySet::add_vertex(const Vector3d &v)
+{
+	vertices.push_back(v);
 	this->dirty = true;
+	return vertices.size() - 1;
 }
 
 void PolySet::append_vertex(double x, double y, double z)
@@ -98,8 +129,7 @@ void PolySet::append_vertex(double x, double y, double z)
 
 void PolySet::append_vertex(const Vector3d &v)
 {
-	polygons.back().push_back(v);
-	this->dirty = true;
+	indices.back().push_back(add_vertex(v));
 }
 
 void PolySet::append_vertex(const Vector3f &v)
@@ -114,8 +144,7 @@ void PolySet::insert_vertex(double x, double y, double z)
 
 void PolySet::insert_vertex(const Vector3d &v)
 {
-	polygons.back().insert(polygons.back().begin(), v);
-	this->dirty = true;
+	indices.back().insert(indices.back().begin(), add_vertex(v));
 }
 
 void PolySet::insert_vertex(const Vector3f &v)
@@ -127,9 +156,10 @@ BoundingBox PolySet::getBoundingBox() const
 {
 	if (this->dirty) {
 		this->bbox.setNull();
-		for(const auto &poly : polygons) {
-			for(const auto &p : poly) {
-				this->bbox.extend(p);
+		// Only count vertices which are in use
+		for(const auto &face : indices) {
+			for(const auto idx : face) {
+				this->bbox.extend(vertices[idx]);
 			}
 		}
 		this->dirty = false;
@@ -137,10 +167,17 @@ BoundingBox PolySet::getBoundingBox() const
 	return this->bbox;
 }
 
+void PolySet::setBoundingBox(const BoundingBox &box)
+{
+	this->bbox = box;
+	this->dirty = false;
+}
+
 size_t PolySet::memsize() const
 {
 	size_t mem = 0;
-	for(const auto &p : this->polygons) mem += p.size() * sizeof(Vector3d);
+	mem += this->vertices.size() * sizeof(Vector3d);
+	for(const auto &face : this->indices) mem += face.size() * sizeof(int) + sizeof(face);
 	mem += this->polygon.memsize() - sizeof(this->polygon);
 	mem += sizeof(PolySet);
 	return mem;
@@ -148,10 +185,14 @@ size_t PolySet::memsize() const
 
 void PolySet::append(const PolySet &ps)
 {
-	this->polygons.insert(this->polygons.end(), ps.polygons.begin(), ps.polygons.end());
-	if (!dirty && !this->bbox.isNull()) {
-		this->bbox.extend(ps.getBoundingBox());
+	const int offset = this->vertices.size();
+	this->vertices.insert(this->vertices.end(), ps.vertices.begin(), ps.vertices.end());
+	this->indices.reserve(this->indices.size() + ps.indices.size());
+	for (const auto &face : ps.indices) {
+		this->indices.push_back(face);
+		for (auto &idx : this->indices.back()) idx += offset;
 	}
+	this->dirty = true;
 }
 
 void PolySet::transform(const Transform3d &mat)
@@ -159,11 +200,11 @@ void PolySet::transform(const Transform3d &mat)
 	// If mirroring transform, flip faces to avoid the object to end up being inside-out
 	bool mirrored = mat.matrix().determinant() < 0;
 
-	for(auto &p : this->polygons){
-		for(auto &v : p) {
-			v = mat * v;
-		}
-		if (mirrored) std::reverse(p.begin(), p.end());
+	for(auto &v : this->vertices) {
+		v = mat * v;
+	}
+	if (mirrored) {
+		for(auto &face : this->indices) std::reverse(face.begin(), face.end());
 	}
 	this->dirty = true;
 }
@@ -203,33 +244,50 @@ void PolySet::resize(const Vector3d &newsize, const Eigen::Matrix<bool,3,1> &aut
 
 /*!
 	Quantizes vertices by gridding them as well as merges close vertices belonging to
-	neighboring grids.
+	neighboring grids. Merged vertices end up sharing one index.
 	May reduce the number of polygons if polygons collapse into < 3 vertices.
 */
 void PolySet::quantizeVertices()
 {
 	Grid3d<int> grid(GRID_FINE);
-	std::vector<int> indices; // Vertex indices in one polygon
-	for (std::vector<Polygon>::iterator iter = this->polygons.begin(); iter != this->polygons.end();) {
-		Polygon &p = *iter;
-		indices.resize(p.size());
-		// Quantize all vertices. Build index list
-		for (unsigned int i=0; i<p.size(); ++i) indices[i] = grid.align(p[i]);
+	std::vector<int> remap(this->vertices.size());
+	std::vector<Vector3d> newvertices;
+	for (size_t i = 0; i < this->vertices.size(); ++i) {
+		Vector3d v = this->vertices[i];
+		remap[i] = grid.align(v);
+		if (remap[i] == int(newvertices.size())) newvertices.push_back(v);
+	}
+	this->vertices.swap(newvertices);
+
+	size_t numfaces = 0;
+	for (auto &face : this->indices) {
+		for (auto &idx : face) idx = remap[idx];
 		// Remove consecutive duplicate vertices
-		Polygon::iterator currp = p.begin();
-		for (unsigned int i=0; i<indices.size(); ++i) {
-			if (indices[i] != indices[(i+1)%indices.size()]) {
-				(*currp++) = p[i];
-			}
+		size_t n = 0;
+		for (size_t i = 0; i < face.size(); ++i) {
+			if (face[i] != face[(i+1)%face.size()]) face[n++] = face[i];
 		}
-		p.erase(currp, p.end());
-		if (p.size() < 3) {
+		face.resize(n);
+		if (face.size() < 3) {
 			PRINTD("Removing collapsed polygon due to quantizing");
-			this->polygons.erase(iter);
-		}
-		else {
-			iter++;
+			continue;
 		}
+		this->indices[numfaces++].swap(face);
+	}
+	this->indices.resize(numfaces);
+	this->dirty = true;
+}
+
+/*!
+	Makes all faces share identical vertices, and drops unused vertices.
+	Used after building a PolySet as a polygon soup.
+*/
+void PolySet::mergeVertices()
+{
+	Reindexer<Vector3d> reindexer;
+	for (auto &face : this->indices) {
+		for (auto &idx : face) idx = reindexer.lookup(this->vertices[idx]);
 	}
+	this->vertices = reindexer.getArray();
 }
 
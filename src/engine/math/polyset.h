@@ -15,7 +15,9 @@ class PolySet : public Geometry
 {
 public:
 	VISITABLE_GEOMETRY();
-	Polygons polygons;
+	// Faces refer to shared vertices by index
+	std::vector<Vector3d> vertices;
+	std::vector<IndexedFace> indices;
 
 	PolySet(unsigned int dim, boost::tribool convex = unknown);
 	PolySet(const Polygon2d &origin);
@@ -25,15 +27,20 @@ public:
 
 	size_t memsize() const override;
 	BoundingBox getBoundingBox() const override;
+	// Use a box known to match the faces, e.g. stored with the mesh, instead of computing it
+	void setBoundingBox(const BoundingBox &box);
 	std::string dump() const override;
 	unsigned int getDimension() const override { return this->dim; }
-	bool isEmpty() const override { return polygons.size() == 0; }
+	bool isEmpty() const override { return indices.size() == 0; }
 	Geometry *copy() const override { return new PolySet(*this); }
 
 	void quantizeVertices();
-	size_t numFacets() const override { return polygons.size(); }
+	size_t numFacets() const override { return indices.size(); }
+	Polygon getFace(size_t i) const;
 	void append_poly();
 	void append_poly(const Polygon &poly);
+	void append_poly(const IndexedFace &face);
+	int add_vertex(const Vector3d &v);
 	void append_vertex(double x, double y, double z = 0.0);
 	void append_vertex(const Vector3d &v);
 	void append_vertex(const Vector3f &v);
@@ -41,6 +48,7 @@ public:
 	void insert_vertex(const Vector3d &v);
 	void insert_vertex(const Vector3f &v);
 	void append(const PolySet &ps);
+	void mergeVertices();
 
 	void transform(const Transform3d &mat);
 	void resize(const Vector3d &newsize, const Eigen::Matrix<bool,3,1> &autosize);
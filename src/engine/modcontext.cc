@@ -74,10 +74,10 @@ void ModuleContext::initializeModule(const UserModule &module)
 	this->functions_p = &module.scope.functions;
 	this->modules_p = &module.scope.modules;
 	for (const auto &assignment : module.scope.assignments) {
-		if (assignment->getExpr()->isLiteral() && this->variables.find(assignment->getName()) != this->variables.end()) {
+		if (assignment->getExpr()->isLiteral() && this->variables.find(assignment->getSymbol())) {
 			LOG(message_group::Warning,assignment->location(),this->documentPath(),"Module %1$s: Parameter %2$s is overwritten with a literal",module.name,assignment->getName());
 		}
-		this->set_variable(assignment->getName(), assignment->getExpr()->evaluate(get_shared_ptr()));
+		this->set_variable(assignment->getSymbol(), assignment->getExpr()->execute(get_shared_ptr()));
 	}
 
 // Experimental code. See issue #399
@@ -148,17 +148,16 @@ std::string ModuleContext::dump(const AbstractModule *mod, const ModuleInstantia
 		if (m) {
 			s << "  module args:";
 			for(const auto &arg : m->definition_arguments) {
-				s << boost::format("    %s = %s") % arg->getName() % variables[arg->getName()];
+				s << boost::format("    %s = %s") % arg->getName() % lookup_variable(arg->getName(), true);
 			}
 		}
 	}
-	typedef std::pair<std::string, ValuePtr> ValueMapType;
 	s << "  vars:";
-	for(const auto &v : constants) {
-		s << boost::format("    %s = %s") % v.first % v.second;
+	for (size_t i = 0; i < constants.size(); ++i) {
+		s << boost::format("    %s = %s") % constants.symbolAt(i).name() % constants.valueAt(i);
 	}
-	for(const auto &v : variables) {
-		s << boost::format("    %s = %s") % v.first % v.second;
+	for (size_t i = 0; i < variables.size(); ++i) {
+		s << boost::format("    %s = %s") % variables.symbolAt(i).name() % variables.valueAt(i);
 	}
 	for(const auto &v : config_variables) {
 		s << boost::format("    %s = %s") % v.first % v.second;
@@ -227,6 +226,6 @@ void FileContext::initializeModule(const class FileModule &module)
 	this->functions_p = &module.scope.functions;
 	this->modules_p = &module.scope.modules;
 	for (const auto &assignment : module.scope.assignments) {
-		this->set_variable(assignment->getName(), assignment->getExpr()->evaluate(get_shared_ptr()));
+		this->set_variable(assignment->getSymbol(), assignment->getExpr()->execute(get_shared_ptr()));
 	}
 }
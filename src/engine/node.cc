@@ -29,6 +29,7 @@
 #include "module.h"
 #include "ModuleInstantiation.h"
 #include "progress.h"
+#include "Profiler.h"
 #include "../common/printutils.h"
 #include <functional>
 #include <iostream>
@@ -36,12 +37,51 @@
 
 size_t AbstractNode::idx_counter;
 
+namespace {
+	// The counter of the innermost IndexScope on this thread, if any
+	thread_local size_t *scope_counter = nullptr;
+
+	void shift_indices(AbstractNode *node, size_t offset)
+	{
+		node->idx += offset;
+		for (auto child : node->children) shift_indices(child, offset);
+	}
+}
+
+AbstractNode::IndexScope::IndexScope() : counter(0), previous(scope_counter)
+{
+	scope_counter = &this->counter;
+}
+
+AbstractNode::IndexScope::~IndexScope()
+{
+	scope_counter = this->previous;
+}
+
+size_t *AbstractNode::IndexScope::current()
+{
+	return scope_counter;
+}
+
+void AbstractNode::IndexScope::setCurrent(size_t *counter)
+{
+	scope_counter = counter;
+}
+
+void AbstractNode::adopt(const std::vector<AbstractNode *> &nodes, size_t count)
+{
+	size_t &counter = scope_counter ? *scope_counter : idx_counter;
+	for (auto node : nodes) shift_indices(node, counter);
+	counter += count;
+}
+
 AbstractNode::AbstractNode(const ModuleInstantiation *mi, const std::shared_ptr<EvalContext> &ctx) :
     modinst(mi),
     progress_mark(0),
-    idx(idx_counter++),
+    idx((scope_counter ? *scope_counter : idx_counter)++),
     location((ctx)?ctx->loc:Location(0, 0, 0, 0, nullptr))
 {
+	Profiler::allocated();
 }
 
 AbstractNode::~AbstractNode()
@@ -49,6 +49,30 @@ public:
 
 	static void resetIndexCounter() { idx_counter = 1; }
 
+	/*!
+		While in scope, nodes instantiated on the current thread are numbered
+		in a sequence of their own, starting at 0. Nodes instantiated on other
+		threads get the indices they would have had in serial order by
+		passing them to adopt() in that order.
+	*/
+	class IndexScope
+	{
+	public:
+		IndexScope();
+		~IndexScope();
+		size_t size() const { return this->counter; }
+
+		// The counter of the current thread, for a StackSegment to continue with it
+		static size_t *current();
+		static void setCurrent(size_t *counter);
+
+	private:
+		size_t counter;
+		size_t *previous;
+	};
+	// Moves nodes numbered in an IndexScope of the given size to the end of the current sequence
+	static void adopt(const std::vector<AbstractNode *> &nodes, size_t count);
+
 	// FIXME: Make protected
 	std::vector<AbstractNode*> children;
 	const ModuleInstantiation *modinst;
@@ -0,0 +1,127 @@
+#include "nodehasher.h"
+#include "math/state.h"
+#include "math/hash.h"
+#include "ModuleInstantiation.h"
+#include "../common/printutils.h"
+#include <iomanip>
+
+bool NodeKey::verify = false;
+
+bool NodeKey::operator==(const NodeKey &other) const
+{
+	if (this->h1 != other.h1 || this->h2 != other.h2) return false;
+	if (NodeKey::verify && this->idString != other.idString) {
+		LOG(message_group::Error,Location::NONE,"","Node cache key collision: %1$s",*this);
+		return false;
+	}
+	return true;
+}
+
+std::ostream &operator<<(std::ostream &stream, const NodeKey &key)
+{
+	const auto flags = stream.flags();
+	const auto fill = stream.fill('0');
+	stream << std::hex << std::setw(16) << key.h1 << std::setw(16) << key.h2;
+	stream.fill(fill);
+	stream.flags(flags);
+	return stream;
+}
+
+namespace {
+	NodeKey combine(char tag, const std::string &text, const std::vector<NodeKey> &children)
+	{
+		std::string buffer;
+		buffer.reserve(1 + text.size() + 2 * sizeof(uint64_t) * children.size());
+		buffer.push_back(tag);
+		buffer += text;
+		for (const auto &child : children) {
+			buffer.append(reinterpret_cast<const char *>(&child.h1), sizeof(child.h1));
+			buffer.append(reinterpret_cast<const char *>(&child.h2), sizeof(child.h2));
+		}
+		const auto digest = hash128(buffer.data(), buffer.size());
+		return NodeKey(digest.first, digest.second);
+	}
+}
+
+/*!
+	Computes the key of \a node from its own description and the keys collected
+	from its children, then passes it on to the parent.
+
+	Like in id strings, a node's own '%' and '#' modifiers are not part of its
+	key, but are part of what it contributes to its parent. Transparent nodes
+	without modifiers pass their children's keys on directly.
+*/
+void NodeHasher::finishNode(const State &state, const AbstractNode &node, bool transparent)
+{
+	const auto children = std::move(this->childkeys.back());
+	this->childkeys.pop_back();
+
+	NodeKey key;
+	if (transparent && children.size() == 1) key = children.front();
+	else key = combine(transparent ? 'L' : 'N', transparent ? "" : node.toString(), children);
+	this->keys[node.index()] = key;
+
+	// Root of the traversal
+	if (this->childkeys.empty()) return;
+
+	char modifiers = 0;
+	if (node.modinst->isBackground() || state.isBackground()) modifiers |= 1;
+	if (node.modinst->isHighlight() || state.isHighlight()) modifiers |= 2;
+
+	auto &parentkeys = this->childkeys.back();
+	if (modifiers) {
+		parentkeys.push_back(combine('M', std::string(1, modifiers), {key}));
+	} else if (transparent) {
+		parentkeys.insert(parentkeys.end(), children.begin(), children.end());
+	} else {
+		parentkeys.push_back(key);
+	}
+}
+
+Response NodeHasher::visit(State &state, const AbstractNode &node)
+{
+	if (state.isPrefix()) {
+		this->childkeys.emplace_back();
+	} else if (state.isPostfix()) {
+		finishNode(state, node, false);
+	}
+	return Response::ContinueTraversal;
+}
+
+/*!
+	Groups with zero or one child are replaced by their child, see GroupNodeChecker.
+*/
+Response NodeHasher::visit(State &state, const GroupNode &node)
+{
+	if (state.isPrefix()) {
+		this->childkeys.emplace_back();
+	} else if (state.isPostfix()) {
+		finishNode(state, node, this->childkeys.back().size() <= 1);
+	}
+	return Response::ContinueTraversal;
+}
+
+/*!
+	List nodes only list their children, and pass modifiers down to them.
+*/
+Response NodeHasher::visit(State &state, const ListNode &node)
+{
+	if (state.isPrefix()) {
+		if (node.modinst->isHighlight()) state.setHighlight(true);
+		if (node.modinst->isBackground()) state.setBackground(true);
+		this->childkeys.emplace_back();
+	} else if (state.isPostfix()) {
+		finishNode(state, node, true);
+	}
+	return Response::ContinueTraversal;
+}
+
+Response NodeHasher::visit(State &state, const RootNode &node)
+{
+	if (state.isPrefix()) {
+		this->childkeys.emplace_back();
+	} else if (state.isPostfix()) {
+		finishNode(state, node, true);
+	}
+	return Response::ContinueTraversal;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <ostream>
+#include "NodeVisitor.h"
+#include "node.h"
+
+/*!
+	128-bit structural hash identifying the geometry of a node subtree.
+
+	Used as the key for the geometry caches instead of the full text dump of
+	the subtree. When NodeKey::verify is set, the key additionally carries the
+	node's id string (see Tree::getIdString()) and equality falls back to
+	comparing it, reporting any hash collision. This is only meant for testing.
+*/
+class NodeKey
+{
+public:
+	NodeKey() : h1(0), h2(0) {}
+	NodeKey(uint64_t h1, uint64_t h2) : h1(h1), h2(h2) {}
+
+	bool operator==(const NodeKey &other) const;
+	bool operator!=(const NodeKey &other) const { return !(*this == other); }
+
+	uint64_t h1, h2;
+	std::string idString;
+
+	static bool verify;
+};
+
+std::ostream &operator<<(std::ostream &stream, const NodeKey &key);
+
+namespace std {
+	template<> struct hash<NodeKey> {
+		std::size_t operator()(const NodeKey &key) const { return static_cast<std::size_t>(key.h1 ^ key.h2); }
+	};
+}
+
+/*!
+	Computes the NodeKey of every node in a tree in a single bottom-up pass.
+
+	Each key is derived from the node's own parameters and its children's keys,
+	so no node is serialized more than once. Lists, the root node and groups
+	with at most one child are transparent, mirroring how NodeDumper builds id
+	strings, so equivalent subtrees from different scopes share a key.
+*/
+class NodeHasher : public NodeVisitor
+{
+public:
+	NodeHasher(std::unordered_map<size_t, NodeKey> &keys) : keys(keys) {}
+	~NodeHasher() {}
+
+	Response visit(State &state, const AbstractNode &node) override;
+	Response visit(State &state, const GroupNode &node) override;
+	Response visit(State &state, const ListNode &node) override;
+	Response visit(State &state, const RootNode &node) override;
+
+private:
+	void finishNode(const State &state, const AbstractNode &node, bool transparent);
+
+	std::unordered_map<size_t, NodeKey> &keys;
+	// Keys contributed by the children of each node currently being visited
+	std::vector<std::vector<NodeKey>> childkeys;
+};
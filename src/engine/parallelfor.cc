@@ -0,0 +1,109 @@
+#include "parallelfor.h"
+#include "context.h"
+#include "feature.h"
+#include "FunctionCache.h"
+#include "UserModule.h"
+#include "../common/ThreadPool.h"
+#include "../common/printutils.h"
+#include <algorithm>
+#include <exception>
+#include <string>
+
+namespace {
+	// Number of parallel loop tasks in progress on this thread
+	thread_local size_t parallel_tasks = 0;
+
+	// More chunks than threads, so threads finishing early can steal work
+	const size_t CHUNKS_PER_THREAD = 4;
+
+	// Gives a task the thread state of the thread which started the loop
+	class TaskState
+	{
+	public:
+		TaskState(const Context &ctx, const Context::Stack &stack, const std::vector<std::string> &names)
+			: contexts(ctx, stack), names(names)
+		{
+			StaticModuleNameStack::swap(this->names);
+			parallel_tasks++;
+		}
+		~TaskState()
+		{
+			parallel_tasks--;
+			StaticModuleNameStack::swap(this->names);
+		}
+
+	private:
+		Context::ThreadStack contexts;
+		std::vector<std::string> names;
+	};
+}
+
+bool ParallelFor::enabled(size_t iterations)
+{
+	return iterations > 1 && Feature::ExperimentalParallelFor.is_enabled() && ThreadPool::instance()->isParallel();
+}
+
+void ParallelFor::checkSafe()
+{
+	if (parallel_tasks > 0) throw ParallelUnsafeException();
+}
+
+size_t ParallelFor::tasks()
+{
+	return parallel_tasks;
+}
+
+void ParallelFor::setTasks(size_t tasks)
+{
+	parallel_tasks = tasks;
+}
+
+ParallelFor::ParallelFor(const std::shared_ptr<Context> &ctx, size_t iterations) : ctx(ctx)
+{
+	const size_t chunks = std::min(iterations, ThreadPool::instance()->numThreads() * CHUNKS_PER_THREAD);
+	for (size_t i = 0; i <= chunks; ++i) this->bounds.push_back(iterations * i / chunks);
+}
+
+size_t ParallelFor::run(const Body &body)
+{
+	const size_t chunks = numChunks();
+	std::vector<std::vector<Message>> messages(chunks);
+	std::vector<std::exception_ptr> exceptions(chunks);
+	std::vector<char> impure(chunks, false);
+
+	const Context::Stack &stack = this->ctx->stack();
+	std::vector<std::string> names;
+	for (int i = 0; i < StaticModuleNameStack::size(); ++i) names.push_back(StaticModuleNameStack::at(i));
+
+	std::vector<ThreadPool::Task> tasks;
+	for (size_t chunk = 0; chunk < chunks; ++chunk) {
+		tasks.push_back([&, chunk]() {
+			TaskState state(*this->ctx, stack, names);
+			MessageCapture capture(messages[chunk]);
+			const auto impurity = FunctionCache::impurity();
+			try {
+				body(chunk, this->bounds[chunk], this->bounds[chunk + 1]);
+			} catch (...) {
+				exceptions[chunk] = std::current_exception();
+			}
+			impure[chunk] = FunctionCache::impurity() != impurity;
+		});
+	}
+	ThreadPool::instance()->run(tasks);
+
+	for (size_t chunk = 0; chunk < chunks; ++chunk) {
+		if (exceptions[chunk]) {
+			try {
+				std::rethrow_exception(exceptions[chunk]);
+			} catch (const ParallelUnsafeException &) {
+				return chunk;
+			} catch (...) {
+			}
+		}
+		// Calls of impure functions in the tasks make the calls in progress here impure as well
+		if (impure[chunk]) FunctionCache::markImpure();
+		for (const auto &msg : messages[chunk]) PRINT(msg);
+		if (exceptions[chunk]) std::rethrow_exception(exceptions[chunk]);
+	}
+	return chunks;
+}
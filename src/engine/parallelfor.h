@@ -0,0 +1,67 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+class Context;
+
+/*!
+	Thrown by ParallelFor::checkSafe() when something with side effects
+	outside of the evaluation is done in a loop iteration evaluated in
+	parallel, e.g. calling rands() or reading a file.
+*/
+class ParallelUnsafeException : public std::runtime_error
+{
+public:
+	ParallelUnsafeException() : std::runtime_error("Not allowed in parallel loop iterations") {}
+};
+
+/*!
+	Evaluates the iterations of a for() loop on the thread pool, with the
+	"parallel-for" feature.
+
+	The iterations are split into consecutive chunks, one task each. Tasks
+	get a copy of the context stack and module name stack of the thread
+	which started the loop. Their messages are captured and printed in
+	iteration order once all chunks are done, and the first exception in
+	iteration order is rethrown, so the output is the same as when
+	evaluating the loop serially.
+
+	Evaluation is speculative: builtins with global side effects call
+	checkSafe() first, which aborts the chunk. Chunks before it are kept,
+	and the caller evaluates the remaining iterations serially, so the side
+	effects happen in their original order.
+*/
+class ParallelFor
+{
+public:
+	typedef std::function<void(size_t chunk, size_t begin, size_t end)> Body;
+
+	// True if a loop with the given number of iterations should be evaluated in parallel
+	static bool enabled(size_t iterations);
+	// Throws ParallelUnsafeException if called from a parallel loop iteration
+	static void checkSafe();
+	// Number of parallel loop tasks in progress on this thread, for a StackSegment to continue with
+	static size_t tasks();
+	static void setTasks(size_t tasks);
+
+	ParallelFor(const std::shared_ptr<Context> &ctx, size_t iterations);
+
+	size_t numChunks() const { return this->bounds.size() - 1; }
+	// The first iteration of the given chunk
+	size_t begin(size_t chunk) const { return this->bounds[chunk]; }
+
+	/*!
+		Calls body for all chunks in parallel, and returns the number of
+		chunks done, i.e. those before the first one which was aborted.
+		Only the results of these may be used, the iterations from
+		begin(done) on have to be evaluated again serially.
+	*/
+	size_t run(const Body &body);
+
+private:
+	std::shared_ptr<Context> ctx;
+	std::vector<size_t> bounds;
+};
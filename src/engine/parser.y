@@ -50,6 +50,7 @@
 #include <boost/filesystem.hpp>
 #include "common/boost-utils.h"
 #include "engine/feature.h"
+#include "engine/Trace.h"
 
 namespace fs = boost::filesystem;
 
@@ -764,6 +765,7 @@ void handle_assignment(const std::string token, Expression *expr, const Location
 
 bool parse(FileModule *&module, const std::string& text, const std::string &filename, const std::string &mainFile, int debug)
 {
+  Trace::Span span("parse", "parse ", filename);
   fs::path filepath = fs::absolute(fs::path(filename));
   mainFilePath = fs::absolute(fs::path(mainFile));
   parsingMainFile = mainFilePath == filepath;
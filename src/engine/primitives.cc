@@ -391,41 +391,16 @@ const Geometry *PrimitiveNode::createGeometry() const
 				z2 = this->z;
 			}
 
-			p->append_poly(); // top
-			p->append_vertex(x1, y1, z2);
-			p->append_vertex(x2, y1, z2);
-			p->append_vertex(x2, y2, z2);
-			p->append_vertex(x1, y2, z2);
-
-			p->append_poly(); // bottom
-			p->append_vertex(x1, y2, z1);
-			p->append_vertex(x2, y2, z1);
-			p->append_vertex(x2, y1, z1);
-			p->append_vertex(x1, y1, z1);
-
-			p->append_poly(); // side1
-			p->append_vertex(x1, y1, z1);
-			p->append_vertex(x2, y1, z1);
-			p->append_vertex(x2, y1, z2);
-			p->append_vertex(x1, y1, z2);
-
-			p->append_poly(); // side2
-			p->append_vertex(x2, y1, z1);
-			p->append_vertex(x2, y2, z1);
-			p->append_vertex(x2, y2, z2);
-			p->append_vertex(x2, y1, z2);
-
-			p->append_poly(); // side3
-			p->append_vertex(x2, y2, z1);
-			p->append_vertex(x1, y2, z1);
-			p->append_vertex(x1, y2, z2);
-			p->append_vertex(x2, y2, z2);
-
-			p->append_poly(); // side4
-			p->append_vertex(x1, y2, z1);
-			p->append_vertex(x1, y1, z1);
-			p->append_vertex(x1, y1, z2);
-			p->append_vertex(x1, y2, z2);
+			// Bits 0, 1 and 2 of the vertex index select x2, y2 and z2 respectively
+			for (int i = 0; i < 8; ++i) {
+				p->add_vertex(Vector3d(i & 1 ? x2 : x1, i & 2 ? y2 : y1, i & 4 ? z2 : z1));
+			}
+			p->append_poly(IndexedFace{4, 5, 7, 6}); // top
+			p->append_poly(IndexedFace{2, 3, 1, 0}); // bottom
+			p->append_poly(IndexedFace{0, 1, 5, 4}); // side1
+			p->append_poly(IndexedFace{1, 3, 7, 5}); // side2
+			p->append_poly(IndexedFace{3, 2, 6, 7}); // side3
+			p->append_poly(IndexedFace{2, 0, 4, 6}); // side4
 		}
 	}
 		break;
@@ -455,43 +430,39 @@ const Geometry *PrimitiveNode::createGeometry() const
 				generate_circle(ring[i].points.data(), r, fragments);
 			}
 
-			p->append_poly();
-			for (int i = 0; i < fragments; ++i)
-				p->append_vertex(ring[0].points[i].x, ring[0].points[i].y, ring[0].z);
+			// Point k of ring i gets vertex index i*fragments + k
+			for (const auto &r : ring) {
+				for (const auto &pt : r.points) p->add_vertex(Vector3d(pt.x, pt.y, r.z));
+			}
+
+			IndexedFace top(fragments);
+			for (int i = 0; i < fragments; ++i) top[i] = i;
+			p->append_poly(top);
 
 			for (int i = 0; i < rings-1; ++i) {
-				auto r1 = &ring[i];
-				auto  r2 = &ring[i+1];
+				const int r1 = i*fragments;
+				const int r2 = (i+1)*fragments;
 				int r1i = 0, r2i = 0;
 				while (r1i < fragments || r2i < fragments) {
 					if (r1i >= fragments) goto sphere_next_r2;
 					if (r2i >= fragments) goto sphere_next_r1;
 					if ((double)r1i / fragments < (double)r2i / fragments) {
 					sphere_next_r1:
-						p->append_poly();
 						int r1j = (r1i+1) % fragments;
-						p->insert_vertex(r1->points[r1i].x, r1->points[r1i].y, r1->z);
-						p->insert_vertex(r1->points[r1j].x, r1->points[r1j].y, r1->z);
-						p->insert_vertex(r2->points[r2i % fragments].x, r2->points[r2i % fragments].y, r2->z);
+						p->append_poly(IndexedFace{r2 + r2i % fragments, r1 + r1j, r1 + r1i});
 						r1i++;
 					} else {
 					sphere_next_r2:
-						p->append_poly();
 						int r2j = (r2i+1) % fragments;
-						p->append_vertex(r2->points[r2i].x, r2->points[r2i].y, r2->z);
-						p->append_vertex(r2->points[r2j].x, r2->points[r2j].y, r2->z);
-						p->append_vertex(r1->points[r1i % fragments].x, r1->points[r1i % fragments].y, r1->z);
+						p->append_poly(IndexedFace{r2 + r2i, r2 + r2j, r1 + r1i % fragments});
 						r2i++;
 					}
 				}
 			}
 
-			p->append_poly();
-			for (int i = 0; i < fragments; ++i) {
-				p->insert_vertex(ring[rings-1].points[i].x,
-												 ring[rings-1].points[i].y,
-												 ring[rings-1].z);
-			}
+			IndexedFace bottom(fragments);
+			for (int i = 0; i < fragments; ++i) bottom[i] = (rings-1)*fragments + fragments-1 - i;
+			p->append_poly(bottom);
 		}
 	}
 		break;
@@ -518,40 +489,35 @@ const Geometry *PrimitiveNode::createGeometry() const
 			generate_circle(circle1.data(), r1, fragments);
 			generate_circle(circle2.data(), r2, fragments);
 
+			// Bottom circle vertices come first, then the top circle
+			for (const auto &pt : circle1) p->add_vertex(Vector3d(pt.x, pt.y, z1));
+			for (const auto &pt : circle2) p->add_vertex(Vector3d(pt.x, pt.y, z2));
+			const int c1 = 0, c2 = fragments;
+
 			for (int i=0; i<fragments; ++i) {
 				int j = (i+1) % fragments;
 				if (r1 == r2) {
-					p->append_poly();
-					p->insert_vertex(circle1[i].x, circle1[i].y, z1);
-					p->insert_vertex(circle2[i].x, circle2[i].y, z2);
-					p->insert_vertex(circle2[j].x, circle2[j].y, z2);
-					p->insert_vertex(circle1[j].x, circle1[j].y, z1);
+					p->append_poly(IndexedFace{c1 + j, c2 + j, c2 + i, c1 + i});
 				} else {
 					if (r1 > 0) {
-						p->append_poly();
-						p->insert_vertex(circle1[i].x, circle1[i].y, z1);
-						p->insert_vertex(circle2[i].x, circle2[i].y, z2);
-						p->insert_vertex(circle1[j].x, circle1[j].y, z1);
+						p->append_poly(IndexedFace{c1 + j, c2 + i, c1 + i});
 					}
 					if (r2 > 0) {
-						p->append_poly();
-						p->insert_vertex(circle2[i].x, circle2[i].y, z2);
-						p->insert_vertex(circle2[j].x, circle2[j].y, z2);
-						p->insert_vertex(circle1[j].x, circle1[j].y, z1);
+						p->append_poly(IndexedFace{c1 + j, c2 + j, c2 + i});
 					}
 				}
 			}
 
 			if (this->r1 > 0) {
-				p->append_poly();
-				for (int i=0; i<fragments; ++i)
-					p->insert_vertex(circle1[i].x, circle1[i].y, z1);
+				IndexedFace bottom(fragments);
+				for (int i=0; i<fragments; ++i) bottom[i] = c1 + fragments-1 - i;
+				p->append_poly(bottom);
 			}
 
 			if (this->r2 > 0) {
-				p->append_poly();
-				for (int i=0; i<fragments; ++i)
-					p->append_vertex(circle2[i].x, circle2[i].y, z2);
+				IndexedFace top(fragments);
+				for (int i=0; i<fragments; ++i) top[i] = c2 + i;
+				p->append_poly(top);
 			}
 		}
 	}
@@ -561,6 +527,8 @@ const Geometry *PrimitiveNode::createGeometry() const
 		g = p;
 		p->setConvexity(this->convexity);
 		const auto &pts = this->points->toVector();
+		// PolySet vertex index of each point, or -1 if not used yet
+		std::vector<int> vertexindices(pts.size(), -1);
 		size_t face_i = 0;
 		for (const auto &face : this->faces->toVector())	{
 			p->append_poly();
@@ -568,14 +536,19 @@ const Geometry *PrimitiveNode::createGeometry() const
 			for (const auto &pt_i_val : face->toVector()) {
 				size_t pt_i = (size_t)pt_i_val->toDouble();
 				if (pt_i < pts.size()) {
-					double px, py, pz;
-					if (!pts[pt_i]->getVec3(px, py, pz, 0.0) ||
-					    !std::isfinite(px) || !std::isfinite(py) || !std::isfinite(pz)) {
-						LOG(message_group::Error,this->modinst->location(),this->document_path,
-							"Unable to convert points[%1$d] = %2$s to a vec3 of numbers",pt_i,pts[pt_i]->toEchoString());
-						return p;
+					if (vertexindices[pt_i] < 0) {
+						double px, py, pz;
+						if (!pts[pt_i]->getVec3(px, py, pz, 0.0) ||
+								!std::isfinite(px) || !std::isfinite(py) || !std::isfinite(pz)) {
+							LOG(message_group::Error,this->modinst->location(),this->document_path,
+								"Unable to convert points[%1$d] = %2$s to a vec3 of numbers",pt_i,pts[pt_i]->toEchoString());
+							return p;
+						}
+						vertexindices[pt_i] = p->add_vertex(Vector3d(px, py, pz));
 					}
-					p->insert_vertex(px, py, pz);
+					// Faces are given clockwise
+					auto &indices = p->indices.back();
+					indices.insert(indices.begin(), vertexindices[pt_i]);
 				} else {
 					LOG(message_group::Warning,this->modinst->location(),this->document_path,"Point index %1$d is out of bounds (from faces[%2$d][%3$d])",pt_i , face_i , fp_i);
 				}
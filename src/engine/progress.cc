@@ -1,14 +1,24 @@
 #include "progress.h"
 #include "node.h"
+#include <algorithm>
+#include <mutex>
 
 int progress_report_count;
 int _progress_mark;
 void (*progress_report_f)(const class AbstractNode*, void*, int);
 void *progress_report_userdata;
 
+namespace {
+	// Progress may be reported from several render threads at once
+	std::mutex progress_mutex;
+	bool progress_cancelled;
+}
+
 void progress_report_prep(AbstractNode *root, void (*f)(const class AbstractNode *node, void *userdata, int mark), void *userdata)
 {
 	progress_report_count = 0;
+	_progress_mark = 0;
+	progress_cancelled = false;
 	progress_report_f = f;
 	progress_report_userdata = userdata;
 	root->progress_prepare();
@@ -21,16 +31,36 @@ void progress_report_fin()
 	progress_report_userdata = nullptr;
 }
 
+/*!
+	Calls the report function on behalf of the current thread. Once it has
+	cancelled, all threads get cancelled on their next report.
+*/
+static void report(const AbstractNode *node)
+{
+	if (progress_cancelled) throw ProgressCancelException();
+	try {
+		progress_report_f(node, progress_report_userdata, _progress_mark);
+	} catch (const ProgressCancelException &) {
+		progress_cancelled = true;
+		throw;
+	}
+}
+
 void progress_update(const AbstractNode *node, int mark)
 {
 	if (progress_report_f) {
-		_progress_mark = mark;
-		progress_report_f(node, progress_report_userdata, _progress_mark);
+		std::lock_guard<std::mutex> lock(progress_mutex);
+		// Subtrees evaluated in parallel finish out of order, never report going backwards
+		_progress_mark = std::max(_progress_mark, mark);
+		report(node);
 	}
 }
 
 void progress_tick()
 {
-	if (progress_report_f)
-		progress_report_f(nullptr, progress_report_userdata, ++_progress_mark);
+	if (progress_report_f) {
+		std::lock_guard<std::mutex> lock(progress_mutex);
+		++_progress_mark;
+		report(nullptr);
+	}
 }
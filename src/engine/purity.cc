@@ -0,0 +1,149 @@
+#include "purity.h"
+#include "expression.h"
+#include <typeinfo>
+
+namespace {
+	// Builtin functions with results depending on more than their arguments
+	bool is_impure_builtin(const std::string &name)
+	{
+		return name == "rands" || name == "parent_module" || name == "dxf_dim" || name == "dxf_cross";
+	}
+}
+
+/*!
+	Walks an expression tree keeping track of the variables in scope.
+	This is a friend of the Expression subclasses.
+*/
+class PurityChecker
+{
+public:
+	PurityChecker(const AssignmentList &parameters)
+	{
+		for (const auto &param : parameters) this->bound.push_back(param->getSymbol());
+	}
+
+	bool check(const Expression *expr)
+	{
+		if (!expr) return true;
+
+		const auto &type = typeid(*expr);
+		if (type == typeid(Literal)) {
+			return true;
+		}
+		else if (type == typeid(Lookup)) {
+			return isBound(static_cast<const Lookup *>(expr)->symbol);
+		}
+		else if (type == typeid(UnaryOp)) {
+			return check(static_cast<const UnaryOp *>(expr)->expr.get());
+		}
+		else if (type == typeid(BinaryOp)) {
+			const auto op = static_cast<const BinaryOp *>(expr);
+			return check(op->left.get()) && check(op->right.get());
+		}
+		else if (type == typeid(TernaryOp)) {
+			const auto op = static_cast<const TernaryOp *>(expr);
+			return check(op->cond.get()) && check(op->ifexpr.get()) && check(op->elseexpr.get());
+		}
+		else if (type == typeid(ArrayLookup)) {
+			const auto lookup = static_cast<const ArrayLookup *>(expr);
+			return check(lookup->array.get()) && check(lookup->index.get());
+		}
+		else if (type == typeid(MemberLookup)) {
+			return check(static_cast<const MemberLookup *>(expr)->expr.get());
+		}
+		else if (type == typeid(Range)) {
+			const auto range = static_cast<const Range *>(expr);
+			return check(range->begin.get()) && check(range->step.get()) && check(range->end.get());
+		}
+		else if (type == typeid(Vector)) {
+			for (const auto &child : static_cast<const Vector *>(expr)->children) {
+				if (!check(child.get())) return false;
+			}
+			return true;
+		}
+		else if (type == typeid(FunctionCall)) {
+			const auto call = static_cast<const FunctionCall *>(expr);
+			// Function values may be closures over anything
+			if (!call->isLookup || isBound(Symbol(call->name))) return false;
+			if (call->name[0] == '$' || is_impure_builtin(call->name)) return false;
+			return checkExpressions(call->arguments);
+		}
+		else if (type == typeid(Let)) {
+			const auto let = static_cast<const Let *>(expr);
+			return checkScope(let->arguments, let->expr.get(), true);
+		}
+		else if (type == typeid(LcLet)) {
+			const auto let = static_cast<const LcLet *>(expr);
+			return checkScope(let->arguments, let->expr.get(), true);
+		}
+		else if (type == typeid(LcFor)) {
+			const auto lc = static_cast<const LcFor *>(expr);
+			return checkScope(lc->arguments, lc->expr.get(), false);
+		}
+		else if (type == typeid(LcForC)) {
+			const auto lc = static_cast<const LcForC *>(expr);
+			const size_t size = this->bound.size();
+			bool pure = checkAssignments(lc->arguments, true) && check(lc->cond.get()) &&
+				checkExpressions(lc->incr_arguments) && check(lc->expr.get());
+			this->bound.resize(size);
+			return pure;
+		}
+		else if (type == typeid(LcIf)) {
+			const auto lc = static_cast<const LcIf *>(expr);
+			return check(lc->cond.get()) && check(lc->ifexpr.get()) && check(lc->elseexpr.get());
+		}
+		else if (type == typeid(LcEach)) {
+			return check(static_cast<const LcEach *>(expr)->expr.get());
+		}
+		// echo(), assert(), function literals (new function values every time), ...
+		return false;
+	}
+
+private:
+	bool isBound(const Symbol &sym) const
+	{
+		if (sym.isConfigVariable()) return false;
+		for (const auto &b : this->bound) {
+			if (b == sym) return true;
+		}
+		return false;
+	}
+
+	bool checkExpressions(const AssignmentList &assignments)
+	{
+		for (const auto &assignment : assignments) {
+			if (!check(assignment->getExpr().get())) return false;
+		}
+		return true;
+	}
+
+	// Binds the assigned names, in sequence if each assignment can see the previous ones
+	bool checkAssignments(const AssignmentList &assignments, bool sequential)
+	{
+		if (!sequential && !checkExpressions(assignments)) return false;
+		for (const auto &assignment : assignments) {
+			if (assignment->getSymbol().isConfigVariable()) return false;
+			if (sequential && !check(assignment->getExpr().get())) return false;
+			this->bound.push_back(assignment->getSymbol());
+		}
+		return true;
+	}
+
+	bool checkScope(const AssignmentList &assignments, const Expression *body, bool sequential)
+	{
+		const size_t size = this->bound.size();
+		const bool pure = checkAssignments(assignments, sequential) && check(body);
+		this->bound.resize(size);
+		return pure;
+	}
+
+	std::vector<Symbol> bound;
+};
+
+bool is_pure(const Expression &expr, const AssignmentList &parameters)
+{
+	for (const auto &param : parameters) {
+		if (param->getSymbol().isConfigVariable()) return false;
+	}
+	return PurityChecker(parameters).check(&expr);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Assignment.h"
+
+class Expression;
+
+/*!
+	Static check whether evaluating an expression only depends on the given
+	variables, and has no side effects.
+
+	Pure expressions don't read $-variables, don't print anything (echo(),
+	assert()), don't use random numbers or files, and only read the given
+	variables and the ones they bind themselves with let() or for(). Calls of
+	other user-defined functions by name are allowed, as long as these are
+	pure as well; which function a name refers to is only known when it's
+	called, so that part has to be checked at run time.
+*/
+bool is_pure(const Expression &expr, const AssignmentList &parameters);
@@ -8,12 +8,15 @@ class StackCheck
 public:
 	static StackCheck &inst()
 	{
-		static StackCheck instance;
+		// The stack is measured from the first check on each thread
+		static thread_local StackCheck instance;
 		return instance;
 	}
 
 	~StackCheck() {}
 	inline bool check() { return size() >= limit; }
+	// True once less than the given fraction of the stack is left
+	inline bool check(double reserve) { return size() >= limit * (1 - reserve); }
 
 private:
 	StackCheck() : limit(PlatformUtils::stackLimit()) {
@@ -0,0 +1,142 @@
+#include "stacksegment.h"
+#include "context.h"
+#include "node.h"
+#include "parallelfor.h"
+#include "FunctionCache.h"
+#include "UserModule.h"
+#include "Profiler.h"
+#include "stackcheck.h"
+#include "../common/PlatformUtils.h"
+#include "../common/printutils.h"
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/thread/thread.hpp>
+
+namespace {
+	// Segments on top of the stack of the thread which started evaluating,
+	// only set before evaluating
+	size_t max_segments = 8;
+	// Fraction of the stack left when switching to the next segment
+	const double STACK_RESERVE = 0.25;
+
+	// Number of segments below the current one
+	thread_local size_t segment_depth = 0;
+
+	// A thread which runs the jobs of the segment below it, one at a time
+	class Segment
+	{
+	public:
+		Segment(size_t depth) : job(nullptr), stopping(false) {
+			boost::thread::attributes attrs;
+			attrs.set_stack_size(PlatformUtils::stackLimit() + STACK_BUFFER_SIZE);
+			this->thread = boost::thread(attrs, [this, depth]() { loop(depth); });
+		}
+		~Segment() {
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->stopping = true;
+			}
+			this->cond.notify_all();
+			this->thread.join();
+		}
+
+		void run(const std::function<void()> &f) {
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->job = &f;
+			this->cond.notify_all();
+			this->cond.wait(lock, [this]() { return !this->job; });
+		}
+
+	private:
+		void loop(size_t depth) {
+			segment_depth = depth;
+			std::unique_lock<std::mutex> lock(this->mutex);
+			while (true) {
+				this->cond.wait(lock, [this]() { return this->job || this->stopping; });
+				if (!this->job) return;
+				lock.unlock();
+				(*this->job)();
+				lock.lock();
+				this->job = nullptr;
+				this->cond.notify_all();
+			}
+		}
+
+		std::mutex mutex;
+		std::condition_variable cond;
+		const std::function<void()> *job;
+		bool stopping;
+		boost::thread thread;
+	};
+
+	// Started on first use, stopped when the thread using it exits
+	thread_local std::unique_ptr<Segment> next_segment;
+}
+
+void StackSegment::setMaxSegments(size_t n)
+{
+	max_segments = n;
+}
+
+bool StackSegment::needed()
+{
+	return segment_depth < max_segments && StackCheck::inst().check(STACK_RESERVE);
+}
+
+bool StackSegment::run(const std::function<void()> &f)
+{
+	if (!next_segment) {
+		try {
+			next_segment.reset(new Segment(segment_depth + 1));
+		} catch (const boost::thread_resource_error &) {
+			return false;
+		}
+	}
+
+	const auto contexts = Context::ThreadStack::current();
+	const auto counter = AbstractNode::IndexScope::current();
+	const size_t tasks = ParallelFor::tasks();
+	const auto profile = Profiler::threadState();
+	std::vector<std::string> names;
+	for (int i = 0; i < StaticModuleNameStack::size(); ++i) names.push_back(StaticModuleNameStack::at(i));
+
+	std::vector<Message> messages;
+	std::exception_ptr exception;
+	bool impure = false;
+
+	next_segment->run([&]() {
+		// The segment only runs while the calling thread waits, so they can share its state
+		Context::ThreadStack::setCurrent(contexts);
+		AbstractNode::IndexScope::setCurrent(counter);
+		ParallelFor::setTasks(tasks);
+		Profiler::setThreadState(profile);
+		StaticModuleNameStack::swap(names);
+
+		{
+			MessageCapture capture(messages);
+			const auto impurity = FunctionCache::impurity();
+			try {
+				f();
+			} catch (...) {
+				exception = std::current_exception();
+			}
+			impure = FunctionCache::impurity() != impurity;
+		}
+
+		// Don't keep the state of the calling thread while parked
+		StaticModuleNameStack::swap(names);
+		Profiler::setThreadState(nullptr);
+		ParallelFor::setTasks(0);
+		AbstractNode::IndexScope::setCurrent(nullptr);
+		Context::ThreadStack::setCurrent(nullptr);
+	});
+
+	if (impure) FunctionCache::markImpure();
+	for (const auto &msg : messages) PRINT(msg);
+	if (exception) std::rethrow_exception(exception);
+	return true;
+}
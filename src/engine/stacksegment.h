@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+/*!
+	Continues evaluating on a new stack once the stack of the current thread
+	is nearly exhausted, so functions and modules can recurse deeper than
+	the stack of the thread evaluating them allows.
+
+	A segment is a helper thread with a stack allocated to the size
+	StackCheck expects, which the calling thread waits for. It takes over
+	the evaluation state of the calling thread: the context stacks, module
+	name stack, node numbering and parallel loop state. Its messages are
+	printed by the calling thread once it is done, and its exception is
+	rethrown there, so the output is the same as when evaluating on a
+	single large stack.
+
+	Only calls of user-defined functions and modules switch segments, once
+	less than a quarter of the stack is left, so calls close to the limit
+	don't each start a segment. Each thread keeps the thread of its next
+	segment parked between runs.
+
+	The number of segments is limited, 8 by default, so infinite recursion
+	still ends in the usual recursion error once the last segment is full.
+	With n segments, recursion can go about 3n/4 + 1 times as deep as on
+	the stack of a single thread, i.e. 7 times by default, so the limit
+	still scales with the stack size.
+*/
+class StackSegment
+{
+public:
+	// Limits the number of segments on top of the stack of each evaluating thread, 0 disables them
+	static void setMaxSegments(size_t n);
+	// True if the current thread should continue on another segment
+	static bool needed();
+	/*!
+		Calls f on the next segment and returns true once it is done.
+		Returns false without calling f if the segment can't be started,
+		the caller then continues until StackCheck reports the recursion.
+	*/
+	static bool run(const std::function<void()> &f);
+};
@@ -306,6 +306,8 @@ const Geometry *SurfaceNode::createGeometry() const
 		for (int i = lines-1; i > 0; i--)
 			p->insert_vertex(ox + 0, oy + i, min_val);
 	}
+	// Neighbouring cells and the walls share their vertices
+	p->mergeVertices();
 
 	return p;
 }
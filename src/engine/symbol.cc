@@ -0,0 +1,54 @@
+#include "symbol.h"
+#include <deque>
+#include <unordered_map>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+namespace {
+	struct SymbolTable {
+		SymbolTable() { names.emplace_back(); ids.emplace("", 0); }
+
+		boost::shared_mutex mutex;
+		// A deque doesn't move its elements, so name() can return references
+		std::deque<std::string> names;
+		std::unordered_map<std::string, uint32_t> ids;
+	};
+
+	SymbolTable &table()
+	{
+		static SymbolTable table;
+		return table;
+	}
+}
+
+// $children is not a config variable, see Context::is_config_variable()
+Symbol::Symbol(const std::string &name) : config(name[0] == '$' && name != "$children")
+{
+	auto &symbols = table();
+	{
+		boost::shared_lock<boost::shared_mutex> lock(symbols.mutex);
+		auto it = symbols.ids.find(name);
+		if (it != symbols.ids.end()) {
+			this->id = it->second;
+			return;
+		}
+	}
+	boost::unique_lock<boost::shared_mutex> lock(symbols.mutex);
+	auto it = symbols.ids.emplace(name, uint32_t(symbols.names.size()));
+	if (it.second) symbols.names.push_back(name);
+	this->id = it.first->second;
+}
+
+bool Symbol::exists(const std::string &name)
+{
+	auto &symbols = table();
+	boost::shared_lock<boost::shared_mutex> lock(symbols.mutex);
+	return symbols.ids.count(name) != 0;
+}
+
+const std::string &Symbol::name() const
+{
+	auto &symbols = table();
+	boost::shared_lock<boost::shared_mutex> lock(symbols.mutex);
+	return symbols.names[this->id];
+}
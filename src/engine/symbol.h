@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/*!
+	An interned identifier.
+
+	Every distinct name maps to a small integer for the lifetime of the
+	program, so variables can be compared and looked up without hashing or
+	comparing strings. Interning is thread safe; the parser interns all
+	identifiers up front, so evaluation mostly compares ids.
+*/
+class Symbol
+{
+public:
+	// The empty name
+	Symbol() : id(0), config(false) {}
+	explicit Symbol(const std::string &name);
+	// True if name has been interned, i.e. it appears in any parsed file
+	static bool exists(const std::string &name);
+
+	const std::string &name() const;
+	uint32_t index() const { return this->id; }
+	// $-variables are dynamically scoped and never resolved by symbol
+	bool isConfigVariable() const { return this->config; }
+
+	bool operator==(const Symbol &other) const { return this->id == other.id; }
+	bool operator!=(const Symbol &other) const { return this->id != other.id; }
+
+private:
+	uint32_t id;
+	bool config;
+};
+
+/*!
+	Where a variable reference was found the last time: the number of
+	parent contexts to walk up, and the slot in that context's VariableMap.
+	It is only a hint, which is validated on every use, as the shape of the
+	context chain can differ between evaluations of the same expression.
+*/
+struct ResolvedSlot
+{
+	// Slots of root context constants are flagged
+	static const uint32_t CONSTANT = 0x80000000;
+
+	ResolvedSlot() : depth(UINT32_MAX), slot(0) {}
+	std::atomic<uint32_t> depth;
+	std::atomic<uint32_t> slot;
+};
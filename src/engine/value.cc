@@ -34,11 +34,14 @@
 #include <boost/variant/static_visitor.hpp>
 #include <boost/numeric/conversion/cast.hpp>
 #include <boost/range/adaptor/transformed.hpp>
+#include <Eigen/Core>
 /*Unicode support for string lengths and array accesses*/
 #include <glib.h>
 
 #include "value.h"
 #include "expression.h"
+#include "parallelfor.h"
+#include "Profiler.h"
 #include "../common/printutils.h"
 #include "../common/boost-utils.h"
 #include "double-conversion/double-conversion.h"
@@ -558,6 +561,8 @@ std::string Value::toEchoString(const tostring_visitor *visitor) const
 std::string UndefType::toString() const {
   std::ostringstream stream;
   if (!reasons.empty()) {
+    // The value may be shared with other threads
+    ParallelFor::checkSafe();
     auto it = reasons.begin();
     stream << *it;
     for (++it; it != reasons.end(); ++it) {
@@ -664,6 +669,12 @@ bool Value::getVec3(double &x, double &y, double &z) const
 
   if (v.size() != 3) return false;
 
+  if (v.isNumeric()) {
+    x = v.numbers()[0];
+    y = v.numbers()[1];
+    z = v.numbers()[2];
+    return true;
+  }
   return (v[0]->getDouble(x) && v[1]->getDouble(y) && v[2]->getDouble(z));
 }
 
@@ -695,10 +706,10 @@ RangeType Value::toRange() const
 }
 
 Value FunctionType::operator==(const FunctionType &other) const {
-  return this == &other;
+  return this->data == other.data;
 }
 Value FunctionType::operator!=(const FunctionType &other) const {
-  return this != &other;
+  return this->data != other.data;
 }
 Value FunctionType::operator< (const FunctionType &other) const {
   return Value::undef("operation undefined (function < function)");
@@ -727,6 +738,9 @@ Value UndefType::operator>=(const UndefType &other) const {
 }
 
 Value VectorType::operator==(const VectorType &v) const {
+  if (this->isNumeric() && v.isNumeric()) {
+    return this->size() == v.size() && std::equal(this->numbers(), this->numbers() + this->size(), v.numbers());
+  }
   size_t i = 0;
   auto first1 = this->begin(), last1 = this->end(), first2 = v.begin(), last2 = v.end();
   for ( ; (first1 != last1) && (first2 != last2); ++first1, ++first2, ++i) {
@@ -854,6 +868,61 @@ Value Value::operator<=(const Value &v) const
 	return boost::apply_visitor(lessequal_visitor(), this->value, v.value);
 }
 
+/*
+  Kernels for packed numeric vectors, see VectorType.
+
+  Sums of products are accumulated in the same order as in the generic
+  element by element code, so both give bit identical results. Matrix
+  products are computed row by row as linear combinations of the packed rows
+  of the right operand, which Eigen vectorizes across the columns.
+*/
+namespace {
+	typedef Eigen::Map<const Eigen::VectorXd> ConstVectorMap;
+	typedef Eigen::Map<Eigen::VectorXd> VectorMap;
+
+	template <typename F> VectorType packed_result(size_t size, F f)
+	{
+		std::vector<double> result(size);
+		f(VectorMap(result.data(), size));
+		return VectorType(std::move(result));
+	}
+
+	double packed_dot(const double *a, const double *b, size_t size)
+	{
+		double r = 0.0;
+		for (size_t i = 0; i < size; ++i) r += a[i] * b[i];
+		return r;
+	}
+
+	// Collects the rows of a matrix if all of them are packed vectors of the given length
+	bool packed_rows(const VectorType &matrix, size_t cols, std::vector<const double *> &rows)
+	{
+		rows.clear();
+		rows.reserve(matrix.size());
+		for (const auto &row : matrix) {
+			if (row->type() != Value::Type::VECTOR) return false;
+			const auto &rowvec = row->toVector();
+			if (!rowvec.isNumeric() || rowvec.size() != cols) return false;
+			rows.push_back(rowvec.numbers());
+		}
+		return true;
+	}
+
+	// sum(coeffs[j] * rows[j])
+	VectorType packed_combination(const double *coeffs, const std::vector<const double *> &rows, size_t cols)
+	{
+		return packed_result(cols, [&](VectorMap result) {
+			result.setZero();
+			for (size_t j = 0; j < rows.size(); ++j) result += coeffs[j] * ConstVectorMap(rows[j], cols);
+		});
+	}
+
+	Value::Type first_element_type(const VectorType &vec)
+	{
+		return vec.isNumeric() ? Value::Type::NUMBER : (*vec.begin())->type();
+	}
+}
+
 class plus_visitor : public boost::static_visitor<Value>
 {
 public:
@@ -866,6 +935,10 @@ public:
 	}
 
 	Value operator()(const VectorType &op1, const VectorType &op2) const {
+		if (op1.isNumeric() && op2.isNumeric()) {
+			const auto n = std::min(op1.size(), op2.size());
+			return packed_result(n, [&](VectorMap sum) { sum = ConstVectorMap(op1.numbers(), n) + ConstVectorMap(op2.numbers(), n); });
+		}
 		VectorType sum;
 		for (size_t i = 0; i < op1.size() && i < op2.size(); ++i) {
 			sum.push_back(ValuePtr(*op1[i] + *op2[i]));
@@ -891,6 +964,10 @@ public:
 	}
 
 	Value operator()(const VectorType &op1, const VectorType &op2) const {
+		if (op1.isNumeric() && op2.isNumeric()) {
+			const auto n = std::min(op1.size(), op2.size());
+			return packed_result(n, [&](VectorMap sum) { sum = ConstVectorMap(op1.numbers(), n) - ConstVectorMap(op2.numbers(), n); });
+		}
 		VectorType sum;
 		for (size_t i = 0; i < op1.size() && i < op2.size(); ++i) {
 			sum.push_back(ValuePtr(*op1[i] - *op2[i]));
@@ -907,6 +984,11 @@ Value Value::operator-(const Value &v) const
 Value multvecnum(const VectorType &vecval, const Value &numval)
 {
   // Vector * Number
+	if (vecval.isNumeric() && numval.type() == Value::Type::NUMBER) {
+		const auto n = vecval.size();
+		const auto num = numval.toDouble();
+		return packed_result(n, [&](VectorMap dst) { dst = ConstVectorMap(vecval.numbers(), n) * num; });
+	}
 	VectorType dstv;
 	for(const auto &val : vecval) {
 		dstv.push_back(ValuePtr((*val) * numval));
@@ -916,6 +998,7 @@ Value multvecnum(const VectorType &vecval, const Value &numval)
 
 Value multvecvec(const VectorType &vec1, const VectorType &vec2) {
 	// Vector dot product.
+	if (vec1.isNumeric() && vec2.isNumeric()) return packed_dot(vec1.numbers(), vec2.numbers(), vec1.size());
 	auto r = 0.0;
 	for (size_t i=0; i<vec1.size(); ++i) {
 		if (vec1[i]->type() != Value::Type::NUMBER || vec2[i]->type() != Value::Type::NUMBER) {
@@ -929,6 +1012,12 @@ Value multvecvec(const VectorType &vec1, const VectorType &vec2) {
 Value multmatvec(const VectorType &matrixvec, const VectorType &vectorvec)
 {
 // Matrix * Vector
+	std::vector<const double *> rows;
+	if (vectorvec.isNumeric() && packed_rows(matrixvec, vectorvec.size(), rows)) {
+		return packed_result(rows.size(), [&](VectorMap dst) {
+			for (size_t i = 0; i < rows.size(); ++i) dst[i] = packed_dot(rows[i], vectorvec.numbers(), vectorvec.size());
+		});
+	}
 	VectorType dstv;
 	for (size_t i=0;i<matrixvec.size();++i) {
 		if (matrixvec[i]->type() != Value::Type::VECTOR ||
@@ -954,8 +1043,12 @@ Value multvecmat(const VectorType &vectorvec, const VectorType &matrixvec)
 {
 	assert(vectorvec.size() == matrixvec.size());
 // Vector * Matrix
-	VectorType dstv;
 	size_t firstRowSize =  matrixvec[0]->toVector().size();
+	std::vector<const double *> rows;
+	if (vectorvec.isNumeric() && packed_rows(matrixvec, firstRowSize, rows)) {
+		return packed_combination(vectorvec.numbers(), rows, firstRowSize);
+	}
+	VectorType dstv;
 	for (size_t i=0; i<firstRowSize; ++i) {
 		double r_e = 0.0;
 		for (size_t j=0; j<vectorvec.size(); ++j) {
@@ -991,8 +1084,7 @@ public:
 
   Value operator()(const VectorType &op1, const VectorType &op2) const {
     if (op1.empty() || op2.empty()) return Value::undef("Multiplication is undefined on empty vectors");
-    auto first1 = op1.begin(), first2 = op2.begin();
-    auto eltype1 = (*first1)->type(), eltype2 = (*first2)->type();
+    auto eltype1 = first_element_type(op1), eltype2 = first_element_type(op2);
     if (eltype1 == Value::Type::NUMBER) {
       if (eltype2 == Value::Type::NUMBER) {
         if (op1.size() == op2.size()) return multvecvec(op1,op2);
@@ -1003,11 +1095,18 @@ public:
       }
     } else if (eltype1 == Value::Type::VECTOR) {
       if (eltype2 == Value::Type::NUMBER) {
-        if ((*first1)->toVector().size() == op2.size()) return multmatvec(op1, op2);
-        else return Value::undef(STR("matrix*vector requires matrix column count to match vector length (" << (*first1)->toVector().size() << " != " << op2.size() << ')'));
+        if (op1[0]->toVector().size() == op2.size()) return multmatvec(op1, op2);
+        else return Value::undef(STR("matrix*vector requires matrix column count to match vector length (" << op1[0]->toVector().size() << " != " << op2.size() << ')'));
       } else if (eltype2 == Value::Type::VECTOR) {
-        if ((*first1)->toVector().size() == op2.size()) {
+        if (op1[0]->toVector().size() == op2.size()) {
           // Matrix * Matrix
+          std::vector<const double *> rows1, rows2;
+          if (packed_rows(op1, op2.size(), rows1) && packed_rows(op2, op2[0]->toVector().size(), rows2)) {
+            VectorType dstv;
+            dstv.reserve(rows1.size());
+            for (const auto row : rows1) dstv.push_back(ValuePtr(packed_combination(row, rows2, op2[0]->toVector().size())));
+            return {dstv};
+          }
           VectorType dstv;
           size_t i = 0;
           for (const auto &srcrow : op1) {
@@ -1020,11 +1119,11 @@ public:
           }
           return {dstv};
         } else {
-          return Value::undef(STR("matrix*matrix requires left operand column count to match right operand row count (" << (*first1)->toVector().size() << " != " << op2.size() << ')'));
+          return Value::undef(STR("matrix*matrix requires left operand column count to match right operand row count (" << op1[0]->toVector().size() << " != " << op2.size() << ')'));
         }
       }
     }
-    return Value::undef(STR("undefined vector*vector multiplication where first elements are types " << (*first1)->typeName() << " and " << (*first2)->typeName() ));
+    return Value::undef(STR("undefined vector*vector multiplication where first elements are types " << op1[0]->typeName() << " and " << op2[0]->typeName() ));
 	}
 };
 
@@ -1040,6 +1139,11 @@ Value Value::operator/(const Value &v) const
   }
   else if (this->type() == Type::VECTOR && v.type() == Type::NUMBER) {
     const auto &vec = this->toVector();
+    if (vec.isNumeric()) {
+      const auto n = vec.size();
+      const auto num = v.toDouble();
+      return packed_result(n, [&](VectorMap dst) { dst = ConstVectorMap(vec.numbers(), n) / num; });
+    }
     VectorType dstv;
     for (const auto &vecval : vec) {
       dstv.push_back(ValuePtr(*vecval / v));
@@ -1048,6 +1152,11 @@ Value Value::operator/(const Value &v) const
   }
   else if (this->type() == Type::NUMBER && v.type() == Type::VECTOR) {
     const auto &vec = v.toVector();
+    if (vec.isNumeric()) {
+      const auto n = vec.size();
+      const auto num = this->toDouble();
+      return packed_result(n, [&](VectorMap dst) { dst = num / ConstVectorMap(vec.numbers(), n).array(); });
+    }
     VectorType dstv;
     for (const auto &vecval : vec) {
       dstv.push_back(ValuePtr(*this / *vecval));
@@ -1072,6 +1181,10 @@ Value Value::operator-() const
   }
   else if (this->type() == Type::VECTOR) {
     const auto &vec = this->toVector();
+    if (vec.isNumeric()) {
+      const auto n = vec.size();
+      return packed_result(n, [&](VectorMap dst) { dst = -ConstVectorMap(vec.numbers(), n); });
+    }
     VectorType dstv;
     for (const auto &vecval : vec) {
       dstv.push_back(ValuePtr(-*vecval));
@@ -1229,70 +1342,115 @@ bool RangeType::iterator::operator!=(const iterator &other) const
 std::ostream& operator<<(std::ostream& stream, const FunctionType& f) {
 	stream << "function(";
 	bool first = true;
-	for (const auto& arg : f.args) {
+	for (const auto& arg : f.getArgs()) {
 		stream << (first ? "" : ", ") << arg->getName();
 		if (arg->getExpr()) {
 			stream << " = " << *arg->getExpr();
 		}
 		first = false;
 	}
-	stream << ") " << *f.expr;
+	stream << ") " << *f.getExpr();
 	return stream;
 }
 
-ValuePtr::ValuePtr()
-{
-	this->reset(new Value());
-}
-
-ValuePtr::ValuePtr(const Value &v)
-{
-	this->reset(new Value(v));
-}
-
-ValuePtr::ValuePtr(bool v)
+VectorType::VectorType(double x, double y, double z) : VectorType(std::vector<double>{x, y, z})
 {
-	this->reset(new Value(v));
 }
 
-ValuePtr::ValuePtr(int v)
+VectorType::VectorType(std::vector<double> numbers) : ptr(std::make_shared<Data>())
 {
-	this->reset(new Value(v));
+	Profiler::allocated();
+	this->length = numbers.size();
+	this->ptr->numbers = std::move(numbers);
 }
 
-ValuePtr::ValuePtr(double v)
+void VectorType::reserve(size_type size)
 {
-	this->reset(new Value(v));
-}
-
-ValuePtr::ValuePtr(const std::string &v)
-{
-	this->reset(new Value(v));
+	if (!this->ptr) {
+		this->ptr = std::make_shared<Data>();
+		Profiler::allocated();
+	}
+	if (this->ptr.use_count() == 1 && this->length == this->ptr->size()) {
+		if (this->ptr->packed) this->ptr->numbers.reserve(size);
+		else this->ptr->values.reserve(size);
+	}
+	else if (size > this->length) {
+		this->ptr = std::make_shared<Data>(*this->ptr, this->length, size);
+		Profiler::allocated();
+	}
 }
 
-ValuePtr::ValuePtr(const char *v)
+/*!
+	True if val can be appended to the shared data in place: no other vector
+	appended to it yet, and there is room for it without reallocating, as
+	other vectors may be reading their elements. Packed data is never
+	promoted in place, as other vectors rely on it being packed.
+	Has to be called with the data locked.
+*/
+bool VectorType::appendable(const ValuePtr &val)
 {
-	this->reset(new Value(v));
+	const auto &data = *this->ptr;
+	return this->length == data.size() && this->length < data.capacity() &&
+		(!data.packed || val->type() == Value::Type::NUMBER);
 }
 
-ValuePtr::ValuePtr(const char v)
+void VectorType::append(ValuePtr val)
 {
-	this->reset(new Value(v));
+	auto &data = *this->ptr;
+	if (data.packed) {
+		if (val->type() == Value::Type::NUMBER) {
+			data.numbers.push_back(val->toDouble());
+			if (data.unpacked) data.values.push_back(std::move(val));
+			return;
+		}
+		// Promote to generic
+		data.unpack();
+		data.packed = false;
+		std::vector<double>().swap(data.numbers);
+	}
+	data.values.push_back(std::move(val));
 }
 
-ValuePtr::ValuePtr(const VectorType &v)
+void VectorType::push_back(ValuePtr val)
 {
-	this->reset(new Value(v));
+	if (!this->ptr) {
+		this->ptr = std::make_shared<Data>();
+		Profiler::allocated();
+	}
+	if (this->ptr.use_count() > 1 || this->length != this->ptr->size()) {
+		std::unique_lock<std::mutex> lock(this->ptr->mutex);
+		if (appendable(val)) {
+			append(std::move(val));
+			this->length++;
+			return;
+		}
+		lock.unlock();
+		// Doubling the capacity makes appending amortized constant time
+		this->ptr = std::make_shared<Data>(*this->ptr, this->length, std::max<size_type>(2 * this->length, 4));
+		Profiler::allocated();
+	}
+	append(std::move(val));
+	this->length++;
 }
 
-ValuePtr::ValuePtr(const RangeType &v)
+void VectorType::extend(VectorType other)
 {
-	this->reset(new Value(v));
+	if (this->size() == 0) {
+		*this = std::move(other);
+		return;
+	}
+	if (other.isNumeric()) {
+		for (size_t i = 0; i < other.size(); ++i) push_back(other.numbers()[i]);
+	}
+	else {
+		for (const auto &v : other) push_back(v);
+	}
 }
 
-ValuePtr::ValuePtr(const FunctionType &v)
+const VectorType::vec_t &VectorType::emptyVec()
 {
-	this->reset(new Value(v));
+	static const vec_t empty;
+	return empty;
 }
 
 ValuePtr ValuePtr::operator==(const ValuePtr &v) const
@@ -1370,12 +1528,3 @@ ValuePtr ValuePtr::operator^(const ValuePtr &v) const
 	return ValuePtr(**this ^ *v);
 }
 
-ValuePtr::operator bool() const
-{
-	return **this;
-}
-
-const Value &ValuePtr::operator*() const
-{
-	return *this->get();
-}
@@ -5,6 +5,9 @@
 #include <algorithm>
 #include <cstdint>
 #include <limits>
+#include <mutex>
+#include <atomic>
+#include <cassert>
 
 // Workaround for https://bugreports.qt-project.org/browse/QTBUG-22829
 #ifndef Q_MOC_RUN
@@ -151,53 +154,20 @@ public:
 	friend class bracket_visitor;
 };
 
-class ValuePtr : public shared_ptr<const class Value>
-{
-public:
-  // FIXME: eventually remove this in favor of specific messages for each undef usage
-  static const ValuePtr undefined;
-
-  ValuePtr();
-  explicit ValuePtr(const Value &v);
-  ValuePtr(bool v);
-  ValuePtr(int v);
-  ValuePtr(double v);
-  ValuePtr(const std::string &v);
-  ValuePtr(const char *v);
-  ValuePtr(const char v);
-  ValuePtr(const class VectorType &v);
-  ValuePtr(const class RangeType &v);
-  ValuePtr(const class FunctionType &v);
-  ValuePtr undef(const std::string &why); // creation of undef should provide a reason!
-
-  operator bool() const;
-
-  ValuePtr operator==(const ValuePtr &v) const;
-  ValuePtr operator!=(const ValuePtr &v) const;
-  ValuePtr operator< (const ValuePtr &v) const;
-  ValuePtr operator<=(const ValuePtr &v) const;
-  ValuePtr operator>=(const ValuePtr &v) const;
-  ValuePtr operator> (const ValuePtr &v) const;
+class ValuePtr;
+class Value;
 
-  ValuePtr operator-() const;
-  ValuePtr operator!() const;
-  ValuePtr operator[](const ValuePtr &v) const;
-  ValuePtr operator+(const ValuePtr &v) const;
-  ValuePtr operator-(const ValuePtr &v) const;
-  ValuePtr operator*(const ValuePtr &v) const;
-  ValuePtr operator/(const ValuePtr &v) const;
-  ValuePtr operator%(const ValuePtr &v) const;
-  ValuePtr operator^(const ValuePtr &v) const;
-
-  const Value &operator*() const;
-
-private:
-};
+/*
+  The types below which are larger than a couple of words are handles to
+  shared, immutable data, so a Value stays small enough to be stored and
+  copied inline, see ValuePtr.
+*/
 
 class FunctionType {
 public:
   FunctionType(std::shared_ptr<Context> ctx, std::shared_ptr<Expression> expr, AssignmentList args)
-    : ctx(ctx), expr(expr), args(args) { }
+    : data(std::make_shared<const Data>(std::move(ctx), std::move(expr), std::move(args))) { }
+  // Functions are only equal to copies of themselves
   Value operator==(const FunctionType &other) const;
   Value operator!=(const FunctionType &other) const;
   Value operator< (const FunctionType &other) const;
@@ -205,32 +175,59 @@ public:
   Value operator<=(const FunctionType &other) const;
   Value operator>=(const FunctionType &other) const;
 
-  const std::shared_ptr<Context>& getCtx() { return ctx; }
-  const std::shared_ptr<Expression>& getExpr() { return expr; }
-  const AssignmentList& getArgs() { return args; }
+  const std::shared_ptr<Context>& getCtx() const { return data->ctx; }
+  const std::shared_ptr<Expression>& getExpr() const { return data->expr; }
+  const AssignmentList& getArgs() const { return data->args; }
   friend std::ostream& operator<<(std::ostream& stream, const FunctionType& f);
 private:
-  std::shared_ptr<Context> ctx;
-  std::shared_ptr<Expression> expr;
-  AssignmentList args;
+  struct Data {
+    Data(std::shared_ptr<Context> ctx, std::shared_ptr<Expression> expr, AssignmentList args)
+      : ctx(std::move(ctx)), expr(std::move(expr)), args(std::move(args)) { }
+    std::shared_ptr<Context> ctx;
+    std::shared_ptr<Expression> expr;
+    AssignmentList args;
+  };
+  shared_ptr<const Data> data;
 };
 
-class str_utf8_wrapper : public std::string
+class str_utf8_wrapper
 {
 public:
-	str_utf8_wrapper() : std::string(), cached_len(-1) { }
-	str_utf8_wrapper( const std::string& s ) : std::string( s ), cached_len(-1) { }
-	str_utf8_wrapper( size_t n, char c ) : std::string(n, c), cached_len(-1) { }
-	~str_utf8_wrapper() {}
+	str_utf8_wrapper() : str_utf8_wrapper(std::string()) { }
+	str_utf8_wrapper(const std::string &s) : data(std::make_shared<const Data>(s)) { }
+	str_utf8_wrapper(const char *s) : data(std::make_shared<const Data>(s)) { }
+	str_utf8_wrapper(size_t n, char c) : data(std::make_shared<const Data>(std::string(n, c))) { }
+
+	const std::string &toString() const { return data->str; }
+	const char *c_str() const { return data->str.c_str(); }
+	size_t size() const { return data->str.size(); }
+	bool empty() const { return data->str.empty(); }
 
 	glong get_utf8_strlen() const {
-		if (cached_len < 0) {
-			cached_len = g_utf8_strlen(this->c_str(), this->size());
+		glong len = data->cached_len.load(std::memory_order_relaxed);
+		if (len < 0) {
+			len = g_utf8_strlen(this->c_str(), this->size());
+			data->cached_len.store(len, std::memory_order_relaxed);
 		}
-		return cached_len;
+		return len;
 	};
+
+	bool operator==(const str_utf8_wrapper &other) const { return toString() == other.toString(); }
+	bool operator!=(const str_utf8_wrapper &other) const { return toString() != other.toString(); }
+	bool operator< (const str_utf8_wrapper &other) const { return toString() <  other.toString(); }
+	bool operator> (const str_utf8_wrapper &other) const { return toString() >  other.toString(); }
+	bool operator<=(const str_utf8_wrapper &other) const { return toString() <= other.toString(); }
+	bool operator>=(const str_utf8_wrapper &other) const { return toString() >= other.toString(); }
+	friend std::ostream &operator<<(std::ostream &stream, const str_utf8_wrapper &s) { return stream << s.toString(); }
+
 private:
-	mutable glong cached_len;
+	struct Data {
+		Data(const std::string &str) : str(str), cached_len(-1) { }
+		const std::string str;
+		// Strings may be shared between parallel for() iterations
+		mutable std::atomic<glong> cached_len;
+	};
+	shared_ptr<const Data> data;
 };
 
 /*
@@ -260,21 +257,37 @@ private:
   mutable std::vector<std::string> reasons;
 };
 
+/*
+  Copies of a VectorType share their elements. Each copy sees the first
+  size() elements of the shared data, which are never modified. Appending
+  to a shared vector adds the element to the shared data in place if no
+  other copy has appended to it yet, and makes a private copy with room to
+  grow otherwise. Building a list by repeatedly appending to the previous
+  one, e.g. with concat(list, [x]), thus takes amortized constant time per
+  element instead of copying the list every time.
+
+  As long as all elements are numbers, they are stored packed as an array of
+  doubles, which the arithmetic operators work on directly. Adding any other
+  element promotes the vector to the generic representation. Packed elements
+  are only wrapped as ValuePtrs when they're accessed as such, e.g. by
+  iterating over the vector.
+*/
 class VectorType {
   using vec_t = std::vector<ValuePtr>;
 public:
-  using value_type = vec_t::value_type;
+  using value_type = ValuePtr;
   using size_type = vec_t::size_type;
   using const_iterator = vec_t::const_iterator;
 
-  VectorType() : vec() {}
-  VectorType(double x, double y, double z) : vec{x,y,z} {}
+  VectorType() {}
+  VectorType(double x, double y, double z);
+  explicit VectorType(std::vector<double> numbers);
   VectorType(const VectorType &) = default;
   VectorType& operator=(const VectorType &) = default;
   VectorType(VectorType&&) = default;
   VectorType& operator=(VectorType&&) = default;
 
-  void reserve(size_type size) { vec.reserve(size); };
+  void reserve(size_type size);
 
   Value operator==(const VectorType &v) const;
   Value operator!=(const VectorType &v) const;
@@ -282,18 +295,35 @@ public:
   Value operator<=(const VectorType &v) const;
   Value operator>=(const VectorType &v) const;
   Value operator> (const VectorType &v) const;
-  const ValuePtr& operator[](size_type i) const { return vec[i]; }
+  const ValuePtr& operator[](size_type i) const { return vec()[i]; }
 
-  const_iterator begin() const { return vec.begin(); }
-  const_iterator   end() const { return vec.end();   }
-  size_type size() const { return vec.size(); }
-  bool empty() const { return vec.empty(); }
+  const_iterator begin() const { return vec().begin(); }
+  const_iterator   end() const { return vec().begin() + size(); }
+  size_type size() const { return this->ptr ? this->length : 0; }
+  bool empty() const { return size() == 0; }
 
-  void push_back(ValuePtr val) { vec.push_back(val); }
-  template<typename... Args> void emplace_back(Args&&... args) { vec.emplace_back(std::forward<Args>(args)...); }
+  // True if all elements are numbers, which are then available as numbers()
+  bool isNumeric() const;
+  // Identifies the elements, which are shared by copies and only ever appended to
+  std::weak_ptr<const void> identity() const { return this->ptr; }
+  const double *numbers() const;
+
+  void push_back(ValuePtr val);
+  template<typename... Args> void emplace_back(Args&&... args) { push_back(ValuePtr(std::forward<Args>(args)...)); }
+  // Appends all elements of other, sharing them if this vector is empty
+  void extend(VectorType other);
 
 private:
-  vec_t vec;
+  struct Data;
+
+  const vec_t &vec() const;
+  bool appendable(const ValuePtr &val);
+  void append(ValuePtr val);
+  static const vec_t &emptyVec();
+
+  shared_ptr<Data> ptr;
+  // Number of elements of the shared data which belong to this vector
+  size_type length = 0;
 };
 
 class Value
@@ -382,4 +412,117 @@ private:
   Variant value;
 };
 
+/*
+  Holds a Value inline. Undef, booleans, numbers and ranges are stored
+  without any heap allocation or reference counting; only strings, vectors
+  and functions share their data between copies.
+
+  The pointer-like interface is kept from when this was a shared_ptr, so
+  it can still be used the same way.
+*/
+class ValuePtr
+{
+public:
+  // FIXME: eventually remove this in favor of specific messages for each undef usage
+  static const ValuePtr undefined;
+
+  ValuePtr() {}
+  explicit ValuePtr(const Value &v) : value(v) {}
+  explicit ValuePtr(Value &&v) : value(std::move(v)) {}
+  ValuePtr(bool v) : value(v) {}
+  ValuePtr(int v) : value(v) {}
+  ValuePtr(double v) : value(v) {}
+  ValuePtr(const std::string &v) : value(v) {}
+  ValuePtr(const char *v) : value(v) {}
+  ValuePtr(const char v) : value(v) {}
+  ValuePtr(const VectorType &v) : value(v) {}
+  ValuePtr(const RangeType &v) : value(v) {}
+  ValuePtr(const FunctionType &v) : value(v) {}
+  ValuePtr undef(const std::string &why); // creation of undef should provide a reason!
+
+  operator bool() const { return this->value.toBool(); }
+
+  ValuePtr operator==(const ValuePtr &v) const;
+  ValuePtr operator!=(const ValuePtr &v) const;
+  ValuePtr operator< (const ValuePtr &v) const;
+  ValuePtr operator<=(const ValuePtr &v) const;
+  ValuePtr operator>=(const ValuePtr &v) const;
+  ValuePtr operator> (const ValuePtr &v) const;
+
+  ValuePtr operator-() const;
+  ValuePtr operator!() const;
+  ValuePtr operator[](const ValuePtr &v) const;
+  ValuePtr operator+(const ValuePtr &v) const;
+  ValuePtr operator-(const ValuePtr &v) const;
+  ValuePtr operator*(const ValuePtr &v) const;
+  ValuePtr operator/(const ValuePtr &v) const;
+  ValuePtr operator%(const ValuePtr &v) const;
+  ValuePtr operator^(const ValuePtr &v) const;
+
+  const Value &operator*() const { return this->value; }
+  const Value *operator->() const { return &this->value; }
+  const Value *get() const { return &this->value; }
+
+private:
+  Value value;
+};
+
+struct VectorType::Data
+{
+  Data() : packed(true), unpacked(false) {}
+  // Copies the first size elements of other, with room for capacity elements
+  Data(const Data &other, size_type size, size_type capacity) : packed(other.packed), unpacked(false) {
+    if (this->packed) {
+      this->numbers.reserve(capacity);
+      this->numbers.assign(other.numbers.begin(), other.numbers.begin() + size);
+    }
+    else {
+      this->values.reserve(capacity);
+      this->values.assign(other.values.begin(), other.values.begin() + size);
+    }
+  }
+
+  size_type size() const { return this->packed ? this->numbers.size() : this->values.size(); }
+  // Number of elements which can be appended without reallocating
+  size_type capacity() const {
+    if (!this->packed) return this->values.capacity();
+    return this->unpacked ? std::min(this->numbers.capacity(), this->values.capacity()) : this->numbers.capacity();
+  }
+
+  // Creates values from numbers, once. Safe to call from multiple threads.
+  void unpack() const {
+    if (this->unpacked.load(std::memory_order_acquire)) return;
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->unpacked.load(std::memory_order_relaxed)) return;
+    // Numbers appended later are added to values as well, without reallocating
+    this->values.reserve(this->numbers.capacity());
+    this->values.assign(this->numbers.begin(), this->numbers.end());
+    this->unpacked.store(true, std::memory_order_release);
+  }
+
+  // Elements while packed
+  std::vector<double> numbers;
+  // Elements when not packed, created on demand from numbers otherwise
+  mutable vec_t values;
+  bool packed;
+  mutable std::atomic<bool> unpacked;
+  // Guards unpacking and appending to data shared by several vectors
+  mutable std::mutex mutex;
+};
+
+inline const VectorType::vec_t &VectorType::vec() const
+{
+  if (!this->ptr) return emptyVec();
+  if (this->ptr->packed) this->ptr->unpack();
+  return this->ptr->values;
+}
+
+inline bool VectorType::isNumeric() const { return !this->ptr || this->ptr->packed; }
+
+inline const double *VectorType::numbers() const
+{
+  assert(isNumeric());
+  return this->ptr ? this->ptr->numbers.data() : nullptr;
+}
+
 void utf8_split(const std::string& str, std::function<void(ValuePtr)> f);
@@ -33,6 +33,7 @@
 #include <QSettings>
 #include <boost/algorithm/string.hpp>
 #include "../engine/GeometryCache.h"
+#include "../engine/DiskCache.h"
 #include "AutoUpdater.h"
 #include "../engine/feature.h"
 #ifdef ENABLE_CGAL
@@ -141,6 +142,9 @@ void Preferences::init() {
 	this->defaultmap["advanced/cgalCacheSize"] = qulonglong(CGALCache::instance()->maxSizeMB())*1024*1024;
 	this->defaultmap["advanced/cgalCacheSizeMB"] = getValue("advanced/cgalCacheSize").toULongLong()/(1024*1024); // carry over old settings if they exist
 #endif
+	this->defaultmap["advanced/diskCacheDir"] = "";
+	this->defaultmap["advanced/diskCacheSizeMB"] = qulonglong(DiskCache::instance()->maxSizeMB());
+	this->defaultmap["advanced/renderThreads"] = 1;
 	this->defaultmap["advanced/openCSGLimit"] = RenderSettings::inst()->openCSGTermLimit;
 	this->defaultmap["advanced/forceGoldfeather"] = false;
 	this->defaultmap["advanced/undockableWindows"] = false;
@@ -194,6 +198,8 @@ void Preferences::init() {
 	this->cgalCacheSizeMBEdit->setValidator(memvalidator);
 #endif
 	this->polysetCacheSizeMBEdit->setValidator(memvalidator);
+	this->diskCacheSizeMBEdit->setValidator(memvalidator);
+	this->renderThreadsEdit->setValidator(validator);
 	this->opencsgLimitEdit->setValidator(validator);
 	this->timeThresholdOnRenderCompleteSoundEdit->setValidator(validator);
 	this->lineEditCharacterThreshold->setValidator(validator1);
@@ -470,6 +476,28 @@ void Preferences::on_polysetCacheSizeMBEdit_textChanged(const QString &text)
 	GeometryCache::instance()->setMaxSizeMB(text.toULong());
 }
 
+void Preferences::on_diskCacheDirEdit_editingFinished()
+{
+	QSettingsCached settings;
+	const auto dir = this->diskCacheDirEdit->text();
+	settings.setValue("advanced/diskCacheDir", dir);
+	DiskCache::instance()->setDirectory(dir.toStdString());
+}
+
+void Preferences::on_diskCacheSizeMBEdit_textChanged(const QString &text)
+{
+	QSettingsCached settings;
+	settings.setValue("advanced/diskCacheSizeMB", text);
+	DiskCache::instance()->setMaxSizeMB(text.toULong());
+}
+
+void Preferences::on_renderThreadsEdit_textChanged(const QString &text)
+{
+	// Applied when the next render starts
+	QSettingsCached settings;
+	settings.setValue("advanced/renderThreads", text);
+}
+
 void Preferences::on_opencsgLimitEdit_textChanged(const QString &text)
 {
 	QSettingsCached settings;
@@ -903,6 +931,9 @@ void Preferences::updateGUI()
 	BlockSignals<QCheckBox *>(this->enableOpenCSGBox)->setChecked(getValue("advanced/enable_opencsg_opengl1x").toBool());
 	BlockSignals<QLineEdit *>(this->cgalCacheSizeMBEdit)->setText(getValue("advanced/cgalCacheSizeMB").toString());
 	BlockSignals<QLineEdit *>(this->polysetCacheSizeMBEdit)->setText(getValue("advanced/polysetCacheSizeMB").toString());
+	BlockSignals<QLineEdit *>(this->diskCacheDirEdit)->setText(getValue("advanced/diskCacheDir").toString());
+	BlockSignals<QLineEdit *>(this->diskCacheSizeMBEdit)->setText(getValue("advanced/diskCacheSizeMB").toString());
+	BlockSignals<QLineEdit *>(this->renderThreadsEdit)->setText(getValue("advanced/renderThreads").toString());
 	BlockSignals<QLineEdit *>(this->opencsgLimitEdit)->setText(getValue("advanced/openCSGLimit").toString());
 	BlockSignals<QCheckBox *>(this->localizationCheckBox)->setChecked(getValue("advanced/localization").toBool());
 	BlockSignals<QCheckBox *>(this->autoReloadRaiseCheckBox)->setChecked(getValue("advanced/autoReloadRaise").toBool());
@@ -36,6 +36,9 @@ public slots:
 	void on_enableOpenCSGBox_toggled(bool);
 	void on_cgalCacheSizeMBEdit_textChanged(const QString &);
 	void on_polysetCacheSizeMBEdit_textChanged(const QString &);
+	void on_diskCacheDirEdit_editingFinished();
+	void on_diskCacheSizeMBEdit_textChanged(const QString &);
+	void on_renderThreadsEdit_textChanged(const QString &);
 	void on_opencsgLimitEdit_textChanged(const QString &);
 	void on_forceGoldfeatherBox_toggled(bool);
 	void on_mouseWheelZoomBox_toggled(bool);
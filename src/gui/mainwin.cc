@@ -28,7 +28,11 @@
 #include "../engine/comment.h"
 #include "openscad.h"
 #include "../engine/GeometryCache.h"
+#include "../engine/DiskCache.h"
+#include "../common/ThreadPool.h"
 #include "../engine/ModuleCache.h"
+#include "../engine/FunctionCache.h"
+#include "../engine/ASTOptimizer.h"
 #include "MainWindow.h"
 #include "OpenSCADApp.h"
 #include "../engine/parsersettings.h"
@@ -197,6 +201,7 @@ MainWindow::MainWindow(const QStringList &filenames)
 	knownFileExtensions["dxf"] = importStatement;
 	knownFileExtensions["svg"] = importStatement;
 	knownFileExtensions["amf"] = importStatement;
+	knownFileExtensions["scadmesh"] = importStatement;
 	knownFileExtensions["dat"] = surfaceStatement;
 	knownFileExtensions["png"] = surfaceStatement;
 	knownFileExtensions["scad"] = "";
@@ -752,6 +757,8 @@ void MainWindow::loadDesignSettings()
 	auto cgalCacheSizeMB = Preferences::inst()->getValue("advanced/cgalCacheSizeMB").toUInt();
 	CGALCache::instance()->setMaxSizeMB(cgalCacheSizeMB);
 #endif
+	DiskCache::instance()->setMaxSizeMB(Preferences::inst()->getValue("advanced/diskCacheSizeMB").toUInt());
+	DiskCache::instance()->setDirectory(Preferences::inst()->getValue("advanced/diskCacheDir").toString().toStdString());
 }
 
 void MainWindow::updateUndockMode(bool undockMode)
@@ -1152,6 +1159,11 @@ void MainWindow::instantiateRoot()
 		this->processEvents();
 
 		AbstractNode::resetIndexCounter();
+		// Results of the previous design's functions would only take up space
+		FunctionCache::instance()->clear();
+		if (Feature::ExperimentalParallelFor.is_enabled()) {
+			ThreadPool::instance()->setNumThreads(Preferences::inst()->getValue("advanced/renderThreads").toUInt());
+		}
 
 		// split these two lines - gcc 4.7 bug
 		auto mi = ModuleInstantiation( "group" );
@@ -1741,6 +1753,7 @@ void MainWindow::parseTopLevelDocument(bool rebuildParameterWidget)
 		CommentParser::collectParameters(fulltext,this->root_module);
 		this->parameterWidget->setParameters(this->root_module,rebuildParameterWidget);
 		this->parameterWidget->applyParameters(this->root_module);
+		if (Feature::ExperimentalAstOptimizer.is_enabled()) optimize_ast(*this->root_module);
 		customizerEditor = activeEditor;
 		this->parameterWidget->setEnabled(true);
 		this->activeEditor->setIndicator(this->root_module->indicatorData);
@@ -2089,6 +2102,7 @@ void MainWindow::cgalRender()
 
 	progress_report_prep(this->root_node, report_func, this);
 
+	ThreadPool::instance()->setNumThreads(Preferences::inst()->getValue("advanced/renderThreads").toUInt());
 	this->cgalworker->start(this->tree);
 }
 
@@ -2098,6 +2112,7 @@ void MainWindow::actionRenderDone(shared_ptr<const Geometry> root_geom)
 	std::chrono::milliseconds ms{this->renderingTime.elapsed()};
 	if (root_geom) {
 		RenderStatistic::printCacheStatistic();
+		RenderStatistic::printPruningStatistic();
 		RenderStatistic::printRenderingTime(ms);
 		if (!root_geom->isEmpty()) {
 			RenderStatistic().print(*root_geom);
@@ -28,6 +28,7 @@
 #include "engine/comment.h"
 #include "engine/node.h"
 #include "engine/FileModule.h"
+#include "engine/ASTOptimizer.h"
 #include "engine/ModuleInstantiation.h"
 #include "engine/builtincontext.h"
 #include "engine/value.h"
@@ -41,7 +42,13 @@
 #include "common/PlatformUtils.h"
 #include "gui/LibraryInfo.h"
 #include "engine/nodedumper.h"
+#include "engine/nodehasher.h"
+#include "engine/DiskCache.h"
+#include "common/ThreadPool.h"
 #include "engine/stackcheck.h"
+#include "engine/Profiler.h"
+#include "engine/Trace.h"
+#include "engine/stacksegment.h"
 #include "osx/CocoaUtils.h"
 #include "gui/FontCache.h"
 #include "renderer/OffscreenView.h"
@@ -425,6 +432,10 @@ int cmdline(const char *deps_output_file, const std::string &filename, const std
     
 	root_module->handleDependencies();
 
+	if (Feature::ExperimentalAstOptimizer.is_enabled() || curFormat == FileFormat::OPTIMIZED_AST) {
+		optimize_ast(*root_module);
+	}
+
 	auto fpath = fs::absolute(fs::path(filename));
 	auto fparent = fpath.parent_path();
 	fs::current_path(fparent);
@@ -432,7 +443,10 @@ int cmdline(const char *deps_output_file, const std::string &filename, const std
 
 	AbstractNode::resetIndexCounter();
 	ContextHandle<FileContext> filectx{Context::create<FileContext>(top_ctx.ctx)};
-	absolute_root_node = root_module->instantiateWithFileContext(filectx.ctx, &root_inst, nullptr);
+	{
+		Trace::Span span("evaluate", "evaluate ", filename);
+		absolute_root_node = root_module->instantiateWithFileContext(filectx.ctx, &root_inst, nullptr);
+	}
 	camera.updateView(filectx.ctx);
 
 	// Do we have an explicit root node (! modifier)?
@@ -469,7 +483,7 @@ int cmdline(const char *deps_output_file, const std::string &filename, const std
 			fs::current_path(original_path);
 		}
 	}
-	else if (curFormat == FileFormat::AST) {
+	else if (curFormat == FileFormat::AST || curFormat == FileFormat::OPTIMIZED_AST) {
 		std::ofstream fstream(new_output_file);
 		if (!fstream.is_open()) {
 			LOG(message_group::None, Location::NONE, "", "Can't open file \"%1$s\" for export", new_output_file);
@@ -509,6 +523,7 @@ int cmdline(const char *deps_output_file, const std::string &filename, const std
 #ifdef ENABLE_CGAL
 		// start measuring render time
 		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		auto span = std::make_unique<Trace::Span>("render", "render");
 		if ((curFormat == FileFormat::PNG) && (viewOptions.renderer == RenderType::OPENCSG || viewOptions.renderer == RenderType::THROWNTOGETHER)) {
 			// OpenCSG or throwntogether png -> just render a preview
 			glview = prepare_preview(tree, viewOptions, camera);
@@ -536,7 +551,9 @@ int cmdline(const char *deps_output_file, const std::string &filename, const std
 		}
 
 		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		span.reset();
 		RenderStatistic::printCacheStatistic();
+		RenderStatistic::printPruningStatistic();
 		RenderStatistic::printRenderingTime( std::chrono::duration_cast<std::chrono::milliseconds>(end-begin) );
 		if (root_geom && !root_geom->isEmpty()) {
 			RenderStatistic().print(*root_geom);
@@ -548,7 +565,8 @@ int cmdline(const char *deps_output_file, const std::string &filename, const std
             curFormat == FileFormat::AMF ||
             curFormat == FileFormat::_3MF ||
             curFormat == FileFormat::NEFDBG ||
-            curFormat == FileFormat::NEF3 )
+            curFormat == FileFormat::NEF3 ||
+            curFormat == FileFormat::SCADMESH )
         {
             if(!checkAndExport(root_geom, 3, curFormat, new_output_file)) {
                 return 1;
@@ -920,7 +938,7 @@ int main(int argc, char **argv)
 	po::options_description desc("Allowed options");
 	desc.add_options()
 		("export-format", po::value<string>(), "overrides format of exported scad file when using option '-o', arg can be any of its supported file extensions.  For ascii stl export, specify 'asciistl', and for binary stl export, specify 'binstl'.  Ascii export is the current stl default, but binary stl is planned as the future default so asciistl should be explicitly specified in scripts when needed.\n")
-		("o,o", po::value<vector<string>>(), "output specified file instead of running the GUI, the file extension specifies the type: stl, off, amf, 3mf, csg, dxf, svg, pdf, png, echo, ast, term, nef3, nefdbg (May be used multiple time for different exports). Use '-' for stdout\n")
+		("o,o", po::value<vector<string>>(), "output specified file instead of running the GUI, the file extension specifies the type: stl, off, amf, 3mf, scadmesh, csg, dxf, svg, pdf, png, echo, ast, term, nef3, nefdbg (May be used multiple time for different exports). Use '-' for stdout\n")
 		("D,D", po::value<vector<string>>(), "var=val -pre-define variables")
 		("p,p", po::value<string>(), "customizer parameter file")
 		("P,P", po::value<string>(), "customizer parameter set")
@@ -958,6 +976,13 @@ int main(int argc, char **argv)
 		("check-parameters", po::value<string>(), "=true/false, configure the parameter check for user modules and functions")
 		("check-parameter-ranges", po::value<string>(), "=true/false, configure the parameter range check for builtin modules")
 		("debug", po::value<string>(), "special debug info")
+		("cache-dir", po::value<string>(), "=dir -persistent geometry cache directory, shared between runs")
+		("cache-size", po::value<unsigned int>(), "=n -limit the persistent geometry cache to n MB")
+		("render-threads", po::value<unsigned int>(), "=n -evaluate independent subtrees on n threads when rendering, and loop iterations with --enable=parallel-for, 0 for one per core (default 1)")
+		("stack-segments", po::value<unsigned int>(), "=n -continue deep recursion on up to n more stacks, 0 to stop at the stack limit (default 8)")
+		("profile", po::value<string>()->implicit_value("profile.json"), "[=file] -print time, calls and allocations per function and module, and write each call as Chrome trace events to file (default profile.json)")
+		("trace", po::value<string>()->implicit_value("trace.json"), "[=file] -write the time spent parsing, evaluating, rendering each node, converting to and from CGAL and exporting as Chrome trace events to file (default trace.json)")
+		("verify-cache-keys", "compare full node dumps on geometry cache hits to detect cache key collisions (slow, for testing)")
 		("s,s", po::value<string>(), "stl_file deprecated, use -o")
 		("x,x", po::value<string>(), "dxf_file deprecated, use -o")
 		;
@@ -996,6 +1021,32 @@ int main(int argc, char **argv)
 	if (vm.count("hardwarnings")) {
 		OpenSCAD::hardwarnings = true;
 	}
+
+	if (vm.count("verify-cache-keys")) {
+		NodeKey::verify = true;
+	}
+
+	if (vm.count("cache-size")) {
+		DiskCache::instance()->setMaxSizeMB(vm["cache-size"].as<unsigned int>());
+	}
+	if (vm.count("cache-dir")) {
+		DiskCache::instance()->setDirectory(vm["cache-dir"].as<string>());
+	}
+	if (vm.count("render-threads")) {
+		ThreadPool::instance()->setNumThreads(vm["render-threads"].as<unsigned int>());
+	}
+	if (vm.count("stack-segments")) {
+		StackSegment::setMaxSegments(vm["stack-segments"].as<unsigned int>());
+	}
+	vector<string> trace_files;
+	if (vm.count("trace")) trace_files.push_back(vm["trace"].as<string>());
+	if (vm.count("profile")) {
+		trace_files.push_back(vm["profile"].as<string>());
+		Profiler::enable();
+	}
+	if (!trace_files.empty()) {
+		Trace::enable();
+	}
 	
 	std::map<std::string, bool*> flags;
 	flags.insert(std::make_pair("check-parameters",&OpenSCAD::parameterCheck));
@@ -1135,11 +1186,24 @@ int main(int argc, char **argv)
 		} catch (const HardWarningException &) {
 			rc = 1;
 		}
+		if (!trace_files.empty()) {
+			const auto docPath = fs::absolute(fs::path(inputFiles[0])).parent_path().string();
+			if (Profiler::enabled()) Profiler::print(docPath);
+			for (const auto &trace_file : trace_files) {
+				if (!Trace::write(trace_file, docPath)) {
+					LOG(message_group::Error,Location::NONE,"","Can't write trace to '%1$s'",trace_file);
+					rc = 1;
+				}
+			}
+		}
 	}
 	else if (QtUseGUI()) {
 		if(vm.count("export-format")) {
 			LOG(message_group::None,Location::NONE,"","Ignoring --export-format option");
 		}
+		if (vm.count("profile") || vm.count("trace")) {
+			LOG(message_group::None,Location::NONE,"","Ignoring --profile and --trace options");
+		}
 		rc = gui(inputFiles, original_path, argc, argv);
 	}
 	else {
@@ -33,6 +33,7 @@
 #include "../common/fileutils.h"
 #include "../engine/evalcontext.h"
 #include "../engine/handle_dep.h"
+#include "../engine/parallelfor.h"
 #include "../engine/math/degree_trig.h"
 
 #include <cmath>
@@ -47,6 +48,7 @@ namespace fs = boost::filesystem;
 
 ValuePtr builtin_dxf_dim(const std::shared_ptr<Context> ctx, const std::shared_ptr<EvalContext> evalctx)
 {
+	ParallelFor::checkSafe();
 	std::string rawFilename;
 	std::string filename;
 	std::string layername;
@@ -155,6 +157,7 @@ ValuePtr builtin_dxf_dim(const std::shared_ptr<Context> ctx, const std::shared_p
 
 ValuePtr builtin_dxf_cross(const std::shared_ptr<Context> ctx, const std::shared_ptr<EvalContext> evalctx)
 {
+	ParallelFor::checkSafe();
 	std::string filename;
 	std::string rawFilename;
 	std::string layername;
@@ -28,6 +28,7 @@
 #include "../engine/math/polyset.h"
 #include "../common/printutils.h"
 #include "../engine/math/Geometry.h"
+#include "../engine/Trace.h"
 
 #include <fstream>
 
@@ -41,6 +42,7 @@
 
 bool canPreview(const FileFormat format) {
 	return (format == FileFormat::AST ||
+					format == FileFormat::OPTIMIZED_AST ||
 					format == FileFormat::CSG ||
 					format == FileFormat::ECHO ||
 					format == FileFormat::TERM ||
@@ -80,6 +82,9 @@ void exportFile(const shared_ptr<const Geometry> &root_geom, std::ostream &outpu
 	case FileFormat::NEF3:
 		export_nef3(root_geom, output);
 		break;
+	case FileFormat::SCADMESH:
+		export_scadmesh(root_geom, output);
+		break;
 	default:
 		assert(false && "Unknown file format");
 	}
@@ -96,7 +101,8 @@ void exportFileByNameStdout(const shared_ptr<const Geometry> &root_geom, const E
 void exportFileByNameStream(const shared_ptr<const Geometry> &root_geom, const ExportInfo& exportInfo)
 {
 	std::ios::openmode mode = std::ios::out | std::ios::trunc;
-	if (exportInfo.format == FileFormat::_3MF || exportInfo.format == FileFormat::STL || exportInfo.format == FileFormat::PDF) {
+	if (exportInfo.format == FileFormat::_3MF || exportInfo.format == FileFormat::STL || exportInfo.format == FileFormat::PDF ||
+			exportInfo.format == FileFormat::SCADMESH) {
 		mode |= std::ios::binary;
 	}
 	std::ofstream fstream(exportInfo.name2open, mode);
@@ -123,6 +129,7 @@ void exportFileByNameStream(const shared_ptr<const Geometry> &root_geom, const E
 
 void exportFileByName(const shared_ptr<const Geometry> &root_geom, const ExportInfo& exportInfo)
 {
+	Trace::Span span("export", "export ", exportInfo.name2display);
 	if (exportInfo.useStdOut) {
 		exportFileByNameStdout(root_geom, exportInfo);
 	} else {
@@ -134,12 +141,21 @@ namespace Export {
 
 ExportMesh::ExportMesh(const PolySet &ps)
 {
+	// Equal vertices may still have different indices in the PolySet, so
+	// merge them by value, but only look up each shared vertex once.
+	std::vector<int> vertexIndices(ps.vertices.size(), -1);
+	auto lookup = [&](int idx) {
+		if (vertexIndices[idx] < 0) {
+			const auto &v = ps.vertices[idx];
+			auto pos = vertexMap.emplace(std::make_pair<std::array<double, 3>, int>({v.x(), v.y(), v.z()}, vertexMap.size()));
+			vertexIndices[idx] = pos.first->second;
+		}
+		return vertexIndices[idx];
+	};
+
 	std::vector<std::array<int, 3>> triangleIndices;
-	for (const auto &p : ps.polygons) {
-		auto pos1 = vertexMap.emplace(std::make_pair<std::array<double, 3>, int>({p[0].x(), p[0].y(), p[0].z()}, vertexMap.size()));
-		auto pos2 = vertexMap.emplace(std::make_pair<std::array<double, 3>, int>({p[1].x(), p[1].y(), p[1].z()}, vertexMap.size()));
-		auto pos3 = vertexMap.emplace(std::make_pair<std::array<double, 3>, int>({p[2].x(), p[2].y(), p[2].z()}, vertexMap.size()));
-		triangleIndices.push_back({pos1.first->second, pos2.first->second, pos3.first->second});
+	for (const auto &face : ps.indices) {
+		triangleIndices.push_back({lookup(face[0]), lookup(face[1]), lookup(face[2])});
 	}
 
 	int index = 0;
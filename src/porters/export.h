@@ -24,10 +24,12 @@ enum class FileFormat {
 	NEF3,
 	CSG,
 	AST,
+	OPTIMIZED_AST,
 	TERM,
 	ECHO,
     PNG,
-    PDF
+    PDF,
+	SCADMESH
 };
 
 struct ExportInfo {
@@ -52,6 +54,7 @@ void export_svg(const shared_ptr<const Geometry> &geom, std::ostream &output);
 void export_pdf(const shared_ptr<const Geometry> &geom, std::ostream &output, const ExportInfo& exportInfo);
 void export_nefdbg(const shared_ptr<const Geometry> &geom, std::ostream &output);
 void export_nef3(const shared_ptr<const Geometry> &geom, std::ostream &output);
+void export_scadmesh(const shared_ptr<const Geometry> &geom, std::ostream &output);
 
 
 // void exportFile(const class Geometry *root_geom, std::ostream &output, FileFormat format);
@@ -73,10 +76,12 @@ struct ExportFileFormatOptions {
 		{"nef3", FileFormat::NEF3},
 		{"csg", FileFormat::CSG},
 		{"ast", FileFormat::AST},
+		{"optimized-ast", FileFormat::OPTIMIZED_AST},
 		{"term", FileFormat::TERM},
 		{"echo", FileFormat::ECHO},
 		{"png", FileFormat::PNG},
         {"pdf", FileFormat::PDF},
+		{"scadmesh", FileFormat::SCADMESH},
 	};
 };
 
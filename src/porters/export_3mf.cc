@@ -40,6 +40,11 @@ using namespace NMR;
 #include "../engine/CGAL_Nef_polyhedron.h"
 #include "../engine/cgal.h"
 #include "../engine/cgalutils.h"
+#include "../engine/Tree.h"
+#include "../engine/transformnode.h"
+#include "../engine/colornode.h"
+#include "../engine/feature.h"
+#include <unordered_map>
 
 static uint32_t lib3mf_write_callback(const char *data, uint32_t bytes, std::ostream *stream)
 {
@@ -63,18 +68,18 @@ static void export_3mf_error(const std::string msg, PLib3MFModel *&model)
 }
 
 /*
- * PolySet must be triangulated.
+ * PolySet must be triangulated. Returns nullptr on error.
  */
-static bool append_polyset(const PolySet &ps, PLib3MFModelMeshObject *&model)
+static PLib3MFModelMeshObject *add_mesh(const PolySet &ps, PLib3MFModelMeshObject *&model)
 {
 	PLib3MFModelMeshObject *mesh;
 	if (lib3mf_model_addmeshobject(model, &mesh) != LIB3MF_OK) {
 		export_3mf_error("Can't add mesh to 3MF model.", model);
-		return false;
+		return nullptr;
 	}
 	if (lib3mf_object_setnameutf8(mesh, "OpenSCAD Model") != LIB3MF_OK) {
 		export_3mf_error("Can't set name for 3MF model.", model);
-		return false;
+		return nullptr;
 	}
 
 	auto vertexFunc = [&](const std::array<double, 3>& coords) -> bool {
@@ -91,23 +96,42 @@ static bool append_polyset(const PolySet &ps, PLib3MFModelMeshObject *&model)
 
 	if (!exportMesh.foreach_vertex(vertexFunc)) {
 		export_3mf_error("Can't add vertex to 3MF model.", model);
-		return false;
+		return nullptr;
 	}
 
 	if (!exportMesh.foreach_triangle(triangleFunc)) {
 		export_3mf_error("Can't add triangle to 3MF model.", model);
-		return false;
+		return nullptr;
 	}
 
+	return mesh;
+}
+
+/*
+ * Places the mesh, with the transformation if given.
+ */
+static bool add_builditem(PLib3MFModelMeshObject *mesh, const Transform3d *matrix, PLib3MFModelMeshObject *&model)
+{
+	MODELTRANSFORM transform;
+	if (matrix) {
+		for (int i = 0; i < 3; ++i) {
+			for (int j = 0; j < 4; ++j) transform.m_fFields[i][j] = (FLOAT)(*matrix)(i, j);
+		}
+	}
 	PLib3MFModelBuildItem *builditem;
-	if (lib3mf_model_addbuilditem(model, mesh, nullptr, &builditem) != LIB3MF_OK) {
+	if (lib3mf_model_addbuilditem(model, mesh, matrix ? &transform : nullptr, &builditem) != LIB3MF_OK) {
 		export_3mf_error("Can't add build item to 3MF model.", model);
 		return false;
 	}
-
 	return true;
 }
 
+static bool append_polyset(const PolySet &ps, PLib3MFModelMeshObject *&model)
+{
+	PLib3MFModelMeshObject *mesh = add_mesh(ps, model);
+	return mesh && add_builditem(mesh, nullptr, model);
+}
+
 static bool append_nef(const CGAL_Nef_polyhedron &root_N, PLib3MFModelMeshObject *&model)
 {
 	if (!root_N.p3) {
@@ -153,6 +177,69 @@ static bool append_3mf(const shared_ptr<const Geometry> &geom, PLib3MFModelMeshO
 	return true;
 }
 
+/*
+ * Finds the subtree a top-level object places: the node below any
+ * transformations, groups with a single child and colors, which don't
+ * change the geometry. matrix is set to the combined transformation.
+ */
+static const AbstractNode *find_instance(const AbstractNode *node, Transform3d &matrix)
+{
+	matrix = Transform3d::Identity();
+	while (node->children.size() == 1) {
+		if (const auto transform = dynamic_cast<const TransformNode *>(node)) matrix = matrix * transform->matrix;
+		else if (!dynamic_cast<const GroupNode *>(node) && !dynamic_cast<const ListNode *>(node) &&
+						 !dynamic_cast<const ColorNode *>(node)) break;
+		node = node->children.front();
+	}
+	return node;
+}
+
+/*
+ * Writes each top-level object as a build item. Objects which are the same
+ * subtree, i.e. have the same cache key, under different transformations
+ * share a single mesh, which is placed by the transformation of each
+ * build item.
+ */
+static bool append_instances(const GeometryList &geomlist, PLib3MFModelMeshObject *&model)
+{
+	std::unordered_map<NodeKey, PLib3MFModelMeshObject *> meshes;
+	for (const auto &item : geomlist.getChildren()) {
+		Transform3d matrix;
+		const AbstractNode *node = item.first ? find_instance(item.first, matrix) : nullptr;
+		// Mirrored or flattened objects are written as they are
+		if (!node || !(matrix.matrix().determinant() > 0)) {
+			if (!append_3mf(item.second, model)) return false;
+			continue;
+		}
+
+		const NodeKey key = Tree(item.first).getNodeKey(*node);
+		auto it = meshes.find(key);
+		if (it == meshes.end()) {
+			PolySet ps(3);
+			if (const auto N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(item.second)) {
+				if (!N->p3 || CGALUtils::createPolySetFromNefPolyhedron3(*N->p3, ps)) {
+					export_3mf_error("Error converting NEF Polyhedron.", model);
+					return false;
+				}
+			}
+			else if (const auto instance = dynamic_pointer_cast<const PolySet>(item.second)) {
+				PolysetUtils::tessellate_faces(*instance, ps);
+			}
+			else {
+				if (!append_3mf(item.second, model)) return false;
+				continue;
+			}
+			// The first instance, moved back to where the subtree is
+			ps.transform(matrix.inverse());
+			PLib3MFModelMeshObject *mesh = add_mesh(ps, model);
+			if (!mesh) return false;
+			it = meshes.emplace(key, mesh).first;
+		}
+		if (!add_builditem(it->second, &matrix, model)) return false;
+	}
+	return true;
+}
+
 /*!
     Saves the current 3D Geometry as 3MF to the given file.
     The file must be open.
@@ -178,7 +265,10 @@ void export_3mf(const shared_ptr<const Geometry> &geom, std::ostream &output)
 		return;
 	}
 
-	if (!append_3mf(geom, model)) {
+	const auto geomlist = dynamic_pointer_cast<const GeometryList>(geom);
+	const bool ok = geomlist && Feature::Experimental3mfInstances.is_enabled() ?
+		append_instances(*geomlist, model) : append_3mf(geom, model);
+	if (!ok) {
 		if (model) lib3mf_release(model);
 		return;
 	}
@@ -26,56 +26,40 @@
 
 #include "export.h"
 #include "../engine/math/polyset.h"
-#include "../engine/math/polyset-utils.h"
-#include "dxfdata.h"
+#include "../engine/Reindexer.h"
+#include "../common/ThreadPool.h"
+#include <clocale>
+#include <cstdio>
 
 #ifdef ENABLE_CGAL
 #include "../engine/CGAL_Nef_polyhedron.h"
 #include "../engine/cgal.h"
 #include "../engine/cgalutils.h"
 
-#include "../engine/Reindexer.h"
-#include "../engine/grid.h"
-
-struct IndexedMesh {
-	IndexedMesh() : numfaces(0) {}
+namespace {
 
-	Reindexer<Vector3d> vertices;
-	std::vector<int> indices;
-	size_t numfaces;
-};
+// Lines formatted by each task, the chunks are written in order
+const size_t CHUNK_LINES = 16384;
 
-
-static void append_geometry(const PolySet &ps, IndexedMesh &mesh)
-{
-	for(const auto &p : ps.polygons) {
-		for(const auto &v : p) {
-			mesh.indices.push_back(mesh.vertices.lookup(v));
-		}
-		mesh.numfaces++;
-		mesh.indices.push_back(-1);
-	}
-}
-
-void append_geometry(const shared_ptr<const Geometry> &geom, IndexedMesh &mesh)
+void collect_polysets(const shared_ptr<const Geometry> &geom, std::vector<shared_ptr<const PolySet>> &polysets)
 {
 	if (const auto geomlist = dynamic_pointer_cast<const GeometryList>(geom)) {
 		for (const Geometry::GeometryItem &item : geomlist->getChildren()) {
-			append_geometry(item.second, mesh);
+			collect_polysets(item.second, polysets);
 		}
 	}
 	else if (const auto N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(geom)) {
-		PolySet ps(3);
-		bool err = CGALUtils::createPolySetFromNefPolyhedron3(*(N->p3), ps);
+		auto ps = make_shared<PolySet>(3);
+		bool err = CGALUtils::createPolySetFromNefPolyhedron3(*(N->p3), *ps);
 		if (err) { 
 			LOG(message_group::Error,Location::NONE,"","Nef->PolySet failed");
 		}
 		else {
-			append_geometry(ps, mesh);
+			polysets.push_back(ps);
 		}
 	}
 	else if (const auto ps = dynamic_pointer_cast<const PolySet>(geom)) {
-		append_geometry(*ps, mesh);
+		polysets.push_back(ps);
 	}
 	else if (dynamic_pointer_cast<const Polygon2d>(geom)) {
 		assert(false && "Unsupported file format");
@@ -84,28 +68,98 @@ void append_geometry(const shared_ptr<const Geometry> &geom, IndexedMesh &mesh)
 	}
 }
 
-void export_off(const shared_ptr<const Geometry> &geom, std::ostream &output)
+void append_int(std::string &output, size_t value)
 {
-	IndexedMesh mesh;
-	append_geometry(geom, mesh);
+	char digits[20];
+	int n = 0;
+	do {
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value > 0);
+	while (n > 0) output += digits[--n];
+}
 
-	output << "OFF " << mesh.vertices.size() << " " << mesh.numfaces << " 0\n";
-	const auto& v = mesh.vertices.getArray();
-	size_t numverts = mesh.vertices.size();
-	for (size_t i=0; i<numverts; ++i) {
-		output << v[i][0] << " " << v[i][1] << " " << v[i][2] << " " << "\n";
+/*!
+	Formats count lines with format(buffer, begin, end) in chunks on the
+	render threads, and writes the chunks in order.
+*/
+template <typename F> void write_lines(std::ostream &output, size_t count, const F &format)
+{
+	auto *pool = ThreadPool::instance();
+	const size_t numchunks = pool->isParallel() ? pool->numThreads() * 4 : 1;
+	std::vector<std::string> buffers(numchunks);
+	std::vector<ThreadPool::Task> tasks;
+	for (size_t begin = 0; begin < count; begin += numchunks * CHUNK_LINES) {
+		tasks.clear();
+		for (size_t c = 0; c < numchunks; ++c) {
+			const size_t chunk_begin = std::min(begin + c * CHUNK_LINES, count);
+			const size_t chunk_end = std::min(chunk_begin + CHUNK_LINES, count);
+			auto &buffer = buffers[c];
+			tasks.push_back([&buffer, &format, chunk_begin, chunk_end]() {
+				buffer.clear();
+				format(buffer, chunk_begin, chunk_end);
+			});
+		}
+		pool->run(tasks);
+		for (const auto &buffer : buffers) output.write(buffer.data(), buffer.size());
 	}
-	size_t cnt = 0;
-	for (size_t i=0; i<mesh.numfaces; ++i) {
-		size_t nverts = 0;
-		while (mesh.indices[cnt++] != -1) nverts++;
-		output << nverts;
-		cnt -= nverts + 1;
-		for (size_t n=0; n<nverts; ++n) output << " " << mesh.indices[cnt++];
-		output << "\n";
-        cnt++; // Skip the -1 marker
+}
+
+}
+
+/*!
+	Writes the faces of all PolySets straight from the geometry, with equal
+	vertices merged in order of first use. Only the merged vertices and the
+	index of each PolySet vertex in them are kept besides the geometry.
+*/
+void export_off(const shared_ptr<const Geometry> &geom, std::ostream &output)
+{
+	std::vector<shared_ptr<const PolySet>> polysets;
+	collect_polysets(geom, polysets);
+
+	Reindexer<Vector3d> vertices;
+	std::vector<std::vector<int>> vertexmaps(polysets.size());
+	size_t numfaces = 0;
+	for (size_t i = 0; i < polysets.size(); ++i) {
+		const auto &ps = *polysets[i];
+		auto &vertexmap = vertexmaps[i];
+		vertexmap.assign(ps.vertices.size(), -1);
+		for (const auto &face : ps.indices) {
+			for (const auto idx : face) {
+				if (vertexmap[idx] < 0) vertexmap[idx] = vertices.lookup(ps.vertices[idx]);
+			}
+		}
+		numfaces += ps.indices.size();
 	}
 
+	setlocale(LC_NUMERIC, "C"); // Ensure radix is . (not ,) in output
+	output << "OFF " << vertices.size() << " " << numfaces << " 0\n";
+	// Formatted the same as by the stream
+	const int precision = int(output.precision());
+	const auto &v = vertices.getArray();
+	write_lines(output, v.size(), [&v, precision](std::string &buffer, size_t begin, size_t end) {
+		char line[128];
+		for (size_t i = begin; i < end; ++i) {
+			const int length = snprintf(line, sizeof(line), "%.*g %.*g %.*g \n", precision, v[i][0], precision, v[i][1], precision, v[i][2]);
+			buffer.append(line, std::min<size_t>(length, sizeof(line) - 1));
+		}
+	});
+	for (size_t i = 0; i < polysets.size(); ++i) {
+		const auto &ps = *polysets[i];
+		const auto &vertexmap = vertexmaps[i];
+		write_lines(output, ps.indices.size(), [&ps, &vertexmap](std::string &buffer, size_t begin, size_t end) {
+			for (size_t f = begin; f < end; ++f) {
+				const auto &face = ps.indices[f];
+				append_int(buffer, face.size());
+				for (const auto idx : face) {
+					buffer += ' ';
+					append_int(buffer, vertexmap[idx]);
+				}
+				buffer += '\n';
+			}
+		});
+	}
+	setlocale(LC_NUMERIC, "");      // Set default locale
 }
 
 #endif // ENABLE_CGAL
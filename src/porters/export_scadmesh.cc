@@ -0,0 +1,119 @@
+#include "export.h"
+#include "scadmesh.h"
+#include "../engine/math/polyset.h"
+#include "../engine/math/hash.h"
+#include "../common/printutils.h"
+
+#include <cstring>
+#include <limits>
+
+#ifdef ENABLE_CGAL
+#include "../engine/CGAL_Nef_polyhedron.h"
+#include "../engine/cgalutils.h"
+#endif
+
+namespace {
+
+template <typename T> void put(char *&p, T value)
+{
+	value = ScadMesh::little_endian(value);
+	memcpy(p, &value, sizeof(value));
+	p += sizeof(value);
+}
+
+}
+
+namespace ScadMesh {
+
+void write(const PolySet &ps, std::ostream &output, const Source *source)
+{
+	size_t num_indices = 0;
+	for (const auto &face : ps.indices) num_indices += face.size();
+	if (num_indices > std::numeric_limits<uint32_t>::max()) {
+		LOG(message_group::Export_Error,Location::NONE,"","Mesh has more than 4294967295 vertex indices, which the scadmesh format can't store");
+		return;
+	}
+
+	std::string body(ps.vertices.size() * 3 * sizeof(double) + (ps.indices.size() + num_indices) * sizeof(uint32_t), '\0');
+	char *p = &body[0];
+	for (const auto &v : ps.vertices) {
+		for (int i = 0; i < 3; ++i) put(p, v[i]);
+	}
+	uint32_t end = 0;
+	for (const auto &face : ps.indices) put(p, end += face.size());
+	for (const auto &face : ps.indices) {
+		for (const auto idx : face) put(p, uint32_t(idx));
+	}
+
+	Header header{};
+	memcpy(header.magic, MAGIC, sizeof(header.magic));
+	header.version = little_endian(VERSION);
+	uint32_t flags = 0;
+	header.num_vertices = little_endian(uint64_t(ps.vertices.size()));
+	header.num_faces = little_endian(uint64_t(ps.indices.size()));
+	header.num_indices = little_endian(uint64_t(num_indices));
+	if (source) {
+		flags |= SOURCE;
+		header.source_size = little_endian(source->size);
+		header.source_mtime = little_endian(source->mtime);
+	}
+	const auto digest = hash128(body.data(), body.size());
+	header.hash[0] = little_endian(digest.first);
+	header.hash[1] = little_endian(digest.second);
+	const auto bbox = ps.getBoundingBox();
+	if (!bbox.isEmpty()) {
+		flags |= BOUNDING_BOX;
+		for (int i = 0; i < 3; ++i) {
+			header.bbox[i] = little_endian(bbox.min()[i]);
+			header.bbox[i + 3] = little_endian(bbox.max()[i]);
+		}
+	}
+	header.flags = little_endian(flags);
+
+	output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	output.write(body.data(), body.size());
+}
+
+}
+
+#ifdef ENABLE_CGAL
+
+static void append_polyset(const shared_ptr<const Geometry> &geom, PolySet &ps)
+{
+	if (const auto geomlist = dynamic_pointer_cast<const GeometryList>(geom)) {
+		for (const Geometry::GeometryItem &item : geomlist->getChildren()) {
+			append_polyset(item.second, ps);
+		}
+	}
+	else if (const auto N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(geom)) {
+		PolySet nef_ps(3);
+		if (CGALUtils::createPolySetFromNefPolyhedron3(*(N->p3), nef_ps)) {
+			LOG(message_group::Error,Location::NONE,"","Nef->PolySet failed");
+		}
+		else {
+			ps.append(nef_ps);
+		}
+	}
+	else if (const auto other = dynamic_pointer_cast<const PolySet>(geom)) {
+		ps.append(*other);
+	}
+	else if (dynamic_pointer_cast<const Polygon2d>(geom)) {
+		assert(false && "Unsupported file format");
+	} else {
+		assert(false && "Not implemented");
+	}
+}
+
+void export_scadmesh(const shared_ptr<const Geometry> &geom, std::ostream &output)
+{
+	if (const auto ps = dynamic_pointer_cast<const PolySet>(geom)) {
+		ScadMesh::write(*ps, output);
+	}
+	else {
+		PolySet ps(3);
+		append_polyset(geom, ps);
+		ScadMesh::write(ps, output);
+	}
+}
+
+#endif // ENABLE_CGAL
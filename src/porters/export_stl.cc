@@ -26,8 +26,11 @@
 
 #include "export.h"
 #include "../engine/math/polyset.h"
-#include "../engine/math/polyset-utils.h"
+#include "../engine/math/GeometryUtils.h"
+#include "../engine/Reindexer.h"
+#include "../common/ThreadPool.h"
 #include "dxfdata.h"
+#include <cstring>
 
 #ifdef ENABLE_CGAL
 #include "../engine/CGAL_Nef_polyhedron.h"
@@ -36,110 +39,233 @@
 
 namespace {
 
-std::string toString(const Vector3d &v)
+// Polygons formatted by each task, the chunks are written in order
+const size_t CHUNK_POLYGONS = 16384;
+// Longest vertex formatted with %.6g: three times "-1.23457e+38" and two spaces
+const size_t VERTEX_TEXT_SIZE = 48;
+
+/*!
+	The vertices of a PolySet as exported: rounded to float, with equal ones
+	merged, the same as PolysetUtils::tessellate_faces() does. For ASCII
+	files, each vertex is also formatted once, and read back to compute the
+	normals from the numbers written.
+*/
+struct StlVertices
 {
-	return STR(v[0] << " " << v[1] << " " << v[2]);
+	std::vector<Vector3f> vertices;
+	// Index in vertices by PolySet vertex
+	std::vector<int> indices;
+	std::vector<char> text;
+	std::vector<uint8_t> text_length;
+	std::vector<Vector3d> written;
+
+	const char *getText(int i) const { return &this->text[i * VERTEX_TEXT_SIZE]; }
+	bool equalText(int i, int j) const {
+		return this->text_length[i] == this->text_length[j] && !memcmp(getText(i), getText(j), this->text_length[i]);
+	}
+};
+
+struct StlChunk
+{
+	size_t begin, end;
+	std::string output;
+	size_t triangle_count;
+	size_t degenerate_polygons;
+	// Reused for each polygon
+	std::vector<IndexedFace> faces;
+	std::vector<IndexedTriangle> triangles;
+};
+
+void append_float(std::string &output, float f)
+{
+	static_assert(sizeof(float)==4, "Need 32 bit float");
+	char data[4];
+	const char *fbeg = reinterpret_cast<const char *>(&f);
+	uint16_t test = 0x0001;
+	if (*reinterpret_cast<char *>(&test) == 1) {
+		std::copy(fbeg, fbeg+4, data);
+	}
+	else {
+		std::reverse_copy(fbeg, fbeg+4, data);
+	}
+	output.append(data, 4);
 }
 
-Vector3d fromString(const std::string &vertexString)
+void append_vector(std::string &output, const Vector3f &v)
 {
-	Vector3d v;
-	std::istringstream stream{vertexString};
-	stream >> v[0] >> v[1] >> v[2];
-	return v;
+	for (int i = 0; i < 3; ++i) append_float(output, v[i]);
 }
 
-void write_vector(std::ostream &output, const Vector3f& v) {
-    for (int i=0; i<3; ++i) {
-        static_assert(sizeof(float)==4, "Need 32 bit float");
-        float f = v[i];
-        char *fbeg = reinterpret_cast<char *>(&f);
-        char data[4];
+// Formats like std::ostream with the given precision, as in the "C" locale set by export_stl()
+void append_double(std::string &output, double d, int precision)
+{
+	char buffer[64];
+	const int length = snprintf(buffer, sizeof(buffer), "%.*g", precision, d);
+	output.append(buffer, std::min<size_t>(length, sizeof(buffer) - 1));
+}
 
-        uint16_t test = 0x0001;
-        if (*reinterpret_cast<char *>(&test) == 1) {
-            std::copy(fbeg, fbeg+4, data);
-        }
-        else {
-            std::reverse_copy(fbeg, fbeg+4, data);
-        }
-        output.write(data, 4);
-    }
+void append_triangle(const StlVertices &vertices, const IndexedTriangle &t, StlChunk &chunk, bool binary, int precision)
+{
+	chunk.triangle_count++;
+	auto &output = chunk.output;
+	if (binary) {
+		const Vector3f &p0 = vertices.vertices[t[0]];
+		const Vector3f &p1 = vertices.vertices[t[1]];
+		const Vector3f &p2 = vertices.vertices[t[2]];
+
+		// Ensure 3 distinct vertices.
+		if ((p0 != p1) && (p0 != p2) && (p1 != p2)) {
+			Vector3f normal = (p1 - p0).cross(p2 - p0);
+			normal.normalize();
+			if (!is_finite(normal) || is_nan(normal)) {
+				// Collinear vertices.
+				normal << 0, 0, 0;
+			}
+			append_vector(output, normal);
+		}
+		append_vector(output, p0);
+		append_vector(output, p1);
+		append_vector(output, p2);
+		output.append(2, '\0');
+	}
+	else if (!vertices.equalText(t[0], t[1]) && !vertices.equalText(t[0], t[2]) && !vertices.equalText(t[1], t[2])) {
+		// The above condition ensures that there are 3 distinct
+		// vertices, but they may be collinear. If they are, the unit
+		// normal is meaningless so the default value of "0 0 0" can
+		// be used. If the vertices are not collinear then the unit
+		// normal must be calculated from the components.
+		output += "  facet normal ";
+		const Vector3d &p0 = vertices.written[t[0]];
+		const Vector3d &p1 = vertices.written[t[1]];
+		const Vector3d &p2 = vertices.written[t[2]];
+		Vector3d normal = (p1 - p0).cross(p2 - p0);
+		normal.normalize();
+		if (is_finite(normal) && !is_nan(normal)) {
+			append_double(output, normal[0], precision);
+			output += ' ';
+			append_double(output, normal[1], precision);
+			output += ' ';
+			append_double(output, normal[2], precision);
+			output += '\n';
+		}
+		else {
+			output += "0 0 0\n";
+		}
+		output += "    outer loop\n";
+		for (int i = 0; i < 3; ++i) {
+			output += "      vertex ";
+			output.append(vertices.getText(t[i]), vertices.text_length[t[i]]);
+			output += '\n';
+		}
+		output += "    endloop\n";
+		output += "  endfacet\n";
+	}
 }
 
-	
+/*!
+	Tessellates and formats the polygons of a chunk, one at a time, the same
+	way as PolysetUtils::tessellate_faces().
+*/
+void append_polygons(const PolySet &ps, const StlVertices &vertices, StlChunk &chunk, bool binary, int precision)
+{
+	chunk.output.clear();
+	chunk.triangle_count = 0;
+	chunk.degenerate_polygons = 0;
+	for (size_t i = chunk.begin; i < chunk.end; ++i) {
+		const auto &pgon = ps.indices[i];
+		if (pgon.size() < 3) {
+			chunk.degenerate_polygons++;
+			continue;
+		}
+		chunk.faces.resize(1);
+		auto &face = chunk.faces[0];
+		face.clear();
+		for (const auto v : pgon) {
+			// Remove consecutive duplicate vertices
+			auto idx = vertices.indices[v];
+			if (face.empty() || idx != face.back()) face.push_back(idx);
+		}
+		if (face.front() == face.back()) face.pop_back();
+		if (face.size() < 3) continue; // Cull empty triangles
+
+		if (face.size() == 3) {
+			append_triangle(vertices, IndexedTriangle(face[0], face[1], face[2]), chunk, binary, precision);
+		}
+		else {
+			chunk.triangles.clear();
+			if (!GeometryUtils::tessellatePolygonWithHoles(vertices.vertices, chunk.faces, chunk.triangles, nullptr)) {
+				for (const auto &t : chunk.triangles) append_triangle(vertices, t, chunk, binary, precision);
+			}
+		}
+	}
+}
+
+/*!
+	Writes the facets of a PolySet, tessellating its polygons on the fly.
+	Chunks of polygons are formatted on the render threads, and written in
+	order, so the output is the same as formatting them one by one.
+*/
 size_t append_stl(const PolySet &ps, std::ostream &output, bool binary)
 {
-    size_t triangle_count = 0;
-    PolySet triangulated(3);
-    PolysetUtils::tessellate_faces(ps, triangulated);
-
-	for(const auto &p : triangulated.polygons) {
-		assert(p.size() == 3); // STL only allows triangles
-        triangle_count++;
-
-        if (binary) {
-            Vector3f p0 = p[0].cast<float>();
-            Vector3f p1 = p[1].cast<float>();
-            Vector3f p2 = p[2].cast<float>();
-
-            // Ensure 3 distinct vertices.
-            if ((p0 != p1) && (p0 != p2) && (p1 != p2)) {
-                Vector3f normal = (p1 - p0).cross(p2 - p0);
-                normal.normalize();
-                if (!is_finite(normal) || is_nan(normal)) {
-                    // Collinear vertices.
-                    normal << 0, 0, 0;
-                }
-                write_vector(output, normal);
-            }
-            write_vector(output, p0);
-            write_vector(output, p1);
-            write_vector(output, p2);
-            char attrib[2] = {0,0};
-            output.write(attrib, 2);
-        }
-        else { // ascii
-            std::array<std::string, 3> vertexStrings;
-            std::transform(p.cbegin(), p.cend(), vertexStrings.begin(),
-                toString);
-
-            if (vertexStrings[0] != vertexStrings[1] &&
-                vertexStrings[0] != vertexStrings[2] &&
-                vertexStrings[1] != vertexStrings[2]) {
-
-                // The above condition ensures that there are 3 distinct
-                // vertices, but they may be collinear. If they are, the unit
-                // normal is meaningless so the default value of "0 0 0" can
-                // be used. If the vertices are not collinear then the unit
-                // normal must be calculated from the components.
-                output << "  facet normal ";
-
-                Vector3d p0 = fromString(vertexStrings[0]);
-                Vector3d p1 = fromString(vertexStrings[1]);
-                Vector3d p2 = fromString(vertexStrings[2]);
-
-                Vector3d normal = (p1 - p0).cross(p2 - p0);
-                normal.normalize();
-                if (is_finite(normal) && !is_nan(normal)) {
-                    output << normal[0] << " " << normal[1] << " " << normal[2]
-                      << "\n";
-                }
-                else {
-                    output << "0 0 0\n";
-                }
-                output << "    outer loop\n";
-
-                for (const auto &vertexString : vertexStrings) {
-                    output << "      vertex " << vertexString << "\n";
-                }
-                output << "    endloop\n";
-                output << "  endfacet\n";
-            }
-        }
-    }
+	StlVertices vertices;
+	Reindexer<Vector3f> allVertices;
+	vertices.indices.reserve(ps.vertices.size());
+	for (const auto &v : ps.vertices) vertices.indices.push_back(allVertices.lookup(v.cast<float>()));
+	vertices.vertices = allVertices.getArray();
 
-    return triangle_count;
+	auto *pool = ThreadPool::instance();
+	const size_t numchunks = pool->isParallel() ? pool->numThreads() * 4 : 1;
+	std::vector<ThreadPool::Task> tasks;
+
+	const size_t numvertices = vertices.vertices.size();
+	if (!binary) {
+		vertices.text.resize(numvertices * VERTEX_TEXT_SIZE);
+		vertices.text_length.resize(numvertices);
+		vertices.written.resize(numvertices);
+		for (size_t c = 0; c < numchunks; ++c) {
+			tasks.push_back([&vertices, numvertices, numchunks, c]() {
+				for (size_t i = numvertices * c / numchunks; i < numvertices * (c + 1) / numchunks; ++i) {
+					const Vector3d v = vertices.vertices[i].cast<double>();
+					char *text = &vertices.text[i * VERTEX_TEXT_SIZE];
+					const int length = snprintf(text, VERTEX_TEXT_SIZE, "%.6g %.6g %.6g", v[0], v[1], v[2]);
+					vertices.text_length[i] = std::min<size_t>(length, VERTEX_TEXT_SIZE - 1);
+					// Normals are computed from the numbers as written
+					char *end;
+					for (int j = 0; j < 3; ++j) {
+						vertices.written[i][j] = strtod(text, &end);
+						text = end;
+					}
+				}
+			});
+		}
+		pool->run(tasks);
+	}
+
+	const int precision = int(output.precision());
+	std::vector<StlChunk> chunks(numchunks);
+	size_t triangle_count = 0, degenerate_polygons = 0;
+	for (size_t begin = 0; begin < ps.indices.size(); begin += numchunks * CHUNK_POLYGONS) {
+		tasks.clear();
+		for (size_t c = 0; c < numchunks; ++c) {
+			auto &chunk = chunks[c];
+			chunk.begin = std::min(begin + c * CHUNK_POLYGONS, ps.indices.size());
+			chunk.end = std::min(chunk.begin + CHUNK_POLYGONS, ps.indices.size());
+			tasks.push_back([&ps, &vertices, &chunk, binary, precision]() {
+				append_polygons(ps, vertices, chunk, binary, precision);
+			});
+		}
+		pool->run(tasks);
+		for (const auto &chunk : chunks) {
+			output.write(chunk.output.data(), chunk.output.size());
+			triangle_count += chunk.triangle_count;
+			degenerate_polygons += chunk.degenerate_polygons;
+		}
+	}
+	if (degenerate_polygons > 0) {
+		LOG(message_group::Warning,Location::NONE,"","PolySet has degenerate polygons");
+	}
+
+	return triangle_count;
 }
 
 /*!
@@ -25,6 +25,7 @@
  */
 
 #include "import.h"
+#include "scadmesh.h"
 #include "engine/importnode.h"
 
 #include "engine/module.h"
@@ -43,6 +44,7 @@
 #include "../engine/handle_dep.h"
 #include "../common/boost-utils.h"
 #include <sys/types.h>
+#include <fstream>
 #include <sstream>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
@@ -102,6 +104,7 @@ AbstractNode *ImportModule::instantiate(const std::shared_ptr<Context>& ctx, con
 		else if (ext == ".3mf") actualtype = ImportType::_3MF;
 		else if (ext == ".amf") actualtype = ImportType::AMF;
 		else if (ext == ".svg") actualtype = ImportType::SVG;
+		else if (ext == ScadMesh::EXTENSION) actualtype = ImportType::SCADMESH;
 	}
 
 	auto node = new ImportNode(inst, evalctx, actualtype);
@@ -159,6 +162,43 @@ AbstractNode *ImportModule::instantiate(const std::shared_ptr<Context>& ctx, con
 	return node;
 }
 
+/*
+	With the import-cache feature, imported 3D meshes are written to a
+	.scadmesh file next to the imported file, together with its size and
+	modification time. While these still match, the cache is read instead.
+*/
+static bool is_cached_type(ImportType type)
+{
+	return type == ImportType::STL || type == ImportType::OFF || type == ImportType::AMF || type == ImportType::_3MF;
+}
+
+static bool get_cache_source(const std::string &filename, ScadMesh::Source &source)
+{
+	boost::system::error_code ec;
+	const auto size = fs::file_size(filename, ec);
+	if (ec) return false;
+	const auto mtime = fs::last_write_time(filename, ec);
+	if (ec) return false;
+	source = {uint64_t(size), int64_t(mtime)};
+	return true;
+}
+
+static void write_cache(const PolySet &ps, const std::string &cachefile, const ScadMesh::Source &source)
+{
+	// Renamed once complete, so other instances never read a partial file
+	boost::system::error_code ec;
+	const auto tmpfile = fs::unique_path(cachefile + ".%%%%-%%%%.tmp", ec);
+	if (!ec) {
+		std::ofstream stream(tmpfile.string(), std::ios::out | std::ios::trunc | std::ios::binary);
+		ScadMesh::write(ps, stream, &source);
+		stream.close();
+		if (stream) fs::rename(tmpfile, cachefile, ec);
+		if (!stream || ec) fs::remove(tmpfile, ec);
+		else return;
+	}
+	LOG(message_group::Warning,Location::NONE,"","Can't write import cache '%1$s'",cachefile);
+}
+
 /*!
 	Will return an empty geometry if the import failed, but not nullptr
 */
@@ -167,6 +207,17 @@ const Geometry *ImportNode::createGeometry() const
 	Geometry *g = nullptr;
 	auto loc = this->modinst->location();
 
+	ScadMesh::Source source;
+	const std::string cachefile = this->filename + ScadMesh::EXTENSION;
+	const bool cache = Feature::ExperimentalImportCache.is_enabled() && is_cached_type(this->type) &&
+		get_cache_source(this->filename, source);
+	if (cache) {
+		if (PolySet *ps = ScadMesh::read(cachefile, loc, &source)) {
+			ps->setConvexity(this->convexity);
+			return ps;
+		}
+	}
+
 	switch (this->type) {
 	case ImportType::STL: {
 		g = import_stl(this->filename, loc);
@@ -184,6 +235,10 @@ const Geometry *ImportNode::createGeometry() const
 		g = import_off(this->filename, loc);
 		break;
 	}
+	case ImportType::SCADMESH: {
+		g = import_scadmesh(this->filename, loc);
+		break;
+	}
 	case ImportType::SVG: {
 		g = import_svg(this->filename, this->dpi, this->center, loc);
  		break;
@@ -205,6 +260,10 @@ const Geometry *ImportNode::createGeometry() const
 	}
 
 	if (g) g->setConvexity(this->convexity);
+	if (cache) {
+		const auto ps = dynamic_cast<const PolySet *>(g);
+		if (ps && !ps->isEmpty()) write_cache(*ps, cachefile, source);
+	}
 	return g;
 }
 
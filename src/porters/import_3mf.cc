@@ -152,27 +152,25 @@ Geometry * import_3mf(const std::string &filename, const Location &loc)
 		PRINTDB("%s: mesh %d, vertex count: %lu, triangle count: %lu", filename.c_str() % mesh_idx % vertex_count % triangle_count);
 
 		PolySet *p = new PolySet(3);
+		// 3MF meshes are indexed already, so vertices map one to one
+		p->vertices.reserve(vertex_count);
+		for (DWORD idx = 0; idx < vertex_count; ++idx) {
+			MODELMESHVERTEX vertex;
+			if (lib3mf_meshobject_getvertex(object, idx, &vertex) != LIB3MF_OK) {
+				return import_3mf_error(model, object_it, first_mesh, p);
+			}
+			p->add_vertex(Vector3d(vertex.m_fPosition[0], vertex.m_fPosition[1], vertex.m_fPosition[2]));
+		}
+		p->indices.reserve(triangle_count);
 		for (DWORD idx = 0; idx < triangle_count; ++idx) {
 			MODELMESHTRIANGLE triangle;
 			if (lib3mf_meshobject_gettriangle(object, idx, &triangle) != LIB3MF_OK) {
 				return import_3mf_error(model, object_it, first_mesh, p);
 			}
-			
-			MODELMESHVERTEX vertex1, vertex2, vertex3;
-			if (lib3mf_meshobject_getvertex(object, triangle.m_nIndices[0], &vertex1) != LIB3MF_OK) {
-				return import_3mf_error(model, object_it, first_mesh, p);
-			}
-			if (lib3mf_meshobject_getvertex(object, triangle.m_nIndices[1], &vertex2) != LIB3MF_OK) {
-				return import_3mf_error(model, object_it, first_mesh, p);
-			}
-			if (lib3mf_meshobject_getvertex(object, triangle.m_nIndices[2], &vertex3) != LIB3MF_OK) {
+			if (triangle.m_nIndices[0] >= vertex_count || triangle.m_nIndices[1] >= vertex_count || triangle.m_nIndices[2] >= vertex_count) {
 				return import_3mf_error(model, object_it, first_mesh, p);
 			}
-			
-			p->append_poly();
-			p->append_vertex(vertex1.m_fPosition[0], vertex1.m_fPosition[1], vertex1.m_fPosition[2]);
-			p->append_vertex(vertex2.m_fPosition[0], vertex2.m_fPosition[1], vertex2.m_fPosition[2]);
-			p->append_vertex(vertex3.m_fPosition[0], vertex3.m_fPosition[1], vertex3.m_fPosition[2]);
+			p->append_poly(IndexedFace{int(triangle.m_nIndices[0]), int(triangle.m_nIndices[1]), int(triangle.m_nIndices[2])});
 		}
 
 		if (first_mesh) {
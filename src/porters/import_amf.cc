@@ -64,7 +64,6 @@ private:
 	
 	double x, y, z;
 	int idx_v1, idx_v2, idx_v3;
-	std::vector<Eigen::Vector3d> vertex_list;
 
 	std::map<const std::string, cb_func> funcs;
 	std::map<const std::string, cb_func> start_funcs;
@@ -143,14 +142,14 @@ void AmfImporter::end_object(AmfImporter *importer, const xmlChar *)
 {
 	PRINTDB("AMF: add object %d", importer->polySets.size());
 	importer->polySets.push_back(importer->polySet);
-	importer->vertex_list.clear();
 	importer->polySet = nullptr;
 }
 
 void AmfImporter::end_vertex(AmfImporter *importer, const xmlChar *)
 {
-	PRINTDB("AMF: add vertex %d - (%.2f, %.2f, %.2f)", importer->vertex_list.size() % importer->x % importer->y % importer->z);
-	importer->vertex_list.push_back(Eigen::Vector3d(importer->x, importer->y, importer->z));
+	if (!importer->polySet) return;
+	PRINTDB("AMF: add vertex %d - (%.2f, %.2f, %.2f)", importer->polySet->vertices.size() % importer->x % importer->y % importer->z);
+	importer->polySet->add_vertex(Vector3d(importer->x, importer->y, importer->z));
 }
 
 void AmfImporter::end_triangle(AmfImporter *importer, const xmlChar *)
@@ -158,14 +157,18 @@ void AmfImporter::end_triangle(AmfImporter *importer, const xmlChar *)
 	int idx_v1 = importer->idx_v1;
 	int idx_v2 = importer->idx_v2;
 	int idx_v3 = importer->idx_v3;
-	PRINTDB("AMF: add triangle %d - (%.2f, %.2f, %.2f)", importer->vertex_list.size() % idx_v1 % idx_v2 % idx_v3);
-
-	std::vector<Eigen::Vector3d> &v = importer->vertex_list;
-	
-	importer->polySet->append_poly();
-	importer->polySet->append_vertex(v[idx_v1].x(), v[idx_v1].y(), v[idx_v1].z());
-	importer->polySet->append_vertex(v[idx_v2].x(), v[idx_v2].y(), v[idx_v2].z());
-	importer->polySet->append_vertex(v[idx_v3].x(), v[idx_v3].y(), v[idx_v3].z());
+	if (!importer->polySet) return;
+	const int numvertices = importer->polySet->vertices.size();
+	PRINTDB("AMF: add triangle %d - (%.2f, %.2f, %.2f)", numvertices % idx_v1 % idx_v2 % idx_v3);
+
+	// The object's vertices map directly to the PolySet's vertices
+	for (const auto idx : {idx_v1, idx_v2, idx_v3}) {
+		if (idx < 0 || idx >= numvertices) {
+			LOG(message_group::Warning,Location::NONE,"","AMF triangle refers to undefined vertex %1$d, import() at line %2$d",idx,importer->loc.firstLine());
+			return;
+		}
+	}
+	importer->polySet->append_poly(IndexedFace{idx_v1, idx_v2, idx_v3});
 }
 
 void AmfImporter::processNode(xmlTextReaderPtr reader)
@@ -260,7 +263,6 @@ PolySet * AmfImporter::read(const std::string filename)
 	end_funcs[triangle] = end_triangle;
 	end_funcs[object] = end_object;
 	streamFile(filename.c_str());
-	vertex_list.clear();
 
 	PolySet *p = nullptr;
 #ifdef ENABLE_CGAL
@@ -1,28 +1,269 @@
 #include "import.h"
+#include "parseutils.h"
 #include "../engine/math/polyset.h"
 #include "../common/printutils.h"
+#include "../common/ThreadPool.h"
 #include "../engine/AST.h"
-#ifdef ENABLE_CGAL
-#include "../engine/cgalutils.h"
-#endif
+#include "../common/boost-utils.h"
 
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+using namespace ParseUtils;
+
+namespace {
+
+/*!
+	Lines of a part of the file. The vertices and faces are parsed straight
+	into the PolySet, once the number of lines before each chunk is known.
+*/
+struct Chunk
+{
+	const char *begin, *end;
+	// Lines with data, and the number of those before the chunk
+	size_t lines = 0;
+	size_t first_line = 0;
+	bool bad_vertices = false;
+	// Lines which can't be parsed, and whether each is a vertex
+	std::vector<std::pair<bool, std::string>> bad_lines;
+};
+
+// End of the data on a line, before any comment
+const char *content_end(const char *p, const char *eol)
+{
+	const char *comment = static_cast<const char *>(memchr(p, '#', eol - p));
+	return comment ? comment : eol;
+}
+
+// Finds the next token in the header, which may span lines and have comments
+bool next_token(const char *&p, const char *end, const char *&token)
+{
+	while (true) {
+		p = skip_space(p, end);
+		if (p == end) return false;
+		if (*p != '#') break;
+		p = line_end(p, end);
+	}
+	token = p;
+	p = token_end(p, end);
+	return true;
+}
+
+bool parse_index(const char *begin, const char *end, uint64_t &result)
+{
+	if (begin == end || end - begin > 18) return false;
+	result = 0;
+	for (const char *p = begin; p < end; ++p) {
+		if (*p < '0' || *p > '9') return false;
+		result = result * 10 + (*p - '0');
+	}
+	return true;
+}
+
+/*!
+	The header is "OFF" with optional prefixes: ST for texture coordinates,
+	C for colors, N for normals, 4 for homogeneous coordinates and n for a
+	dimension which follows. Only the coordinates are read.
+*/
+bool parse_keyword(const char *begin, const char *end, bool &homogeneous, bool &dimension)
+{
+	if (end - begin < 3 || memcmp(end - 3, "OFF", 3)) return false;
+	end -= 3;
+	for (const char *prefix : {"ST", "C", "N", "4", "n"}) {
+		const size_t length = strlen(prefix);
+		if (size_t(end - begin) >= length && !memcmp(begin, prefix, length)) {
+			if (*prefix == '4') homogeneous = true;
+			if (*prefix == 'n') dimension = true;
+			begin += length;
+		}
+	}
+	return begin == end;
+}
+
+bool parse_vertex(const char *p, const char *end, bool homogeneous, Vector3d &v)
+{
+	double coords[4];
+	const int count = homogeneous ? 4 : 3;
+	for (int i = 0; i < count; ++i) {
+		const char *number = skip_space(p, end);
+		p = token_end(number, end);
+		if (!parse_double(number, p, coords[i])) return false;
+	}
+	v = Vector3d(coords[0], coords[1], coords[2]);
+	if (homogeneous) v /= coords[3];
+	return true;
+}
+
+bool parse_face(const char *p, const char *end, uint64_t numvertices, IndexedFace &face)
+{
+	const char *token = skip_space(p, end);
+	p = token_end(token, end);
+	uint64_t size;
+	if (!parse_index(token, p, size) || size < 3 || size > uint64_t(end - p)) return false;
+	face.resize(size);
+	for (auto &idx : face) {
+		token = skip_space(p, end);
+		p = token_end(token, end);
+		uint64_t i;
+		if (!parse_index(token, p, i) || i >= numvertices) return false;
+		idx = int(i);
+	}
+	return true;
+}
+
+void count_lines(Chunk &chunk)
+{
+	for (const char *p = chunk.begin; p < chunk.end;) {
+		const char *eol = line_end(p, chunk.end);
+		if (skip_space(p, content_end(p, eol)) < content_end(p, eol)) chunk.lines++;
+		p = eol + 1;
+	}
+}
+
+void parse_lines(Chunk &chunk, bool homogeneous, PolySet &ps)
+{
+	const size_t numvertices = ps.vertices.size(), numlines = numvertices + ps.indices.size();
+	size_t line = chunk.first_line;
+	for (const char *p = chunk.begin; p < chunk.end && line < numlines;) {
+		const char *eol = line_end(p, chunk.end);
+		const char *data_end = content_end(p, eol);
+		const char *data = skip_space(p, data_end);
+		if (data < data_end) {
+			bool ok;
+			if (line < numvertices) {
+				ok = parse_vertex(data, data_end, homogeneous, ps.vertices[line]);
+				if (!ok) chunk.bad_vertices = true;
+			}
+			else {
+				auto &face = ps.indices[line - numvertices];
+				ok = parse_face(data, data_end, numvertices, face);
+				// Faces left empty are removed
+				if (!ok) face.clear();
+			}
+			if (!ok) {
+				while (data_end > data && is_space(*(data_end - 1))) --data_end;
+				chunk.bad_lines.emplace_back(line < numvertices, std::string(data, data_end));
+			}
+			line++;
+		}
+		p = eol + 1;
+	}
+}
+
+std::vector<Chunk> split(const char *begin, const char *end)
+{
+	const size_t n = num_chunks(end - begin);
+	std::vector<Chunk> chunks(n);
+	const char *p = begin;
+	for (size_t i = 0; i < n; ++i) {
+		chunks[i].begin = p;
+		if (i + 1 == n) p = end;
+		else p = std::max(p, std::min(line_end(begin + (end - begin) * (i + 1) / n, end) + 1, end));
+		chunks[i].end = p;
+	}
+	return chunks;
+}
+
+}
+
+/*!
+	Reads an ASCII OFF file. The file is memory mapped and split into
+	chunks at line starts. The chunks are parsed concurrently if rendering
+	uses more than one thread: first counting the lines with data in each,
+	then parsing each line straight into its vertex or face of the PolySet,
+	which is allocated from the counts in the header.
+*/
 PolySet *import_off(const std::string &filename, const Location &loc)
 {
 	PolySet *p = new PolySet(3);
-#ifdef ENABLE_CGAL
-	CGAL_Polyhedron poly;
-	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
-	if (!file.good()) {
+
+	boost::interprocess::mapped_region region;
+	try {
+		boost::interprocess::file_mapping file(filename.c_str(), boost::interprocess::read_only);
+		region = boost::interprocess::mapped_region(file, boost::interprocess::read_only);
+	}
+	catch (const boost::interprocess::interprocess_exception &) {
 		LOG(message_group::Warning,Location::NONE,"","Can't open import file '%1$s', import() at line %2$d",filename,loc.firstLine());
+		return p;
+	}
+	const char *data = static_cast<const char *>(region.get_address());
+	const char *end = data + region.get_size();
+
+	const char *pos = data, *token, *counts_end = data;
+	uint64_t counts[3];
+	bool homogeneous = false, dimension = false, ok = next_token(pos, end, token);
+	// The keyword is optional
+	if (ok && !parse_index(token, pos, counts[0])) {
+		ok = parse_keyword(token, pos, homogeneous, dimension);
+		const char *binary = pos, *next;
+		if (ok && next_token(binary, end, next) && token_equals(next, binary, "BINARY")) {
+			LOG(message_group::Warning,Location::NONE,"","Binary OFF files are not supported, import() at line %1$d",loc.firstLine());
+			return p;
+		}
+		uint64_t numdims = 3;
+		if (ok && dimension) ok = next_token(pos, end, token) && parse_index(token, pos, numdims);
+		if (ok && numdims != 3) {
+			LOG(message_group::Warning,Location::NONE,"","Only 3D OFF files are supported, import() at line %1$d",loc.firstLine());
+			return p;
+		}
+		ok = ok && next_token(pos, end, token);
+	}
+	for (int i = 0; i < 3 && ok; ++i) {
+		if (i > 0) ok = next_token(pos, end, token);
+		ok = ok && parse_index(token, pos, counts[i]);
+		counts_end = pos;
+	}
+	if (!ok) {
+		LOG(message_group::Warning,Location::NONE,"","Can't parse OFF header of '%1$s', import() at line %2$d",filename,loc.firstLine());
+		return p;
+	}
+	const uint64_t numvertices = counts[0], numfaces = counts[1];
+	// Each vertex and face takes a line
+	if (numvertices > INT_MAX || numvertices + numfaces > uint64_t(end - data)) {
+		LOG(message_group::Warning,Location::NONE,"","OFF file '%1$s' is truncated, import() at line %2$d",filename,loc.firstLine());
+		return p;
+	}
+
+	std::vector<Chunk> chunks = split(std::min(line_end(counts_end, end) + 1, end), end);
+	std::vector<ThreadPool::Task> tasks;
+	for (auto &chunk : chunks) tasks.push_back([&chunk]() { count_lines(chunk); });
+	ThreadPool::instance()->run(tasks);
+
+	size_t lines = 0;
+	for (auto &chunk : chunks) {
+		chunk.first_line = lines;
+		lines += chunk.lines;
+	}
+	if (lines < numvertices + numfaces) {
+		LOG(message_group::Warning,Location::NONE,"","OFF file '%1$s' is truncated, import() at line %2$d",filename,loc.firstLine());
+		if (lines < numvertices) return p;
+	}
+	p->vertices.resize(numvertices);
+	p->indices.resize(std::min<size_t>(numfaces, lines - numvertices));
+
+	tasks.clear();
+	for (auto &chunk : chunks) {
+		tasks.push_back([&chunk, homogeneous, p]() { parse_lines(chunk, homogeneous, *p); });
+	}
+	ThreadPool::instance()->run(tasks);
+
+	bool bad_vertices = false;
+	for (const auto &chunk : chunks) {
+		for (const auto &line : chunk.bad_lines) {
+			LOG(message_group::Warning,Location::NONE,"","Can't parse %1$s line '%2$s', import() at line %3$d",line.first ? "vertex" : "face",line.second,loc.firstLine());
+		}
+		bad_vertices |= chunk.bad_vertices;
 	}
-	else {
-		file >> poly;
-		file.close();
-		CGALUtils::createPolySetFromPolyhedron(poly, *p);
+	if (bad_vertices) {
+		p->vertices.clear();
+		p->indices.clear();
+		return p;
 	}
-#else
-	LOG(message_group::Warning,Location::NONE,"","OFF import requires CGAL, import() at line %2$d",filename,loc.firstLine());
-#endif
+	p->indices.erase(std::remove_if(p->indices.begin(), p->indices.end(), [](const IndexedFace &face) {
+		return face.empty();
+	}), p->indices.end());
 	return p;
 }
-	
@@ -0,0 +1,132 @@
+#include "import.h"
+#include "scadmesh.h"
+#include "../engine/math/polyset.h"
+#include "../engine/math/hash.h"
+#include "../common/printutils.h"
+
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace {
+
+template <typename T> T get(const char *p)
+{
+	T value;
+	memcpy(&value, p, sizeof(value));
+	return ScadMesh::little_endian(value);
+}
+
+}
+
+namespace ScadMesh {
+
+/*!
+	The vertices are copied as a block, so apart from checking the file,
+	the cost of reading it is creating the faces of the PolySet. The bounding
+	box is taken from the header instead of computed from the vertices.
+*/
+PolySet *read(const std::string &filename, const Location &loc, const Source *source)
+{
+	boost::interprocess::mapped_region region;
+	try {
+		boost::interprocess::file_mapping file(filename.c_str(), boost::interprocess::read_only);
+		region = boost::interprocess::mapped_region(file, boost::interprocess::read_only);
+	}
+	catch (const boost::interprocess::interprocess_exception &) {
+		if (!source) {
+			LOG(message_group::Warning,Location::NONE,"","Can't open import file '%1$s', import() at line %2$d",filename,loc.firstLine());
+		}
+		return nullptr;
+	}
+	const char *data = static_cast<const char *>(region.get_address());
+	const size_t size = region.get_size();
+
+	const auto invalid = [&](const char *reason) -> PolySet * {
+		if (!source) {
+			LOG(message_group::Warning,Location::NONE,"","Can't import '%1$s', %2$s, import() at line %3$d",filename,reason,loc.firstLine());
+		}
+		return nullptr;
+	};
+
+	if (size < sizeof(Header) || memcmp(data, MAGIC, sizeof(MAGIC))) return invalid("not a scadmesh file");
+	const uint32_t version = get<uint32_t>(data + offsetof(Header, version));
+	if (version != VERSION) return invalid("unsupported scadmesh version");
+	const uint32_t flags = get<uint32_t>(data + offsetof(Header, flags));
+	if (source) {
+		const Source cached{get<uint64_t>(data + offsetof(Header, source_size)), get<int64_t>(data + offsetof(Header, source_mtime))};
+		if (!(flags & SOURCE) || !(cached == *source)) return nullptr;
+	}
+
+	// Each count is at most the size of the file, so the sums can't overflow
+	const uint64_t num_vertices = get<uint64_t>(data + offsetof(Header, num_vertices));
+	const uint64_t num_faces = get<uint64_t>(data + offsetof(Header, num_faces));
+	const uint64_t num_indices = get<uint64_t>(data + offsetof(Header, num_indices));
+	if (num_vertices > size || num_faces > size || num_indices > size ||
+			num_vertices > INT_MAX ||
+			sizeof(Header) + num_vertices * 3 * sizeof(double) + (num_faces + num_indices) * sizeof(uint32_t) != size) {
+		return invalid("the file is truncated");
+	}
+	const char *body = data + sizeof(Header);
+	const auto digest = hash128(body, size - sizeof(Header));
+	if (digest.first != get<uint64_t>(data + offsetof(Header, hash)) ||
+			digest.second != get<uint64_t>(data + offsetof(Header, hash) + sizeof(uint64_t))) {
+		return invalid("the file is damaged");
+	}
+
+	const char *face_ends = body + num_vertices * 3 * sizeof(double);
+	const char *indices = face_ends + num_faces * sizeof(uint32_t);
+	std::unique_ptr<PolySet> p(new PolySet(3));
+	p->vertices.resize(num_vertices);
+	static_assert(sizeof(Vector3d) == 3 * sizeof(double), "Vector3d must not be padded");
+#if BOOST_ENDIAN_BIG_BYTE
+	for (uint64_t i = 0; i < num_vertices; ++i) {
+		for (int j = 0; j < 3; ++j) p->vertices[i][j] = get<double>(body + (i * 3 + j) * sizeof(double));
+	}
+#else
+	if (num_vertices > 0) memcpy(p->vertices[0].data(), body, num_vertices * sizeof(Vector3d));
+#endif
+
+	p->indices.resize(num_faces);
+	uint32_t begin = 0;
+	for (uint64_t i = 0; i < num_faces; ++i) {
+		const uint32_t end = get<uint32_t>(face_ends + i * sizeof(uint32_t));
+		if (end < begin || end > num_indices) return invalid("a face is out of range");
+		auto &face = p->indices[i];
+		face.resize(end - begin);
+		for (uint32_t j = begin; j < end; ++j) {
+			const uint32_t idx = get<uint32_t>(indices + j * sizeof(uint32_t));
+			if (idx >= num_vertices) return invalid("a vertex index is out of range");
+			face[j - begin] = idx;
+		}
+		begin = end;
+	}
+	if (begin != num_indices) return invalid("a face is out of range");
+
+	// The header isn't covered by the hash, so only use a box which is
+	// plausible, and contains the first face, else compute it on first use
+	if ((flags & BOUNDING_BOX) && num_faces > 0) {
+		BoundingBox bbox;
+		for (int i = 0; i < 3; ++i) {
+			bbox.min()[i] = get<double>(data + offsetof(Header, bbox) + i * sizeof(double));
+			bbox.max()[i] = get<double>(data + offsetof(Header, bbox) + (i + 3) * sizeof(double));
+		}
+		bool valid = bbox.min().allFinite() && bbox.max().allFinite() && !bbox.isEmpty();
+		for (const auto idx : p->indices[0]) {
+			if (valid) valid = bbox.contains(p->vertices[idx]);
+		}
+		if (valid) p->setBoundingBox(bbox);
+	}
+	return p.release();
+}
+
+}
+
+PolySet *import_scadmesh(const std::string &filename, const Location &loc)
+{
+	PolySet *p = ScadMesh::read(filename, loc);
+	return p ? p : new PolySet(3);
+}
@@ -1,36 +1,31 @@
 #include "import.h"
 #include "../engine/math/polyset.h"
+#include "../engine/Reindexer.h"
 #include "../common/printutils.h"
+#include "../common/ThreadPool.h"
 #include "../engine/AST.h"
+#include "parseutils.h"
 #include "../common/boost-utils.h"
 
-#include <fstream>
+#include <array>
+#include <cstring>
 #include <boost/predef.h>
-#include <boost/regex.hpp>
-#include <boost/lexical_cast.hpp>
-#include <boost/algorithm/string.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 #if !defined(BOOST_ENDIAN_BIG_BYTE_AVAILABLE) && !defined(BOOST_ENDIAN_LITTLE_BYTE_AVAILABLE)
 #error Byte order undefined or unknown. Currently only BOOST_ENDIAN_BIG_BYTE and BOOST_ENDIAN_LITTLE_BYTE are supported.
 #endif
 
-#define STL_FACET_NUMBYTES 4*3*4+2
-// as there is no 'float32_t' standard, we assume the systems 'float'
-// is a 'binary32' aka 'single' standard IEEE 32-bit floating point type
-union stl_facet {
-	uint8_t data8[ STL_FACET_NUMBYTES ];
-	uint32_t data32[4*3];
-	struct facet_data {
-	  float i, j, k;
-	  float x1, y1, z1;
-	  float x2, y2, z2;
-	  float x3, y3, z3;
-	  uint16_t attribute_byte_count;
-	} data;
-};
+using namespace ParseUtils;
+
+namespace {
+
+const size_t STL_HEADER_NUMBYTES = 80 + 4;
+const size_t STL_FACET_NUMBYTES = 4 * 3 * 4 + 2;
 
 #if BOOST_ENDIAN_BIG_BYTE
-static void uint32_byte_swap(uint32_t &x)
+void uint32_byte_swap(uint32_t &x)
 {
 # if __GNUC__ >= 4 && __GNUC_MINOR__ >= 3
 	x = __builtin_bswap32( x );
@@ -48,98 +43,232 @@ static void uint32_byte_swap(uint32_t &x)
 }
 #endif
 
-static void read_stl_facet(std::ifstream &f, stl_facet &facet)
+// STL stores little endian values, which may not be aligned
+uint32_t read_uint32(const char *data)
 {
-	f.read( (char*)facet.data8, STL_FACET_NUMBYTES );
+	uint32_t x;
+	memcpy(&x, data, sizeof(x));
 #if BOOST_ENDIAN_BIG_BYTE
-	for ( int i = 0; i < 12; ++i ) {
-		uint32_byte_swap( facet.data32[ i ] );
-	}
-	// we ignore attribute byte count
+	uint32_byte_swap(x);
 #endif
+	return x;
 }
 
-PolySet *import_stl(const std::string &filename, const Location &loc)
+// as there is no 'float32_t' standard, we assume the systems 'float'
+// is a 'binary32' aka 'single' standard IEEE 32-bit floating point type
+float read_float(const char *data)
 {
-	PolySet *p = new PolySet(3);
+	const uint32_t x = read_uint32(data);
+	float f;
+	memcpy(&f, &x, sizeof(f));
+	return f;
+}
 
-	// Open file and position at the end
-	std::ifstream f(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
-	if (!f.good()) {
-		LOG(message_group::Warning,Location::NONE,"","Can't open import file '%1$s', import() at line %2$d",filename,loc.firstLine());
-		return p;
+/*!
+	Triangles of a part of the file. Vertices are shared within the part
+	while parsing, and between parts once all are parsed.
+*/
+struct Chunk
+{
+	const char *begin, *end;
+	Reindexer<Vector3d> vertices;
+	std::vector<std::array<int, 3>> triangles;
+	std::vector<std::string> bad_lines;
+
+	void add_triangle(const Vector3d &v1, const Vector3d &v2, const Vector3d &v3) {
+		this->triangles.push_back({{this->vertices.lookup(v1), this->vertices.lookup(v2), this->vertices.lookup(v3)}});
 	}
-	
-	boost::regex ex_sfe("solid|facet|endloop");
-	boost::regex ex_outer("outer loop");
-	boost::regex ex_vertex("vertex");
-	boost::regex ex_vertices("\\s*vertex\\s+([^\\s]+)\\s+([^\\s]+)\\s+([^\\s]+)");
-	
-	bool binary = false;
-	std::streampos file_size = f.tellg();
-	f.seekg(80);
-	if (f.good() && !f.eof()) {
-		uint32_t facenum = 0;
-		f.read((char *)&facenum, sizeof(uint32_t));
-#if BOOST_ENDIAN_BIG_BYTE
-		uint32_byte_swap( facenum );
-#endif
-		if (file_size ==  static_cast<std::streamoff>(80 + 4 + 50*facenum)) {
-			binary = true;
+};
+
+/*!
+	Parses the facets of an ASCII STL chunk line by line. Only "vertex"
+	lines and the "outer loop" lines starting a facet matter, everything
+	else, like normals, is skipped.
+*/
+void parse_ascii(Chunk &chunk)
+{
+	// Facets take about 250 characters
+	const size_t facets = (chunk.end - chunk.begin) / 256;
+	chunk.triangles.reserve(facets);
+	chunk.vertices.reserve(facets / 2);
+	int i = 0;
+	double vdata[3][3];
+	for (const char *p = chunk.begin; p < chunk.end;) {
+		const char *eol = line_end(p, chunk.end);
+		const char *word = skip_space(p, eol);
+		const char *word_end = token_end(word, eol);
+		if (token_equals(word, word_end, "outer")) {
+			i = 0;
 		}
-	}
-	f.seekg(0);
-	
-	char data[5];
-	f.read(data, 5);
-	if (!binary && !f.eof() && f.good() && !memcmp(data, "solid", 5)) {
-		int i = 0;
-		double vdata[3][3];
-		std::string line;
-		std::getline(f, line);
-		while (!f.eof()) {
-			std::getline(f, line);
-			boost::trim(line);
-			if (boost::regex_search(line, ex_sfe)) {
-				continue;
+		else if (token_equals(word, word_end, "vertex")) {
+			const char *numbers[3][2];
+			const char *q = word_end;
+			int count = 0;
+			for (; count < 3; ++count) {
+				numbers[count][0] = skip_space(q, eol);
+				numbers[count][1] = q = token_end(numbers[count][0], eol);
+				if (numbers[count][0] == q) break;
 			}
-			if (boost::regex_search(line, ex_outer)) {
-				i = 0;
-				continue;
-			}
-			boost::smatch results;
-			if (boost::regex_search(line, results, ex_vertices)) {
-				try {
-					for (int v=0; v<3; ++v) {
-						vdata[i][v] = boost::lexical_cast<double>(results[v+1]);
-					}
-				}
-				catch (const boost::bad_lexical_cast &blc) {
-					LOG(message_group::Warning,Location::NONE,"","Can't parse vertex line '%1$s', import() at line %2$d",line,loc.firstLine());
+			if (count == 3 && i < 3) {
+				bool ok = true;
+				for (int v = 0; v < 3 && ok; ++v) ok = parse_double(numbers[v][0], numbers[v][1], vdata[i][v]);
+				if (!ok) {
+					// Skip the rest of the facet
+					const char *last = eol;
+					while (last > word && is_space(*(last - 1))) --last;
+					chunk.bad_lines.emplace_back(word, last);
 					i = 10;
-					continue;
 				}
-				if (++i == 3) {
-					p->append_poly();
-					p->append_vertex(vdata[0][0], vdata[0][1], vdata[0][2]);
-					p->append_vertex(vdata[1][0], vdata[1][1], vdata[1][2]);
-					p->append_vertex(vdata[2][0], vdata[2][1], vdata[2][2]);
+				else if (++i == 3) {
+					chunk.add_triangle(Vector3d(vdata[0][0], vdata[0][1], vdata[0][2]),
+														 Vector3d(vdata[1][0], vdata[1][1], vdata[1][2]),
+														 Vector3d(vdata[2][0], vdata[2][1], vdata[2][2]));
 				}
 			}
+			else if (count == 3) {
+				i++;
+			}
 		}
+		p = eol + 1;
+	}
+}
+
+void parse_binary(Chunk &chunk)
+{
+	const size_t facets = (chunk.end - chunk.begin) / STL_FACET_NUMBYTES;
+	chunk.triangles.reserve(facets);
+	// Closed meshes have about half as many vertices as triangles
+	chunk.vertices.reserve(facets / 2);
+	for (const char *p = chunk.begin; p + STL_FACET_NUMBYTES <= chunk.end; p += STL_FACET_NUMBYTES) {
+		// Skip the normal, we ignore the attribute byte count
+		const char *v = p + 3 * 4;
+		chunk.add_triangle(Vector3d(read_float(v), read_float(v + 4), read_float(v + 8)),
+											 Vector3d(read_float(v + 12), read_float(v + 16), read_float(v + 20)),
+											 Vector3d(read_float(v + 24), read_float(v + 28), read_float(v + 32)));
+	}
+}
+
+/*!
+	Returns the start of the first "outer loop" line at or after p. Splitting
+	the file there gives chunks which parse the same as the whole file, as
+	those lines start a new facet.
+*/
+const char *next_facet(const char *p, const char *begin, const char *end)
+{
+	// Start at a line start
+	while (p > begin && p < end && *(p - 1) != '\n') ++p;
+	while (p < end) {
+		const char *eol = line_end(p, end);
+		const char *word = skip_space(p, eol);
+		if (token_equals(word, token_end(word, eol), "outer")) return p;
+		p = eol + 1;
 	}
-	else if (binary && !f.eof() && f.good())
-	{
-		f.ignore(80-5+4);
-		while (1) {
-			stl_facet facet;
-			read_stl_facet( f, facet );
-			if (f.eof()) break;
-			p->append_poly();
-			p->append_vertex(facet.data.x1, facet.data.y1, facet.data.z1);
-			p->append_vertex(facet.data.x2, facet.data.y2, facet.data.z2);
-			p->append_vertex(facet.data.x3, facet.data.y3, facet.data.z3);
+	return end;
+}
+
+std::vector<Chunk> split_ascii(const char *begin, const char *end)
+{
+	const size_t n = num_chunks(end - begin);
+	std::vector<Chunk> chunks(n);
+	const char *p = begin;
+	for (size_t i = 0; i < n; ++i) {
+		chunks[i].begin = p;
+		p = i + 1 == n ? end : std::max(p, next_facet(begin + (end - begin) * (i + 1) / n, begin, end));
+		chunks[i].end = p;
+	}
+	return chunks;
+}
+
+std::vector<Chunk> split_binary(const char *begin, size_t facets)
+{
+	const size_t n = num_chunks(facets * STL_FACET_NUMBYTES);
+	std::vector<Chunk> chunks(n);
+	for (size_t i = 0; i < n; ++i) {
+		chunks[i].begin = begin + facets * i / n * STL_FACET_NUMBYTES;
+		chunks[i].end = begin + facets * (i + 1) / n * STL_FACET_NUMBYTES;
+	}
+	return chunks;
+}
+
+}
+
+/*!
+	Reads an ASCII or binary STL file. The file is memory mapped and split
+	into chunks, which are parsed concurrently if rendering uses more than
+	one thread. Equal vertices are merged while parsing, in the order they
+	first appear in the file, so the result doesn't depend on the number of
+	chunks.
+*/
+PolySet *import_stl(const std::string &filename, const Location &loc)
+{
+	PolySet *p = new PolySet(3);
+
+	boost::interprocess::mapped_region region;
+	try {
+		boost::interprocess::file_mapping file(filename.c_str(), boost::interprocess::read_only);
+		region = boost::interprocess::mapped_region(file, boost::interprocess::read_only);
+	}
+	catch (const boost::interprocess::interprocess_exception &) {
+		// Mapping an empty file fails as well, which has no facets anyway
+		if (!fs::is_regular_file(filename) || fs::file_size(filename) > 0) {
+			LOG(message_group::Warning,Location::NONE,"","Can't open import file '%1$s', import() at line %2$d",filename,loc.firstLine());
 		}
+		return p;
+	}
+	const char *data = static_cast<const char *>(region.get_address());
+	const size_t size = region.get_size();
+
+	bool binary = false;
+	size_t facets = 0;
+	if (size >= STL_HEADER_NUMBYTES) {
+		facets = read_uint32(data + 80);
+		binary = size == STL_HEADER_NUMBYTES + STL_FACET_NUMBYTES * facets;
+	}
+
+	std::vector<Chunk> chunks;
+	if (binary) {
+		chunks = split_binary(data + STL_HEADER_NUMBYTES, facets);
+	}
+	else if (size >= 5 && !memcmp(data, "solid", 5)) {
+		// Skip the "solid name" line
+		const char *end = data + size;
+		chunks = split_ascii(std::min(line_end(data, end) + 1, end), end);
+	}
+
+	std::vector<ThreadPool::Task> tasks;
+	for (auto &chunk : chunks) {
+		tasks.push_back([&chunk, binary]() {
+			if (binary) parse_binary(chunk);
+			else parse_ascii(chunk);
+		});
+	}
+	ThreadPool::instance()->run(tasks);
+
+	// Merging the vertices of each chunk in order gives the same indices as
+	// reading the whole file in one go
+	Reindexer<Vector3d> vertices;
+	size_t triangles = 0;
+	for (const auto &chunk : chunks) triangles += chunk.triangles.size();
+	p->indices.reserve(triangles);
+	for (auto &chunk : chunks) {
+		for (const auto &line : chunk.bad_lines) {
+			LOG(message_group::Warning,Location::NONE,"","Can't parse vertex line '%1$s', import() at line %2$d",line,loc.firstLine());
+		}
+		const auto &local = chunk.vertices.getArray();
+		std::vector<int> indices(local.size());
+		if (chunks.size() == 1) {
+			for (size_t i = 0; i < local.size(); ++i) indices[i] = p->add_vertex(local[i]);
+		}
+		else {
+			for (size_t i = 0; i < local.size(); ++i) indices[i] = vertices.lookup(local[i]);
+		}
+		for (const auto &t : chunk.triangles) {
+			p->append_poly(IndexedFace{indices[t[0]], indices[t[1]], indices[t[2]]});
+		}
+		chunk = Chunk();
+	}
+	if (chunks.size() > 1) {
+		for (const auto &v : vertices.getArray()) p->add_vertex(v);
 	}
 	return p;
 }
@@ -0,0 +1,93 @@
+#include "parseutils.h"
+#include "../common/ThreadPool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <boost/lexical_cast.hpp>
+
+namespace ParseUtils {
+
+namespace {
+
+// Files are split into chunks of at least this size to be parsed in parallel
+const size_t MIN_CHUNK_SIZE = 1 << 20;
+// Chunks per render thread, so threads which finish early can take over some
+const size_t CHUNKS_PER_THREAD = 4;
+
+}
+
+/*!
+	Parses a decimal number like "-1.5e+02", which is all STL and OFF
+	writers produce. Numbers with up to 19 significant digits and a small
+	exponent are exact powers of ten apart from a double, so a single
+	multiplication or division gives the correctly rounded result. Anything
+	else, e.g. longer numbers or "nan", is left to lexical_cast, which the
+	line based STL reader used for every number.
+*/
+bool parse_double(const char *begin, const char *end, double &result)
+{
+	static const double powers[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const char *p = begin;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	bool any_digits = false;
+	for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+		any_digits = true;
+		if (mantissa == 0 && *p == '0') continue;
+		mantissa = mantissa * 10 + (*p - '0');
+		digits++;
+	}
+	if (p < end && *p == '.') {
+		for (++p; p < end && *p >= '0' && *p <= '9'; ++p) {
+			any_digits = true;
+			exponent--;
+			if (mantissa == 0 && *p == '0') continue;
+			mantissa = mantissa * 10 + (*p - '0');
+			digits++;
+		}
+	}
+	if (any_digits && p < end && (*p == 'e' || *p == 'E')) {
+		++p;
+		bool negative_exponent = false;
+		if (p < end && (*p == '-' || *p == '+')) negative_exponent = *p++ == '-';
+		int e = 0;
+		bool exponent_digits = false;
+		for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+			exponent_digits = true;
+			if (e < 10000) e = e * 10 + (*p - '0');
+		}
+		if (!exponent_digits) any_digits = false;
+		exponent += negative_exponent ? -e : e;
+	}
+
+	if (any_digits && p == end && digits <= 19 && mantissa <= (uint64_t(1) << 53) &&
+			(mantissa == 0 || (exponent >= -22 && exponent <= 22))) {
+		double value = double(mantissa);
+		if (exponent < 0) value /= powers[-exponent];
+		else if (mantissa != 0) value *= powers[exponent];
+		result = negative ? -value : value;
+		return true;
+	}
+	try {
+		result = boost::lexical_cast<double>(std::string(begin, end));
+		return true;
+	}
+	catch (const boost::bad_lexical_cast &) {
+		return false;
+	}
+}
+
+size_t num_chunks(size_t size)
+{
+	if (!ThreadPool::instance()->isParallel()) return 1;
+	return std::max<size_t>(1, std::min<size_t>(size / MIN_CHUNK_SIZE, ThreadPool::instance()->numThreads() * CHUNKS_PER_THREAD));
+}
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+/*!
+	Helpers for reading text mesh files from a memory mapped buffer, split
+	into chunks which are parsed on the render threads.
+*/
+namespace ParseUtils {
+
+inline bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+inline const char *skip_space(const char *p, const char *end)
+{
+	while (p < end && is_space(*p)) ++p;
+	return p;
+}
+
+inline const char *token_end(const char *p, const char *end)
+{
+	while (p < end && !is_space(*p)) ++p;
+	return p;
+}
+
+inline bool token_equals(const char *begin, const char *end, const char *word)
+{
+	const size_t length = strlen(word);
+	return size_t(end - begin) == length && !memcmp(begin, word, length);
+}
+
+inline const char *line_end(const char *p, const char *end)
+{
+	const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+	return nl ? nl : end;
+}
+
+// Parses a decimal floating point number, which must span begin to end
+bool parse_double(const char *begin, const char *end, double &result);
+
+// Number of chunks to split a file of the given size into
+size_t num_chunks(size_t size);
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "../engine/AST.h"
+#include <boost/predef.h>
+
+class PolySet;
+
+/*!
+	Binary mesh format, for importing pre-processed geometry without parsing.
+
+	The file is a fixed size Header followed by the mesh, stored the way it
+	is laid out in memory:
+
+		double   vertices[num_vertices][3]
+		uint32_t face_ends[num_faces]     end of each face in indices
+		uint32_t indices[num_indices]     vertex indices of all faces
+
+	All values are little endian. The content hash covers everything after
+	the header, so a truncated or damaged file is rejected instead of
+	imported.
+
+	A file written as the import cache of another file records the size and
+	modification time of that file, see Source.
+*/
+namespace ScadMesh {
+
+const char MAGIC[8] = {'S', 'C', 'A', 'D', 'M', 'E', 'S', 'H'};
+const uint32_t VERSION = 1;
+const char *const EXTENSION = ".scadmesh";
+
+enum Flags : uint32_t {
+	BOUNDING_BOX = 1 << 0,
+	SOURCE = 1 << 1,
+};
+
+struct Header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint64_t num_vertices;
+	uint64_t num_faces;
+	uint64_t num_indices;
+	// Size and modification time of the file this is a cache of, if flags has SOURCE
+	uint64_t source_size;
+	int64_t source_mtime;
+	uint64_t hash[2];
+	// Minimum and maximum corner of the vertices used by faces, if flags has BOUNDING_BOX
+	double bbox[6];
+};
+static_assert(sizeof(Header) == 120, "ScadMesh::Header must not be padded");
+
+// Identifies the version of a file an import cache was written for
+struct Source
+{
+	uint64_t size;
+	int64_t mtime;
+
+	bool operator==(const Source &other) const { return size == other.size && mtime == other.mtime; }
+};
+
+// Converts a value between host and file byte order
+template <typename T> T little_endian(T value)
+{
+#if BOOST_ENDIAN_BIG_BYTE
+	char *bytes = reinterpret_cast<char *>(&value);
+	std::reverse(bytes, bytes + sizeof(value));
+#endif
+	return value;
+}
+
+void write(const PolySet &ps, std::ostream &output, const Source *source = nullptr);
+
+/*!
+	Returns nullptr if the file can't be read or isn't a valid mesh. If
+	source is given, also if the file isn't a cache of that version of the
+	source, and without warnings, as this just means the cache is stale.
+*/
+PolySet *read(const std::string &filename, const Location &loc, const Source *source = nullptr);
+
+}
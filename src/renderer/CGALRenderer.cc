@@ -121,9 +121,10 @@ void CGALRenderer::draw(bool showfaces, bool showedges) const
 			glDisable(GL_LIGHTING);
 			setColor(ColorMode::CGAL_FACE_2D_COLOR);
 			
-			for (const auto &polygon : polyset->polygons) {
+			for (const auto &face : polyset->indices) {
 				glBegin(GL_POLYGON);
-				for (const auto &p : polygon) {
+				for (const auto idx : face) {
+					const auto &p = polyset->vertices[idx];
 					glVertex3d(p[0], p[1], 0);
 				}
 				glEnd();
@@ -204,6 +204,7 @@ void Renderer::render_surface(shared_ptr<const class Geometry> geom, csgmode_e c
 	shared_ptr<const PolySet> ps = dynamic_pointer_cast<const PolySet>(geom);
 
 	if (!ps) return;
+	const auto &vertices = ps->vertices;
 
 #ifdef ENABLE_OPENCSG
 	if (shaderinfo && shaderinfo->type == GLView::shaderinfo_t::CSG_RENDERING) {
@@ -218,38 +219,38 @@ void Renderer::render_surface(shared_ptr<const class Geometry> geom, csgmode_e c
 
 		// Render top+bottom
 		for (double z = -zbase/2; z < zbase; z += zbase) {
-			for (size_t i = 0; i < ps->polygons.size(); ++i) {
-				const Polygon *poly = &ps->polygons[i];
-				if (poly->size() == 3) {
+			for (size_t i = 0; i < ps->indices.size(); ++i) {
+				const auto &face = ps->indices[i];
+				if (face.size() == 3) {
 					if (z < 0) {
-						gl_draw_triangle(shaderinfo, poly->at(0), poly->at(2), poly->at(1), true, true, true, z, mirrored);
+						gl_draw_triangle(shaderinfo, vertices[face[0]], vertices[face[2]], vertices[face[1]], true, true, true, z, mirrored);
 					} else {
-						gl_draw_triangle(shaderinfo, poly->at(0), poly->at(1), poly->at(2), true, true, true, z, mirrored);
+						gl_draw_triangle(shaderinfo, vertices[face[0]], vertices[face[1]], vertices[face[2]], true, true, true, z, mirrored);
 					}
 				}
-				else if (poly->size() == 4) {
+				else if (face.size() == 4) {
 					if (z < 0) {
-						gl_draw_triangle(shaderinfo, poly->at(0), poly->at(3), poly->at(1), true, false, true, z, mirrored);
-						gl_draw_triangle(shaderinfo, poly->at(2), poly->at(1), poly->at(3), true, false, true, z, mirrored);
+						gl_draw_triangle(shaderinfo, vertices[face[0]], vertices[face[3]], vertices[face[1]], true, false, true, z, mirrored);
+						gl_draw_triangle(shaderinfo, vertices[face[2]], vertices[face[1]], vertices[face[3]], true, false, true, z, mirrored);
 					} else {
-						gl_draw_triangle(shaderinfo, poly->at(0), poly->at(1), poly->at(3), true, false, true, z, mirrored);
-						gl_draw_triangle(shaderinfo, poly->at(2), poly->at(3), poly->at(1), true, false, true, z, mirrored);
+						gl_draw_triangle(shaderinfo, vertices[face[0]], vertices[face[1]], vertices[face[3]], true, false, true, z, mirrored);
+						gl_draw_triangle(shaderinfo, vertices[face[2]], vertices[face[3]], vertices[face[1]], true, false, true, z, mirrored);
 					}
 				}
 				else {
 					Vector3d center = Vector3d::Zero();
-					for (size_t j = 0; j < poly->size(); ++j) {
-						center[0] += poly->at(j)[0];
-						center[1] += poly->at(j)[1];
+					for (size_t j = 0; j < face.size(); ++j) {
+						center[0] += vertices[face[j]][0];
+						center[1] += vertices[face[j]][1];
 					}
-					center[0] /= poly->size();
-					center[1] /= poly->size();
-					for (size_t j = 1; j <= poly->size(); ++j) {
+					center[0] /= face.size();
+					center[1] /= face.size();
+					for (size_t j = 1; j <= face.size(); ++j) {
 						if (z < 0) {
-							gl_draw_triangle(shaderinfo, center, poly->at(j % poly->size()), poly->at(j - 1),
+							gl_draw_triangle(shaderinfo, center, vertices[face[j % face.size()]], vertices[face[j - 1]],
 									false, true, false, z, mirrored);
 						} else {
-							gl_draw_triangle(shaderinfo, center, poly->at(j - 1), poly->at(j % poly->size()),
+							gl_draw_triangle(shaderinfo, center, vertices[face[j - 1]], vertices[face[j % face.size()]],
 									false, true, false, z, mirrored);
 						}
 					}
@@ -273,12 +274,11 @@ void Renderer::render_surface(shared_ptr<const class Geometry> geom, csgmode_e c
 		else {
 			// If we don't have borders, use the polygons as borders.
 			// FIXME: When is this used?
-			const Polygons *borders_p = &ps->polygons;
-			for (size_t i = 0; i < borders_p->size(); ++i) {
-				const Polygon *poly = &borders_p->at(i);
-				for (size_t j = 1; j <= poly->size(); ++j) {
-					Vector3d p1 = poly->at(j - 1), p2 = poly->at(j - 1);
-					Vector3d p3 = poly->at(j % poly->size()), p4 = poly->at(j % poly->size());
+			for (size_t i = 0; i < ps->indices.size(); ++i) {
+				const auto &face = ps->indices[i];
+				for (size_t j = 1; j <= face.size(); ++j) {
+					Vector3d p1 = vertices[face[j - 1]], p2 = vertices[face[j - 1]];
+					Vector3d p3 = vertices[face[j % face.size()]], p4 = vertices[face[j % face.size()]];
 					p1[2] -= zbase/2, p2[2] += zbase/2;
 					p3[2] -= zbase/2, p4[2] += zbase/2;
 					gl_draw_triangle(shaderinfo, p2, p1, p3, true, true, false, 0, mirrored);
@@ -288,28 +288,28 @@ void Renderer::render_surface(shared_ptr<const class Geometry> geom, csgmode_e c
 		}
 		glEnd();
 	} else if (ps->getDimension() == 3) {
-		for (size_t i = 0; i < ps->polygons.size(); ++i) {
-			const Polygon *poly = &ps->polygons[i];
+		for (size_t i = 0; i < ps->indices.size(); ++i) {
+			const auto &face = ps->indices[i];
 			glBegin(GL_TRIANGLES);
-			if (poly->size() == 3) {
-				gl_draw_triangle(shaderinfo, poly->at(0), poly->at(1), poly->at(2), true, true, true, 0, mirrored);
+			if (face.size() == 3) {
+				gl_draw_triangle(shaderinfo, vertices[face[0]], vertices[face[1]], vertices[face[2]], true, true, true, 0, mirrored);
 			}
-			else if (poly->size() == 4) {
-				gl_draw_triangle(shaderinfo, poly->at(0), poly->at(1), poly->at(3), true, false, true, 0, mirrored);
-				gl_draw_triangle(shaderinfo, poly->at(2), poly->at(3), poly->at(1), true, false, true, 0, mirrored);
+			else if (face.size() == 4) {
+				gl_draw_triangle(shaderinfo, vertices[face[0]], vertices[face[1]], vertices[face[3]], true, false, true, 0, mirrored);
+				gl_draw_triangle(shaderinfo, vertices[face[2]], vertices[face[3]], vertices[face[1]], true, false, true, 0, mirrored);
 			}
 			else {
 				Vector3d center = Vector3d::Zero();
-				for (size_t j = 0; j < poly->size(); ++j) {
-					center[0] += poly->at(j)[0];
-					center[1] += poly->at(j)[1];
-					center[2] += poly->at(j)[2];
+				for (size_t j = 0; j < face.size(); ++j) {
+					center[0] += vertices[face[j]][0];
+					center[1] += vertices[face[j]][1];
+					center[2] += vertices[face[j]][2];
 				}
-				center[0] /= poly->size();
-				center[1] /= poly->size();
-				center[2] /= poly->size();
-				for (size_t j = 1; j <= poly->size(); ++j) {
-					gl_draw_triangle(shaderinfo, center, poly->at(j - 1), poly->at(j % poly->size()), false, true, false, 0, mirrored);
+				center[0] /= face.size();
+				center[1] /= face.size();
+				center[2] /= face.size();
+				for (size_t j = 1; j <= face.size(); ++j) {
+					gl_draw_triangle(shaderinfo, center, vertices[face[j - 1]], vertices[face[j % face.size()]], false, true, false, 0, mirrored);
 				}
 			}
 			glEnd();
@@ -331,6 +331,7 @@ void Renderer::render_edges(shared_ptr<const Geometry> geom, csgmode_e csgmode)
 	shared_ptr<const PolySet> ps = dynamic_pointer_cast<const PolySet>(geom);
 
 	if (!ps) return;
+	const auto &vertices = ps->vertices;
 
 	glDisable(GL_LIGHTING);
 	if (ps->getDimension() == 2) {
@@ -367,11 +368,11 @@ void Renderer::render_edges(shared_ptr<const Geometry> geom, csgmode_e csgmode)
 			}
 		}
 	} else if (ps->getDimension() == 3) {
-		for (size_t i = 0; i < ps->polygons.size(); ++i) {
-			const Polygon *poly = &ps->polygons[i];
+		for (size_t i = 0; i < ps->indices.size(); ++i) {
+			const auto &face = ps->indices[i];
 			glBegin(GL_LINE_LOOP);
-			for (size_t j = 0; j < poly->size(); ++j) {
-				const Vector3d &p = poly->at(j);
+			for (size_t j = 0; j < face.size(); ++j) {
+				const Vector3d &p = vertices[face[j]];
 				glVertex3d(p[0], p[1], p[2]);
 			}
 			glEnd();
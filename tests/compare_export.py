@@ -0,0 +1,168 @@
+#!/usr/bin/env python
+
+# Export comparison test
+#
+#
+# Usage: <script> <inputfile> --openscad=<executable-path> --format=<format> [--reference=<file>]
+#          [--reference-args=<args>] [--test-args=<args>] [--runs=<n>] [--reimport] [--no-reference]
+#          [--retval=<n>] [--expect=<regex>]... [--count=<n>:<regex>]... [--check-file=<file> [--file-expect=<regex>]...]
+#          [--output-dir=<dir>] [<openscad args>]
+#
+#
+# step 1. If an input file is _not_ an .scad file, create a temporary .scad file importing it.
+# step 2. Export the reference file (the input file if not given) with the openscad args and
+#         the reference args.
+# step 3. Export the input file with the openscad args and the test args, --runs times.
+# step 4. Fail unless each export of step 3 is identical to the export of step 2 (skipped with
+#         --no-reference), each --expect regex matches the output of the last run, and each
+#         --count regex matches the given number of times in the last export. With --retval, the
+#         exports of step 3 must fail with that return value instead, e.g. 1 for an empty result,
+#         and write nothing to compare. With --check-file,
+#         also fail unless the last run wrote that file, it parses if it's a .json file, and each
+#         --file-expect regex matches it.
+# step 5. With --reimport, import the export of step 2 and repeat steps 2-4 on that.
+#
+# This allows checking that options which should only change how a result is computed,
+# e.g. the number of threads or caching, don't change the result, without expected files.
+# 3MF files are compared by their model XML, without UUIDs.
+#
+# This script should return 0 on success, not-0 on error.
+
+from __future__ import print_function
+
+import sys, os, re, subprocess, argparse, shlex, hashlib
+
+def failquit(*args):
+    if len(args)!=0: print(args)
+    print('compare_export args:',str(sys.argv))
+    print('exiting compare_export.py with failure')
+    sys.exit(1)
+
+def createImport(inputfile, scadfile):
+    print('createImport: ' + inputfile + " " + scadfile)
+    try:
+        f = open(scadfile,'w')
+        f.write('import("'+os.path.abspath(inputfile).replace('\\','/')+'");'+os.linesep)
+        f.close()
+    except:
+        failquit('failure while opening/writing ' + scadfile + ': ' + str(sys.exc_info()))
+
+def scadFile(inputfile, name):
+    if os.path.splitext(inputfile)[1] in ['.scad', '.csg']: return inputfile
+    scadfile = os.path.join(outputdir, name + '.scad')
+    createImport(inputfile, scadfile)
+    return scadfile
+
+def readExport(filename):
+    if args.format == '3mf':
+        from zipfile import ZipFile
+        xml_content = ZipFile(filename).read("3D/3dmodel.model").decode('utf-8')
+        return re.sub('UUID="[^"]*"', 'UUID=""', xml_content).encode('utf-8')
+    with open(filename, 'rb') as f:
+        return f.read()
+
+def export(inputfile, exportfile, extra_args, retval=0):
+    cmd = [args.openscad, inputfile, '-o', exportfile] + extra_args
+    if export_format is not None:
+        cmd.extend(['--export-format', export_format])
+    print('Running OpenSCAD:', file=sys.stderr)
+    print(' '.join(cmd), file=sys.stderr)
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    log = proc.communicate()[0].decode('utf-8', 'replace')
+    print(log, file=sys.stderr)
+    if proc.returncode != retval:
+        failquit('OpenSCAD failed with return code ' + str(proc.returncode) + ', expected ' + str(retval))
+    if retval != 0:
+        return None, log
+    return readExport(exportfile), log
+
+def checkFile():
+    try:
+        with open(args.checkfile, 'rb') as f:
+            content = f.read().decode('utf-8', 'replace')
+    except IOError:
+        failquit('cant read file written by OpenSCAD: ' + args.checkfile)
+    if os.path.splitext(args.checkfile)[1] == '.json':
+        import json
+        try:
+            json.loads(content)
+        except ValueError as e:
+            failquit('invalid JSON in ' + args.checkfile + ': ' + str(e))
+    for regex in args.fileexpect:
+        if not re.search(regex, content):
+            failquit(args.checkfile + ' does not match ' + regex)
+
+def compare(inputfile, reference, name):
+    reffile = os.path.join(outputdir, name + '-reference.' + args.format)
+    expected = None
+    if not args.noreference:
+        expected = export(scadFile(reference, name + '-reference'), reffile, remaining_args + reference_args)[0]
+    scadfile = scadFile(inputfile, name)
+    exportfile = os.path.join(outputdir, name + '.' + args.format)
+    for run in range(args.runs):
+        if args.checkfile and os.path.exists(args.checkfile): os.remove(args.checkfile)
+        actual, log = export(scadfile, exportfile, remaining_args + test_args, args.retval)
+        if expected is not None and actual != expected:
+            failquit('Export of run ' + str(run + 1) + ' differs from the reference: ' + exportfile + ' ' + reffile)
+    for regex in args.expect:
+        if not re.search(regex, log):
+            failquit('Output does not match ' + regex)
+    for count in args.count:
+        n, regex = count.split(':', 1)
+        found = len(re.findall(regex.encode('utf-8'), actual or b''))
+        if found != int(n):
+            failquit('Export has ' + str(found) + ' matches of ' + regex + ', expected ' + n)
+    if args.checkfile: checkFile()
+    return reffile if expected is not None else exportfile
+
+#
+# Parse arguments
+#
+formats = ['asciistl', 'binstl', 'stl', 'off', 'amf', '3mf', 'scadmesh']
+parser = argparse.ArgumentParser()
+parser.add_argument('--openscad', required=True, help='Specify OpenSCAD executable')
+parser.add_argument('--format', required=True, choices=[item for sublist in [(f,f.upper()) for f in formats] for item in sublist], help='Specify 3d export format')
+parser.add_argument('--reference', help='Input file of the reference export')
+parser.add_argument('--reference-args', dest='referenceargs', default='', help='OpenSCAD args of the reference export')
+parser.add_argument('--test-args', dest='testargs', default='', help='OpenSCAD args of the compared exports')
+parser.add_argument('--runs', type=int, default=1, help='Number of compared exports')
+parser.add_argument('--reimport', action='store_true', help='Compare imports of the reference export as well')
+parser.add_argument('--no-reference', dest='noreference', action='store_true', help='Only check --expect and --count')
+parser.add_argument('--retval', type=int, default=0, help='Return value of the compared exports')
+parser.add_argument('--expect', action='append', default=[], help='Regex the output of the last run must match')
+parser.add_argument('--count', action='append', default=[], help='<n>:<regex> the last export must match n times')
+parser.add_argument('--check-file', dest='checkfile', help='File the last run must write')
+parser.add_argument('--file-expect', dest='fileexpect', action='append', default=[], help='Regex the --check-file must match')
+parser.add_argument('--output-dir', dest='outputdir', default='output', help='Directory of the exported files')
+args,remaining_args = parser.parse_known_args()
+
+args.format = args.format.lower()
+if args.retval != 0 and not args.noreference:
+    failquit('--retval requires --no-reference')
+reference_args = shlex.split(args.referenceargs)
+test_args = shlex.split(args.testargs)
+
+export_format = None
+if args.format in ['asciistl', 'binstl']:
+    export_format = args.format
+    args.format = 'stl'
+
+inputfile = remaining_args[0]
+remaining_args = remaining_args[1:] # Passed on to the OpenSCAD executable
+
+if not os.path.exists(inputfile):
+    failquit('cant find input file named: ' + inputfile)
+if not os.path.exists(args.openscad):
+    failquit('cant find openscad executable named: ' + args.openscad)
+
+basename = os.path.splitext(os.path.split(inputfile)[1])[0]
+# Tests may share input files and run in parallel, so each gets its own directory
+outputdir = os.path.join(args.outputdir, 'compare_export', basename + '-' + hashlib.md5(' '.join(sys.argv[1:]).encode('utf-8')).hexdigest()[:8])
+try:
+    if not os.path.exists(outputdir): os.makedirs(outputdir)
+except OSError:
+    pass
+
+reference = compare(inputfile, args.reference or inputfile, basename)
+if args.reimport:
+    compare(reference, reference, basename + '-reimport')